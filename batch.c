@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "chip8_batch.h"
+
+/* ---- Defines ----*/
+
+#define DEFAULT_CYCLES  100000
+
+/* ---- Batch runner ---- */
+
+static const char* status_names[] = {
+    [C8_BATCH_PENDING] = "pending",
+    [C8_BATCH_OK]      = "ok",
+    [C8_BATCH_LOAD]    = "load_error",
+    [C8_BATCH_KEYWAIT] = "waiting_key",
+    [C8_BATCH_FAULT]   = "fault"
+};
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-j threads] [-n cycles] [-e engine] [-x index] rom...\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long cycles = DEFAULT_CYCLES;
+    int threads = 0;
+    int opt = 0;
+    C8_ENGINE engine = C8_ENGINE_SANDBOX; /* Corpora hold broken ROMs */
+    int failed = 0;
+    C8BatchJob* jobs = NULL;
+    size_t count = 0;
+    C8RomLib lib;
+    const char* index = NULL;
+
+    while((opt = getopt(argc, argv, "j:n:e:x:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            cycles = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            if(c8_engine_by_name(optarg, &engine) != 0)
+            {
+                fprintf(stderr, "Unknown engine %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'x':
+            index = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    count = argc - optind;
+    jobs = calloc(count, sizeof(C8BatchJob));
+    if(jobs == NULL)
+    {
+        return 1;
+    }
+
+    /* Map the corpus once, the workers copy from the shared mappings */
+    c8_romlib_init(&lib);
+    if(index != NULL)
+    {
+        c8_romlib_read_index(&lib, index); /* A missing index is rebuilt */
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        jobs[i].rom = argv[optind + i];
+        jobs[i].image = c8_romlib_add(&lib, jobs[i].rom);
+    }
+
+    if(c8_batch_run(jobs, count, cycles, engine, threads) != 0)
+    {
+        fprintf(stderr, "Failed to start the worker pool\n");
+        c8_romlib_free(&lib);
+        free(jobs);
+        return 1;
+    }
+
+    if(index != NULL && c8_romlib_write_index(&lib, index) != 0)
+    {
+        fprintf(stderr, "Failed to write %s\n", index);
+    }
+
+    /* Report as CSV */
+    printf("rom,status,cycles,display_hash,worker,rom_hash,platform,fault,fault_pc,fault_opcode\n");
+    for(size_t i = 0; i < count; i++)
+    {
+        const C8Rom* rom = jobs[i].image;
+
+        printf("%s,%s,%lu,%08x,%d,%016llx,%s,%s,%04x,%04x\n", jobs[i].rom,
+               status_names[jobs[i].status],
+               jobs[i].cycles, jobs[i].display_hash, jobs[i].worker,
+               (rom != NULL) ? (unsigned long long)rom->hash : 0ull,
+               (rom != NULL) ? c8_platform_name(rom->platform) : "",
+               c8_fault_name(jobs[i].fault.kind), jobs[i].fault.pc, jobs[i].fault.opcode);
+
+        if(jobs[i].status == C8_BATCH_PENDING || jobs[i].status == C8_BATCH_LOAD)
+        {
+            failed++;
+        }
+    }
+
+    c8_romlib_free(&lib);
+    free(jobs);
+
+    return (failed == 0) ? 0 : 2;
+}
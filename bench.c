@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_lanes.h"
+
+/* ---- Defines ----*/
+
+#define SECOND_TO_NS        1000000000ULL
+#define DEFAULT_CYCLES      20000000UL
+#define OPCODE_CLASSES      16
+#define CALIBRATION_LOOPS   1000000
+
+/* ---- Benchmark harness (no SDL) ---- */
+
+static const char* c8_class_names[OPCODE_CLASSES] = {
+    "0nnn SYS/CLS/RET", "1nnn JP", "2nnn CALL", "3xkk SE",
+    "4xkk SNE", "5xy0 SE", "6xkk LD", "7xkk ADD",
+    "8xyN ALU", "9xy0 SNE", "Annn LD I", "Bnnn JP V0",
+    "Cxkk RND", "Dxyn DRW", "ExNN SKP", "FxNN MISC"
+};
+
+static const char* c8_bundled_roms[] = {
+    "test_opcode.ch8"
+};
+
+/* A loop running every opcode class each lap, on the switch engine it never  */
+/* idles, overflows the stack or leaves memory: the per-class costs are taken */
+/* on it rather than on the ROMs, which mostly spin in a 1nnn once finished   */
+static const UBIT8 c8_class_mix[] = {
+    0x60, 0x05, /* 200: LD V0, 05      */
+    0x61, 0x03, /* 202: LD V1, 03      */
+    0x71, 0x01, /* 204: ADD V1, 01     */
+    0x80, 0x14, /* 206: ADD V0, V1     */
+    0x30, 0x00, /* 208: SE V0, 00      */
+    0x40, 0x09, /* 20A: SNE V0, 09     */
+    0x50, 0x10, /* 20C: SE V0, V1      */
+    0x90, 0x10, /* 20E: SNE V0, V1     */
+    0x50, 0x10, /* 210: SE V0, V1, skipped */
+    0xC2, 0xFF, /* 212: RND V2, FF     */
+    0xA3, 0x00, /* 214: LD I, 300      */
+    0xF2, 0x33, /* 216: LD B, V2       */
+    0xF2, 0x65, /* 218: LD V2, [I]     */
+    0xF0, 0x29, /* 21A: LD F, V0       */
+    0xD1, 0x25, /* 21C: DRW V1, V2, 5  */
+    0xE3, 0x9E, /* 21E: SKP V3         */
+    0x22, 0x2A, /* 220: CALL 22A       */
+    0x60, 0x00, /* 222: LD V0, 00      */
+    0xB2, 0x28, /* 224: JP V0, 228     */
+    0x12, 0x00, /* 226: JP 200, skipped */
+    0x12, 0x00, /* 228: JP 200         */
+    0x00, 0xE0, /* 22A: CLS            */
+    0x00, 0xEE  /* 22C: RET            */
+};
+
+static const char* c8_engines[] = {
+    "switch", "predecoded", "jit", "sandbox"
+};
+
+#define ENGINES (sizeof(c8_engines) / sizeof(c8_engines[0]))
+
+typedef struct
+{
+    unsigned long cycles[ENGINES];
+    UBIT64        elapsed_ns[ENGINES];
+} bench_result;
+
+typedef struct
+{
+    unsigned long count[OPCODE_CLASSES];
+    UBIT64        ns[OPCODE_CLASSES];
+} bench_classes;
+
+/* Machine state a lane must end with, taken from its machine */
+typedef struct
+{
+    UBIT16 pc;
+    UBIT16 index;
+    UBIT16 sp;
+    UBIT16 delay_timer;
+    UBIT16 sound_timer;
+    UBIT8  registers[16];
+    UBIT64 display[DISP_H];
+} bench_lane_end;
+
+static UBIT64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UBIT64)ts.tv_sec * SECOND_TO_NS + ts.tv_nsec;
+}
+
+/* This function measures the cost of an empty pair of clock reads */
+static UBIT64 bench_clock_overhead(void)
+{
+    UBIT64 start = now_ns();
+
+    for(int i = 0; i < CALIBRATION_LOOPS; i++)
+    {
+        now_ns();
+    }
+
+    return (now_ns() - start) / CALIBRATION_LOOPS;
+}
+
+/* This function resets a machine for a measure */
+static void bench_reset(Chip8* chip8)
+{
+    c8_deinit(chip8);
+    c8_init(chip8);
+
+    /* Measure the engines: fast-forwarded idle loops would inflate the rates */
+    chip8->fast_idle = STD_FALSE;
+}
+
+/* This function loads a fresh machine with the given ROM */
+static int bench_load(Chip8* chip8, char* rom)
+{
+    bench_reset(chip8);
+
+    return chip8->load_rom(chip8, rom);
+}
+
+/* This function runs a ROM once per engine, untouched */
+static int bench_rom(Chip8* chip8, char* rom, unsigned long cycles, bench_result* res)
+{
+    UBIT64 start = 0;
+
+    for(size_t e = 0; e < ENGINES; e++)
+    {
+        if(bench_load(chip8, rom) != 0)
+        {
+            return 1;
+        }
+
+        c8_set_engine(chip8, c8_engines[e]);
+
+        start = now_ns();
+        res->cycles[e] = c8_run(chip8, cycles);
+        res->elapsed_ns[e] = now_ns() - start;
+    }
+
+    return 0;
+}
+
+/* This function times every single instruction of the switch engine on the */
+/* class mix loop, to split the cost by opcode class                         */
+static void bench_class_mix(Chip8* chip8, unsigned long cycles, UBIT64 overhead, bench_classes* res)
+{
+    bench_reset(chip8);
+    c8_load_program(chip8, c8_class_mix, sizeof(c8_class_mix));
+
+    for(unsigned long i = 0; i < cycles; i++)
+    {
+        UBIT8 op_class = chip8->memory[chip8->pc] >> 4;
+        UBIT64 t0 = now_ns();
+
+        chip8->loop(chip8);
+
+        UBIT64 t1 = now_ns() - t0;
+
+        res->count[op_class]++;
+        res->ns[op_class] += (t1 > overhead) ? (t1 - overhead) : 0;
+    }
+}
+
+static void bench_lane_end_take(bench_lane_end* end, const Chip8* chip8)
+{
+    end->pc = chip8->pc;
+    end->index = chip8->index;
+    end->sp = chip8->sp;
+    end->delay_timer = chip8->delay_timer;
+    end->sound_timer = chip8->sound_timer;
+    memcpy(end->registers, chip8->registers, sizeof(end->registers));
+    memcpy(end->display, chip8->display[0], sizeof(end->display));
+}
+
+static int bench_lane_end_same(const bench_lane_end* end, const Chip8* chip8)
+{
+    return end->pc == chip8->pc && end->index == chip8->index && end->sp == chip8->sp
+        && end->delay_timer == chip8->delay_timer && end->sound_timer == chip8->sound_timer
+        && memcmp(end->registers, chip8->registers, sizeof(end->registers)) == 0
+        && memcmp(end->display, chip8->display[0], sizeof(end->display)) == 0;
+}
+
+/* This function runs _lanes_ copies of a ROM frame by frame, first as      */
+/* independent predecoded machines, then as lockstep lanes in scalar code  */
+/* and with the AVX2 kernels. Lane i is seeded with i in every run. Each    */
+/* lane must end with the registers, pc, I, timers and display of its      */
+/* machine, returns 1 when one does not.                                    */
+static int bench_lanes(char* rom, size_t lanes, unsigned long cycles, STD_BOOL csv)
+{
+    static const char* names[] = { "machines", "lanes-scalar", "lanes-avx2" };
+    unsigned long frames = cycles / (lanes * C8_DEFAULT_IPF) + 1;
+    Chip8* machines = malloc(lanes * sizeof(Chip8));
+    bench_lane_end* ends = malloc(lanes * sizeof(bench_lane_end));
+    Chip8* lane = malloc(sizeof(Chip8));
+    C8Lanes* l = c8_lanes_create(lanes);
+    int simd = 0;
+    int status = 0;
+
+    if(machines == NULL || ends == NULL || lane == NULL || l == NULL)
+    {
+        free(machines);
+        free(ends);
+        free(lane);
+        c8_lanes_free(l);
+        return 1;
+    }
+
+    c8_init(lane);
+
+    simd = l->simd;
+
+    for(size_t i = 0; i < lanes; i++)
+    {
+        c8_init(&machines[i]);
+        c8_seed(&machines[i], i);
+        machines[i].engine = C8_ENGINE_PREDECODED;
+        machines[i].fast_idle = STD_FALSE; /* Lanes run idle loops cycle by cycle */
+
+        if(machines[i].load_rom(&machines[i], rom) != 0)
+        {
+            status = 1;
+        }
+    }
+
+    /* The lanes share the program image of the machines */
+    if(status == 0 && c8_lanes_load(l, &machines[0].memory[C8_PROGRAM_START], C8_MEM_SIZE - C8_PROGRAM_START, 0) != 0)
+    {
+        status = 1;
+    }
+
+    for(int run = 0; run < 3 && status == 0; run++)
+    {
+        unsigned long executed = 0;
+        UBIT64 start = 0;
+        UBIT64 elapsed = 0;
+        double ips = 0;
+
+        if(run == 2 && simd == 0)
+        {
+            break;
+        }
+
+        for(size_t i = 0; run > 0 && i < lanes; i++)
+        {
+            c8_lanes_set(l, i, &machines[i]);
+        }
+
+        l->simd = (run == 2) ? simd : 0;
+        start = now_ns();
+
+        for(unsigned long f = 0; f < frames; f++)
+        {
+            if(run > 0)
+            {
+                executed += c8_lanes_run_frame(l, C8_DEFAULT_IPF);
+                continue;
+            }
+
+            for(size_t i = 0; i < lanes; i++)
+            {
+                executed += c8_run_frame(&machines[i], C8_DEFAULT_IPF);
+            }
+        }
+
+        elapsed = now_ns() - start;
+
+        /* Every lane must end where its machine did */
+        for(size_t i = 0; run > 0 && i < lanes; i++)
+        {
+            c8_lanes_get(l, i, lane);
+
+            if(!bench_lane_end_same(&ends[i], lane))
+            {
+                fprintf(stderr, "%s: lane %zu ends at pc %03X I %03X, its machine at pc %03X I %03X\n",
+                        names[run], i, lane->pc, lane->index, ends[i].pc, ends[i].index);
+                status = 1;
+                break;
+            }
+        }
+
+        /* The lanes restart from the loaded machines */
+        for(size_t i = 0; run == 0 && i < lanes; i++)
+        {
+            bench_lane_end_take(&ends[i], &machines[i]);
+            c8_deinit(&machines[i]);
+            c8_init(&machines[i]);
+            c8_seed(&machines[i], i);
+            machines[i].engine = C8_ENGINE_PREDECODED;
+            machines[i].fast_idle = STD_FALSE;
+            machines[i].load_rom(&machines[i], rom);
+        }
+
+        ips = executed / ((double)(elapsed ? elapsed : 1) / SECOND_TO_NS);
+
+        if(csv == STD_TRUE)
+        {
+            printf("%s,%s,all,%lu,%.0f,%.0f,%.3f\n", rom, names[run], executed, ips, ips / C8_DEFAULT_IPF, 1e9 / ips);
+            continue;
+        }
+
+        printf("  %zu %s\n", lanes, names[run]);
+        printf("    instructions/s: %.0f\n", ips);
+        printf("    frames/s:       %.0f (over all lanes)\n", ips / C8_DEFAULT_IPF);
+    }
+
+    for(size_t i = 0; i < lanes; i++)
+    {
+        c8_deinit(&machines[i]);
+    }
+
+    c8_deinit(lane);
+    free(machines);
+    free(ends);
+    free(lane);
+    c8_lanes_free(l);
+
+    return status;
+}
+
+static void bench_report(const char* rom, const bench_result* res, STD_BOOL csv)
+{
+    if(csv == STD_FALSE)
+    {
+        printf("%s\n", rom);
+    }
+
+    for(size_t e = 0; e < ENGINES; e++)
+    {
+        double seconds = (double)(res->elapsed_ns[e] ? res->elapsed_ns[e] : 1) / SECOND_TO_NS;
+        double ips = res->cycles[e] / seconds;
+        double fps = ips / C8_DEFAULT_IPF;
+
+        if(csv == STD_TRUE)
+        {
+            printf("%s,%s,all,%lu,%.0f,%.0f,%.3f\n", rom, c8_engines[e], res->cycles[e], ips, fps, 1e9 / ips);
+            continue;
+        }
+
+        printf("  %s engine\n", c8_engines[e]);
+        printf("    instructions/s: %.0f\n", ips);
+        printf("    frames/s:       %.0f (%d instructions per frame)\n", fps, C8_DEFAULT_IPF);
+        printf("    ns/instruction: %.3f\n", 1e9 / ips);
+    }
+
+}
+
+static void bench_report_classes(const bench_classes* res, STD_BOOL csv)
+{
+    if(csv == STD_FALSE)
+    {
+        printf("class mix loop\n");
+        printf("  %-18s %12s %10s\n", "class (switch)", "count", "ns/op");
+    }
+
+    for(int i = 0; i < OPCODE_CLASSES; i++)
+    {
+        if(res->count[i] == 0)
+            continue;
+
+        if(csv == STD_TRUE)
+        {
+            printf("mix,switch,%X,%lu,,,%.3f\n", i, res->count[i], (double)res->ns[i] / res->count[i]);
+        }
+        else
+        {
+            printf("  %-18s %12lu %10.3f\n", c8_class_names[i], res->count[i], (double)res->ns[i] / res->count[i]);
+        }
+    }
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n cycles] [-l lanes] [-c] [rom...]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long cycles = DEFAULT_CYCLES;
+    size_t lanes = 0;
+    STD_BOOL csv = STD_FALSE;
+    Chip8* chip8 = NULL;
+    char** roms = (char**)c8_bundled_roms;
+    int count = sizeof(c8_bundled_roms) / sizeof(c8_bundled_roms[0]);
+    UBIT64 overhead = 0;
+    bench_classes classes = { 0 };
+    int failed = 0;
+    int opt = 0;
+
+    while((opt = getopt(argc, argv, "n:l:c")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            cycles = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            lanes = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            csv = STD_TRUE;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind < argc)
+    {
+        roms = &argv[optind];
+        count = argc - optind;
+    }
+
+    chip8 = malloc(sizeof(Chip8));
+    if(chip8 == NULL)
+    {
+        return 1;
+    }
+
+    c8_init(chip8);
+    overhead = bench_clock_overhead();
+
+    if(csv == STD_TRUE)
+    {
+        printf("rom,engine,class,count,ips,fps,ns_per_op\n");
+    }
+
+    bench_class_mix(chip8, cycles, overhead, &classes);
+    bench_report_classes(&classes, csv);
+
+    for(int i = 0; i < count; i++)
+    {
+        bench_result res = { 0 };
+
+        if(bench_rom(chip8, roms[i], cycles, &res) != 0)
+        {
+            fprintf(stderr, "Failed to load %s\n", roms[i]);
+            failed++;
+            continue;
+        }
+
+        bench_report(roms[i], &res, csv);
+
+        if(lanes > 0 && bench_lanes(roms[i], lanes, cycles, csv) != 0)
+        {
+            fprintf(stderr, "Failed to run %s on %zu lanes\n", roms[i], lanes);
+            failed++;
+        }
+    }
+
+    c8_deinit(chip8);
+    free(chip8);
+
+    return (failed == 0) ? 0 : 1;
+}
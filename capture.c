@@ -0,0 +1,593 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_capture.h"
+
+/* ---- Defines ----*/
+
+#define DEFAULT_SCALE 4  /* Output pixels per hires pixel */
+#define MAX_SCALE     16
+#define PALETTE_SIZE  4
+#define GIF_MIN_CS    2  /* Shortest GIF frame delay players honour (centiseconds) */
+
+/* ---- Capture decoder (no SDL) ---- */
+
+typedef struct
+{
+    int    scale;
+    int    w, h;                  /* Output size: the hires display, scaled */
+    UBIT32 palette[PALETTE_SIZE]; /* 0xRRGGBB per colour index, 0 is the background */
+} image_options;
+
+/* This function renders the display to one palette index per pixel. Low */
+/* resolution frames are doubled, so every frame has the same size.      */
+static void render(const C8CaptureReader* reader, const image_options* o, UBIT8* pixels)
+{
+    int unit = o->scale * (reader->hires ? 1 : 2);
+
+    for(int y = 0; y < o->h; y++)
+    {
+        for(int x = 0; x < o->w; x++)
+        {
+            pixels[y * o->w + x] = c8_capture_pixel(reader, x / unit, y / unit);
+        }
+    }
+}
+
+/* ---- PNG ---- */
+
+typedef struct
+{
+    UBIT8* out;
+    size_t n;
+    UBIT32 bits;
+    int    count;
+} bit_writer;
+
+/* This function appends _n_ bits, least significant first (deflate order) */
+static void put_bits(bit_writer* bw, UBIT32 value, int n)
+{
+    bw->bits |= value << bw->count;
+    bw->count += n;
+
+    while(bw->count >= 8)
+    {
+        bw->out[bw->n++] = (UBIT8)bw->bits;
+        bw->bits >>= 8;
+        bw->count -= 8;
+    }
+}
+
+/* This function appends a Huffman code, sent most significant bit first */
+static void put_code(bit_writer* bw, UBIT32 code, int n)
+{
+    UBIT32 reversed = 0;
+
+    for(int i = 0; i < n; i++)
+    {
+        reversed |= ((code >> i) & 1) << (n - 1 - i);
+    }
+
+    put_bits(bw, reversed, n);
+}
+
+/* This function appends a symbol of the fixed literal/length code */
+static void put_symbol(bit_writer* bw, int symbol)
+{
+    if(symbol < 144)
+        put_code(bw, 0x30 + symbol, 8);
+    else if(symbol < 256)
+        put_code(bw, 0x190 + symbol - 144, 9);
+    else if(symbol < 280)
+        put_code(bw, symbol - 256, 7);
+    else
+        put_code(bw, 0xC0 + symbol - 280, 8);
+}
+
+static void put_match(bit_writer* bw, int length, int distance)
+{
+    static const UBIT16 length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const UBIT8 length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const UBIT16 distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                              257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                              8193, 12289, 16385, 24577 };
+    int l = 28;
+    int d = 29;
+
+    while(length_base[l] > length)
+        l--;
+    while(distance_base[d] > distance)
+        d--;
+
+    put_symbol(bw, 257 + l);
+    put_bits(bw, length - length_base[l], length_extra[l]);
+    put_code(bw, d, 5);
+    put_bits(bw, distance - distance_base[d], (d < 4) ? 0 : d / 2 - 1);
+}
+
+/* This function compresses _raw_ as one fixed Huffman deflate block. The   */
+/* only matches tried are runs (distance 1) and the previous row (_stride_), */
+/* which is all a scaled display needs. _out_ holds 9/8 of _n_ plus 16.      */
+static size_t deflate_rows(const UBIT8* raw, size_t n, size_t stride, UBIT8* out)
+{
+    bit_writer bw = { out, 0, 0, 0 };
+    size_t distances[2] = { 1, stride };
+    size_t i = 0;
+
+    put_bits(&bw, 1, 1); /* Final block */
+    put_bits(&bw, 1, 2); /* Fixed Huffman codes */
+
+    while(i < n)
+    {
+        size_t best = 0;
+        size_t best_distance = 0;
+
+        for(int k = 0; k < 2; k++)
+        {
+            size_t d = distances[k];
+            size_t len = 0;
+
+            if(d > i || d > 32768)
+                continue;
+
+            while(i + len < n && len < 258 && raw[i + len] == raw[i + len - d])
+                len++;
+
+            if(len > best)
+            {
+                best = len;
+                best_distance = d;
+            }
+        }
+
+        if(best >= 3)
+        {
+            put_match(&bw, (int)best, (int)best_distance);
+            i += best;
+        }
+        else
+        {
+            put_symbol(&bw, raw[i++]);
+        }
+    }
+
+    put_symbol(&bw, 256);
+    put_bits(&bw, 0, 7); /* Flush to a byte */
+
+    return bw.n;
+}
+
+static UBIT32 crc32_update(UBIT32 crc, const UBIT8* data, size_t n)
+{
+    crc = ~crc;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        crc ^= data[i];
+
+        for(int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+static void put_be32(UBIT8* p, UBIT32 v)
+{
+    p[0] = (UBIT8)(v >> 24);
+    p[1] = (UBIT8)(v >> 16);
+    p[2] = (UBIT8)(v >> 8);
+    p[3] = (UBIT8)v;
+}
+
+/* This function writes one PNG chunk, returns 0 on success */
+static int png_chunk(FILE* f, const char* type, const UBIT8* data, size_t n)
+{
+    UBIT8 word[4];
+    UBIT32 crc = crc32_update(0, (const UBIT8*)type, 4);
+
+    crc = crc32_update(crc, data, n);
+    put_be32(word, (UBIT32)n);
+
+    if(fwrite(word, 1, 4, f) != 4 || fwrite(type, 1, 4, f) != 4 || fwrite(data, 1, n, f) != n)
+    {
+        return 1;
+    }
+
+    put_be32(word, crc);
+
+    return (fwrite(word, 1, 4, f) != 4) ? 1 : 0;
+}
+
+/* This function writes an indexed colour PNG, returns 0 on success */
+static int write_png(const char* filename, const image_options* o, const UBIT8* pixels)
+{
+    static const UBIT8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    size_t stride = (size_t)o->w + 1;
+    size_t n = stride * o->h;
+    UBIT8* raw = malloc(n);
+    UBIT8* z = malloc(n + n / 8 + 32);
+    UBIT8 header[13] = { 0 };
+    UBIT8 plte[PALETTE_SIZE * 3];
+    UBIT32 a = 1;
+    UBIT32 b = 0;
+    size_t zn = 0;
+    FILE* f = NULL;
+    int ret = 1;
+
+    if(raw == NULL || z == NULL || (f = fopen(filename, "wb")) == NULL)
+    {
+        free(raw);
+        free(z);
+        return 1;
+    }
+
+    /* Scanlines: filter type 0, then one palette index per pixel */
+    for(int y = 0; y < o->h; y++)
+    {
+        raw[y * stride] = 0;
+        memcpy(&raw[y * stride + 1], &pixels[y * o->w], o->w);
+    }
+
+    for(size_t i = 0; i < n; i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    /* zlib stream: header, deflate data, Adler-32 */
+    z[zn++] = 0x78;
+    z[zn++] = 0x01;
+    zn += deflate_rows(raw, n, stride, &z[zn]);
+    put_be32(&z[zn], (b << 16) | a);
+    zn += 4;
+
+    put_be32(&header[0], o->w);
+    put_be32(&header[4], o->h);
+    header[8] = 8; /* Bit depth */
+    header[9] = 3; /* Indexed colour */
+
+    for(int c = 0; c < PALETTE_SIZE; c++)
+    {
+        plte[c * 3] = (UBIT8)(o->palette[c] >> 16);
+        plte[c * 3 + 1] = (UBIT8)(o->palette[c] >> 8);
+        plte[c * 3 + 2] = (UBIT8)o->palette[c];
+    }
+
+    if(fwrite(signature, 1, sizeof(signature), f) == sizeof(signature) &&
+       png_chunk(f, "IHDR", header, sizeof(header)) == 0 &&
+       png_chunk(f, "PLTE", plte, sizeof(plte)) == 0 &&
+       png_chunk(f, "IDAT", z, zn) == 0 &&
+       png_chunk(f, "IEND", NULL, 0) == 0)
+    {
+        ret = 0;
+    }
+
+    if(fclose(f) != 0)
+    {
+        ret = 1;
+    }
+
+    free(raw);
+    free(z);
+
+    return ret;
+}
+
+/* ---- GIF ---- */
+
+typedef struct
+{
+    FILE*  f;
+    UBIT8  block[256]; /* Data sub-block being filled, block[0] is its size */
+    UBIT32 bits;
+    int    count;
+} gif_writer;
+
+static void gif_byte(gif_writer* gw, UBIT8 byte)
+{
+    gw->block[++gw->block[0]] = byte;
+
+    if(gw->block[0] == 255)
+    {
+        fwrite(gw->block, 1, 256, gw->f);
+        gw->block[0] = 0;
+    }
+}
+
+static void gif_code(gif_writer* gw, UBIT32 code, int size)
+{
+    gw->bits |= code << gw->count;
+    gw->count += size;
+
+    while(gw->count >= 8)
+    {
+        gif_byte(gw, (UBIT8)gw->bits);
+        gw->bits >>= 8;
+        gw->count -= 8;
+    }
+}
+
+static void write_le16(FILE* f, unsigned v)
+{
+    fputc(v & 0xFF, f);
+    fputc((v >> 8) & 0xFF, f);
+}
+
+/* This function writes the GIF header, the palette and the looping extension */
+static void gif_begin(FILE* f, const image_options* o)
+{
+    fwrite("GIF89a", 1, 6, f);
+    write_le16(f, o->w);
+    write_le16(f, o->h);
+    fputc(0x91, f); /* Global colour table of 4 entries, 2 bits per primary */
+    fputc(0, f);    /* Background colour */
+    fputc(0, f);    /* Pixel aspect ratio */
+
+    for(int c = 0; c < PALETTE_SIZE; c++)
+    {
+        fputc((o->palette[c] >> 16) & 0xFF, f);
+        fputc((o->palette[c] >> 8) & 0xFF, f);
+        fputc(o->palette[c] & 0xFF, f);
+    }
+
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, f);
+}
+
+/* This function writes one frame shown for _delay_ centiseconds, LZW compressed */
+/* with 2-bit codes: clear is 4, end of information 5                             */
+static void gif_frame(FILE* f, const image_options* o, const UBIT8* pixels, unsigned delay)
+{
+    static UBIT16 next_of[4096][PALETTE_SIZE]; /* Code of prefix + pixel, 0 if none */
+    gif_writer gw = { f, { 0 }, 0, 0 };
+    size_t n = (size_t)o->w * o->h;
+    UBIT32 prefix = pixels[0];
+    UBIT32 next = 6;
+    int size = 3;
+
+    fwrite("\x21\xF9\x04\x04", 1, 4, f); /* Graphic control: keep the frame */
+    write_le16(f, delay);
+    fputc(0, f);
+    fputc(0, f);
+
+    fputc(0x2C, f); /* Image descriptor, whole screen */
+    write_le16(f, 0);
+    write_le16(f, 0);
+    write_le16(f, o->w);
+    write_le16(f, o->h);
+    fputc(0, f);
+
+    fputc(2, f); /* Minimum code size */
+
+    memset(next_of, 0, sizeof(next_of));
+    gif_code(&gw, 4, size);
+
+    for(size_t i = 1; i < n; i++)
+    {
+        UBIT8 p = pixels[i];
+
+        if(next_of[prefix][p] != 0)
+        {
+            prefix = next_of[prefix][p];
+            continue;
+        }
+
+        gif_code(&gw, prefix, size);
+
+        if(next >= 4096)
+        {
+            /* Table full: start over */
+            gif_code(&gw, 4, size);
+            memset(next_of, 0, sizeof(next_of));
+            next = 6;
+            size = 3;
+        }
+        else
+        {
+            if(next >= (1u << size))
+            {
+                size++;
+            }
+            next_of[prefix][p] = (UBIT16)next++;
+        }
+
+        prefix = p;
+    }
+
+    gif_code(&gw, prefix, size);
+    gif_code(&gw, 5, size);
+    gif_code(&gw, 0, 7); /* Flush to a byte */
+
+    if(gw.block[0] > 0)
+    {
+        fwrite(gw.block, 1, gw.block[0] + 1, f);
+    }
+
+    fputc(0, f); /* Block terminator */
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-g out.gif] [-p prefix] [-s scale] [-P fg:bg[:c2:c3]] capture\n", name);
+    fprintf(stderr, "       -g writes an animated GIF (frames shorter than %d cs are merged into the next)\n", GIF_MIN_CS);
+    fprintf(stderr, "       -p writes prefix_<frame>.png for every stored frame\n");
+    fprintf(stderr, "       Without -g or -p the capture is only checked and summarized.\n");
+}
+
+/* This function parses a "RRGGBB:RRGGBB[:RRGGBB:RRGGBB]" palette like main */
+int parse_palette(const char* arg, image_options* o)
+{
+    static const int order[PALETTE_SIZE] = { 1, 0, 2, 3 };
+    char* end = NULL;
+
+    for(int i = 0; i < PALETTE_SIZE; i++)
+    {
+        o->palette[order[i]] = strtoul(arg, &end, 16) & 0xFFFFFF;
+
+        if(*end == '\0')
+        {
+            /* Foreground and background are required, the others optional */
+            return (i == 1 || i == PALETTE_SIZE - 1) ? 0 : 1;
+        }
+
+        if(*end != ':')
+        {
+            return 1;
+        }
+
+        arg = end + 1;
+    }
+
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    image_options o = { DEFAULT_SCALE, 0, 0, { 0x000000, 0xFFFFFF, 0xFF6600, 0x662200 } };
+    C8CaptureReader reader;
+    const char* gif_file = NULL;
+    const char* png_prefix = NULL;
+    UBIT8* pixels = NULL;
+    UBIT8* pending = NULL;
+    UBIT64 pending_frame = 0;
+    UBIT64 frames = 0;
+    FILE* gif = NULL;
+    int status = 0;
+    int ret = 0;
+    int opt = 0;
+
+    while((opt = getopt(argc, argv, "g:p:s:P:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'g':
+            gif_file = optarg;
+            break;
+        case 'p':
+            png_prefix = optarg;
+            break;
+        case 's':
+            o.scale = atoi(optarg);
+            o.scale = (o.scale < 1) ? 1 : (o.scale > MAX_SCALE) ? MAX_SCALE : o.scale;
+            break;
+        case 'P':
+            if(parse_palette(optarg, &o) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(c8_capture_reader_open(&reader, argv[optind]) != 0)
+    {
+        fprintf(stderr, "Failed to read capture %s\n", argv[optind]);
+        return 1;
+    }
+
+    o.w = C8_HIRES_W * o.scale;
+    o.h = C8_HIRES_H * o.scale;
+    pixels = malloc((size_t)o.w * o.h);
+    pending = malloc((size_t)o.w * o.h);
+
+    if(pixels == NULL || pending == NULL || (gif_file != NULL && (gif = fopen(gif_file, "wb")) == NULL))
+    {
+        fprintf(stderr, "Failed to create %s\n", (gif_file != NULL) ? gif_file : "the images");
+        c8_capture_reader_close(&reader);
+        free(pixels);
+        free(pending);
+        return 1;
+    }
+
+    if(gif != NULL)
+    {
+        gif_begin(gif, &o);
+    }
+
+    while((status = c8_capture_read(&reader)) == 0)
+    {
+        render(&reader, &o, pixels);
+
+        if(png_prefix != NULL)
+        {
+            char name[4096];
+
+            snprintf(name, sizeof(name), "%s_%08llu.png", png_prefix, (unsigned long long)reader.frame);
+            if(write_png(name, &o, pixels) != 0)
+            {
+                fprintf(stderr, "Failed to write %s\n", name);
+                ret = 1;
+                break;
+            }
+        }
+
+        /* A GIF frame is written once the next one tells how long it lasts */
+        if(gif != NULL)
+        {
+            unsigned delay = (unsigned)(reader.frame * 100 / C8_FRAME_HZ - pending_frame * 100 / C8_FRAME_HZ);
+
+            if(frames > 0 && delay >= GIF_MIN_CS)
+            {
+                gif_frame(gif, &o, pending, delay);
+                pending_frame = reader.frame;
+            }
+            else if(frames == 0)
+            {
+                pending_frame = reader.frame;
+            }
+
+            memcpy(pending, pixels, (size_t)o.w * o.h);
+        }
+
+        frames++;
+    }
+
+    if(gif != NULL)
+    {
+        if(frames > 0)
+        {
+            gif_frame(gif, &o, pending, 100);
+        }
+
+        fputc(0x3B, gif); /* Trailer */
+
+        if(fclose(gif) != 0)
+        {
+            fprintf(stderr, "Failed to write %s\n", gif_file);
+            ret = 1;
+        }
+    }
+
+    if(status == 2)
+    {
+        fprintf(stderr, "Malformed record after frame %llu\n", (unsigned long long)reader.frame);
+        ret = 2;
+    }
+
+    printf("frames:       %llu\n", (unsigned long long)frames);
+    printf("last_frame:   %llu\n", (unsigned long long)reader.frame);
+    printf("duration_s:   %.1f\n", (double)reader.frame / C8_FRAME_HZ);
+
+    c8_capture_reader_close(&reader);
+    free(pixels);
+    free(pending);
+
+    return ret;
+}
@@ -2,14 +2,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "chip8.h"
-
-static Chip8 chip8;
-
-enum {
-    FONTSET_LEN = 16,
-    FONTSET_SPRITE = 5
-};
+#include "chip8_engine.h"
+#include "chip8_debug.h"
+#include "chip8_profile.h"
+
+/* Handlers depending on the quirks take them as a constant parameter and are */
+/* inlined into one copy per quirk set (see c8_quirk_handlers), where the     */
+/* tests of the quirks fold away                                              */
+#if defined(__GNUC__)
+#define C8_SPECIALIZE static inline __attribute__((always_inline))
+#else
+#define C8_SPECIALIZE static inline
+#endif
 
 const UBIT8 c8_fontset[FONTSET_LEN * FONTSET_SPRITE] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -30,554 +34,968 @@ const UBIT8 c8_fontset[FONTSET_LEN * FONTSET_SPRITE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80, // F
 };
 
+const UBIT8 c8_bigfont[FONTSET_LEN * BIGFONT_SPRITE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+};
+
 /* This function increments the PC to the next position */
-void c8_increment_pc()
+void c8_increment_pc(Chip8* chip8)
 {
-    chip8.pc += 2; /* Increment in 16bits (2 bits)*/
+    chip8->pc += 2; /* Increment in 16bits (2 bits)*/
 }
 
 /* This function increments the SP to the next position */
-void c8_increment_sp()
+void c8_increment_sp(Chip8* chip8)
 {
-    chip8.sp += 1; /* Increment in 16bits (2 bits)*/
+    chip8->sp += 1; /* Increment in 16bits (2 bits)*/
 }
 
 /* This function decrements the SP to the previous position */
-void c8_decrement_sp()
+void c8_decrement_sp(Chip8* chip8)
+{
+    chip8->sp -= 1; /* Increment in 16bits (2 bits)*/
+}
+
+/* This function advances the PC past the next instruction, for a taken skip */
+void c8_skip_next(Chip8* chip8)
+{
+    chip8->pc += c8_skip_len(chip8, chip8->pc) - 2;
+}
+
+/* This function clears the chip8 display, every plane */
+void c8_clear_disp(Chip8* chip8)
+{
+    memset(chip8->display, 0, sizeof(chip8->display));
+}
+
+/* This function process the _cls_ instruction, it clears the selected planes */
+void c8_process_instruction_cls(Chip8* chip8)
+{
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        if((chip8->planes & (1 << p)) == 0)
+        {
+            continue;
+        }
+
+        for(int i = 0; i < C8_PLANE_WORDS; i++)
+        {
+            if(chip8->display[p][i] != 0)
+            {
+                chip8->display_dirty = STD_TRUE;
+                break;
+            }
+        }
+
+        memset(chip8->display[p], 0, sizeof(chip8->display[p]));
+    }
+}
+
+/* This function scrolls the selected planes _n_ rows down (00Cn) or up (00Dn). */
+/* Rows are whole words, so this is a memmove per plane.                       */
+void c8_scroll_vertical(Chip8* chip8, UBIT8 n, STD_BOOL down)
 {
-    chip8.sp -= 1; /* Increment in 16bits (2 bits)*/
+    size_t words = c8_disp_w(chip8) / 64;
+    size_t height = c8_disp_h(chip8);
+
+    if(n > height)
+    {
+        n = height;
+    }
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        UBIT64* plane = chip8->display[p];
+
+        if((chip8->planes & (1 << p)) == 0)
+        {
+            continue;
+        }
+
+        if(down == STD_TRUE)
+        {
+            memmove(&plane[n * words], plane, (height - n) * words * sizeof(UBIT64));
+            memset(plane, 0, n * words * sizeof(UBIT64));
+        }
+        else
+        {
+            memmove(plane, &plane[n * words], (height - n) * words * sizeof(UBIT64));
+            memset(&plane[(height - n) * words], 0, n * words * sizeof(UBIT64));
+        }
+    }
+
+    chip8->display_dirty = STD_TRUE;
 }
 
-/* This function clears the chip8 display */
-void c8_clear_disp()
+/* This function scrolls the selected planes 4 pixels right (00FB) or left (00FC). */
+/* Each row is shifted as a whole, carrying between the two high resolution words. */
+void c8_scroll_horizontal(Chip8* chip8, STD_BOOL right)
 {
-    for(int i = 0; i < DISP_H; i++)
-        memset(&(chip8.display[i]), 0, sizeof(chip8.display[i]));
+    int height = c8_disp_h(chip8);
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        UBIT64* plane = chip8->display[p];
+
+        if((chip8->planes & (1 << p)) == 0)
+        {
+            continue;
+        }
+
+        for(int y = 0; y < height; y++)
+        {
+            if(chip8->hires == 0)
+            {
+                plane[y] = (right == STD_TRUE) ? plane[y] >> 4 : plane[y] << 4;
+            }
+            else if(right == STD_TRUE)
+            {
+                plane[2 * y + 1] = (plane[2 * y + 1] >> 4) | (plane[2 * y] << 60);
+                plane[2 * y] >>= 4;
+            }
+            else
+            {
+                plane[2 * y] = (plane[2 * y] << 4) | (plane[2 * y + 1] >> 60);
+                plane[2 * y + 1] <<= 4;
+            }
+        }
+    }
+
+    chip8->display_dirty = STD_TRUE;
 }
 
-/* This function process the _cls_ instruction */
-void c8_process_instruction_cls()
+/* This function switches between the 64x32 (00FE) and 128x64 (00FF) displays. */
+/* The row layout changes with the mode, so the display is cleared.            */
+void c8_set_hires(Chip8* chip8, UBIT8 hires)
 {
-    c8_clear_disp();
+    chip8->hires = hires;
+    c8_clear_disp(chip8);
+    chip8->display_dirty = STD_TRUE;
 }
 
 /* This function process the _ret_ instruction */
-void c8_process_instruction_ret()
+void c8_process_instruction_ret(Chip8* chip8)
 {
-    chip8.pc = chip8.stack[--chip8.sp];
+    chip8->pc = chip8->stack[--chip8->sp];
 }
 
 /* This function process the instruction set 0 */
-void c8_process_instruction_0()
+void c8_process_instruction_0(Chip8* chip8)
 {
-    if(chip8.opcode == 0x00E0)
+    if(chip8->opcode == 0x00E0)
+    {
+        c8_process_instruction_cls(chip8);
+    }
+
+    if(chip8->opcode == 0x00EE)
+    {
+        c8_process_instruction_ret(chip8);
+    }
+
+    if((chip8->opcode & 0xFFF0) == 0x00C0)
+    {
+        c8_scroll_vertical(chip8, chip8->opcode & 0xF, STD_TRUE);
+    }
+
+    if((chip8->opcode & 0xFFF0) == 0x00D0)
     {
-        c8_process_instruction_cls();
+        c8_scroll_vertical(chip8, chip8->opcode & 0xF, STD_FALSE);
     }
 
-    if(chip8.opcode == 0x00EE)
+    switch(chip8->opcode)
     {
-        c8_process_instruction_ret();
+    case 0x00FB:
+        c8_scroll_horizontal(chip8, STD_TRUE);
+        break;
+    case 0x00FC:
+        c8_scroll_horizontal(chip8, STD_FALSE);
+        break;
+    case 0x00FD:
+        /* EXIT: the program stays on this instruction */
+        return;
+    case 0x00FE:
+        c8_set_hires(chip8, 0);
+        break;
+    case 0x00FF:
+        c8_set_hires(chip8, 1);
+        break;
+    default:
+        break;
     }
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
 /* This function process the instruction jump to location */
-void c8_process_instruction_1()
+void c8_process_instruction_1(Chip8* chip8)
 {
-    chip8.pc = (chip8.opcode & 0x0FFF);
+    chip8->pc = (chip8->opcode & 0x0FFF);
 }
 
 /* This function process the instruction call subroutine */
-void c8_process_instruction_2()
+void c8_process_instruction_2(Chip8* chip8)
 {
-    chip8.stack[chip8.sp] = chip8.pc;
-    c8_increment_sp();
-    chip8.pc = (chip8.opcode & 0x0FFF);
+    chip8->stack[chip8->sp] = chip8->pc;
+    c8_increment_sp(chip8);
+    chip8->pc = (chip8->opcode & 0x0FFF);
 }
 
 /* This function process the instruction skip next instruction if Vx == kk */
-void c8_process_instruction_3()
+void c8_process_instruction_3(Chip8* chip8)
 {
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT16 kk = (chip8.opcode & 0x00FF);
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT16 kk = (chip8->opcode & 0x00FF);
 
-    if(chip8.registers[vx] == kk)
+    if(chip8->registers[vx] == kk)
     {
-        c8_increment_pc();
+        c8_skip_next(chip8);
     }
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
 /* This function process the instruction skip next instruction if Vx != kk */
-void c8_process_instruction_4()
+void c8_process_instruction_4(Chip8* chip8)
+{
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT16 kk = (chip8->opcode & 0x00FF);
+
+    if(chip8->registers[vx] != kk)
+    {
+        c8_skip_next(chip8);
+    }
+
+    c8_increment_pc(chip8);
+}
+
+/* This function performs the XO-CHIP 5xy2 (store Vx...Vy at I) and 5xy3 (load  */
+/* Vx...Vy from I). The range runs backwards when x > y and I is left unchanged. */
+void c8_process_regs_range(Chip8* chip8)
 {
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT16 kk = (chip8.opcode & 0x00FF);
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
+    int step = (vx <= vy) ? 1 : -1;
+    int count = (vx <= vy) ? vy - vx + 1 : vx - vy + 1;
 
-    if(chip8.registers[vx] != kk)
+    for(int i = 0; i < count; i++)
     {
-        c8_increment_pc();
+        UBIT16 addr = (chip8->index + i) & (C8_RAM_SIZE - 1);
+
+        if((chip8->opcode & 0x000F) == 0x2)
+            chip8->memory[addr] = chip8->registers[vx + i * step];
+        else
+            chip8->registers[vx + i * step] = chip8->memory[addr];
     }
 
-    c8_increment_pc();
+    if((chip8->opcode & 0x000F) == 0x2)
+    {
+        c8_invalidate(chip8, chip8->index, count);
+        C8_DEBUG_STORE(chip8, chip8->index, count);
+    }
 }
 
 /* This function process the instruction skip next instruction if Vx == Vy */
-void c8_process_instruction_5()
+void c8_process_instruction_5(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
 
-    if(chip8.registers[vx] == chip8.registers[vy])
+    if(c8_is_ext_5(chip8->opcode))
+    {
+        c8_process_regs_range(chip8);
+    }
+    else if(chip8->registers[vx] == chip8->registers[vy])
     {
-        c8_increment_pc();
+        c8_skip_next(chip8);
     }
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
 /* This function process the instruction LD Vx, byte */
-void c8_process_instruction_6()
+void c8_process_instruction_6(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT16 kk = (chip8.opcode & 0x00FF);
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT16 kk = (chip8->opcode & 0x00FF);
 
-    chip8.registers[vx] = kk;
+    chip8->registers[vx] = kk;
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
 /* This function process the instruction ADD Vx, byte */
-void c8_process_instruction_7()
+void c8_process_instruction_7(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT16 kk = (chip8.opcode & 0x00FF);
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT16 kk = (chip8->opcode & 0x00FF);
 
-    chip8.registers[vx] += kk;
+    chip8->registers[vx] += kk;
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
 /* This function stores the value Vy in Vx */
-void c8_process_ld_reg()
+void c8_process_ld_reg(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
 
-    chip8.registers[vx] = chip8.registers[vy];
+    chip8->registers[vx] = chip8->registers[vy];
 }
 
 /* This function performs a bitwise OR and stores the result in register Vx */
-void c8_process_or()
+void c8_process_or(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
 
-    chip8.registers[vx] = chip8.registers[vx] | chip8.registers[vy];
+    chip8->registers[vx] = chip8->registers[vx] | chip8->registers[vy];
 }
 
 /* This function performs a bitwise AND and stores the result in register Vx */
-void c8_process_and()
+void c8_process_and(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
 
-    chip8.registers[vx] = chip8.registers[vx] & chip8.registers[vy];
+    chip8->registers[vx] = chip8->registers[vx] & chip8->registers[vy];
 }
 
 /* This function performs a bitwise XOR and stores the result in register Vx */
-void c8_process_xor()
+void c8_process_xor(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
 
-    chip8.registers[vx] = chip8.registers[vx] ^ chip8.registers[vy];
+    chip8->registers[vx] = chip8->registers[vx] ^ chip8->registers[vy];
 }
 
 /* This function performs ADD Vx, Vy with carry (stores result in Vx) */
-void c8_process_add_regs()
+void c8_process_add_regs(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
     UBIT8 vf = 0xF;
     UBIT16 sum = 0x00;
     
-    sum = chip8.registers[vx] + chip8.registers[vy];
+    sum = chip8->registers[vx] + chip8->registers[vy];
     if(sum > 255)
     {
-        chip8.registers[vf] = 1;
+        chip8->registers[vf] = 1;
     }
     else
     {
-        chip8.registers[vf] = 0;
+        chip8->registers[vf] = 0;
     }
 
-    chip8.registers[vx] = (sum & 0xFF);
+    chip8->registers[vx] = (sum & 0xFF);
 }
 
 /* This function performs SUB Vx, Vy and sets Vf = NOT borrow (stores result in Vx)*/
-void c8_process_sub_regs()
+void c8_process_sub_regs(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
     UBIT8 vf = 0xF;
 
-    if(chip8.registers[vx] > chip8.registers[vy])
+    if(chip8->registers[vx] > chip8->registers[vy])
     {
-        chip8.registers[vf] = 1;
+        chip8->registers[vf] = 1;
     }
     else
     {
-        chip8.registers[vf] = 0;
+        chip8->registers[vf] = 0;
     }
 
-    chip8.registers[vx] -= chip8.registers[vy];
+    chip8->registers[vx] -= chip8->registers[vy];
 }
 
-/* This function performs SHR Vx {, Vy} If the least-significant bit of Vx is 1, */
-/* then VF is set to 1, otherwise 0. Then Vx is divided by 2.                    */
-void c8_process_shr()
+/* This function performs SHR Vx {, Vy} If the least-significant bit of Vs is 1, */
+/* then VF is set to 1, otherwise 0. Then Vx is Vs divided by 2. Vs is Vx, or Vy */
+/* with C8_QUIRK_SHIFT_VY.                                                        */
+void c8_process_shr(Chip8* chip8, UBIT8 vs)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
     UBIT8 vf = 0xF;
 
-    chip8.registers[vf] = (chip8.registers[vx] & 0x01) != 0 ? 1: 0;
-    chip8.registers[vx] >>= 1;
+    chip8->registers[vf] = (chip8->registers[vs] & 0x01) != 0 ? 1: 0;
+    chip8->registers[vx] = chip8->registers[vs] >> 1;
 }
 
 /* This function performs SUBN Vx, Vy If Vy > Vx, then VF is set to 1, otherwise 0. */
 /* Then Vx is subtracted from Vy, and the results stored in Vx                      */
-void c8_process_subn_regs()
+void c8_process_subn_regs(Chip8* chip8)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8 vy = (chip8->opcode & 0x00F0) >> 4;
     UBIT8 vf = 0xF;
 
-    if(chip8.registers[vx] > chip8.registers[vy])
+    if(chip8->registers[vx] > chip8->registers[vy])
     {
-        chip8.registers[vf] = 1;
+        chip8->registers[vf] = 1;
     }
     else
     {
-        chip8.registers[vf] = 0;
+        chip8->registers[vf] = 0;
     }
 
-    chip8.registers[vx] = chip8.registers[vy] - chip8.registers[vx];
+    chip8->registers[vx] = chip8->registers[vy] - chip8->registers[vx];
 }
 
-/* This function performs SHL Vx {, Vy} If the most-significant bit of Vx is 1, */
-/* then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.             */
-void c8_process_shl()
+/* This function performs SHL Vx {, Vy} If the most-significant bit of Vs is 1, */
+/* then VF is set to 1, otherwise to 0. Then Vx is Vs multiplied by 2. Vs is Vx, */
+/* or Vy with C8_QUIRK_SHIFT_VY.                                                  */
+void c8_process_shl(Chip8* chip8, UBIT8 vs)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
+    UBIT8 vx = (chip8->opcode & 0x0F00) >> 8;
     UBIT8 vf = 0xF;
 
-    chip8.registers[vf] = (chip8.registers[vx] & 0x80) != 0 ? 1 : 0;
-    chip8.registers[vx] <<= 1;
+    chip8->registers[vf] = (chip8->registers[vs] & 0x80) != 0 ? 1 : 0;
+    chip8->registers[vx] = chip8->registers[vs] << 1;
 }
 
 /* This function process the instruction set 8 */
-void c8_process_instruction_8()
+C8_SPECIALIZE void c8_process_instruction_8(Chip8* chip8, const UBIT8 quirks)
 {
-    UBIT8 last = (chip8.opcode & 0x000F);
+    UBIT8 last = (chip8->opcode & 0x000F);
+    UBIT8 vs = (quirks & C8_QUIRK_SHIFT_VY) ? (chip8->opcode & 0x00F0) >> 4 : (chip8->opcode & 0x0F00) >> 8;
 
     switch (last)
     {
     case 0x0:
-        c8_process_ld_reg();
+        c8_process_ld_reg(chip8);
         break;
     case 0x1:
-        c8_process_or();
+        c8_process_or(chip8);
         break;
     case 0x2:
-        c8_process_and();
+        c8_process_and(chip8);
         break;
     case 0x3:
-        c8_process_xor();
+        c8_process_xor(chip8);
         break;
     case 0x4:
-        c8_process_add_regs();
+        c8_process_add_regs(chip8);
         break;
     case 0x5:
-        c8_process_sub_regs();
+        c8_process_sub_regs(chip8);
         break;
     case 0x6:
-        c8_process_shr();
+        c8_process_shr(chip8, vs);
         break;
     case 0x7:
-        c8_process_subn_regs();
+        c8_process_subn_regs(chip8);
         break;
     case 0xE:
-        c8_process_shl();
+        c8_process_shl(chip8, vs);
         break;
     default:
         break;
     }
 
-    c8_increment_pc();
+    /* The logic operations clear VF on the COSMAC VIP */
+    if((quirks & C8_QUIRK_VF_RESET) && last >= 0x1 && last <= 0x3)
+    {
+        chip8->registers[0xF] = 0;
+    }
+
+    c8_increment_pc(chip8);
 }
 
 /* This function performs SNE Vx, Vy */
-void c8_process_instruction_9()
+void c8_process_instruction_9(Chip8* chip8)
 {
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8  vy = (chip8.opcode & 0x00F0) >> 4;
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT8  vy = (chip8->opcode & 0x00F0) >> 4;
 
-    if(chip8.registers[vx] != chip8.registers[vy])
+    if(chip8->registers[vx] != chip8->registers[vy])
     {
-        c8_increment_pc();
+        c8_skip_next(chip8);
     }
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
 /* This function performs LD I, addr */
-void c8_process_instruction_A()
+void c8_process_instruction_A(Chip8* chip8)
 {
-    chip8.index = (chip8.opcode & 0x0FFF);
-    c8_increment_pc();
+    chip8->index = (chip8->opcode & 0x0FFF);
+    c8_increment_pc(chip8);
 }
 
 /* This function performs JP V0, addr */
-void c8_process_instruction_B()
+void c8_process_instruction_B(Chip8* chip8)
 {
     /* Jump to nnn + V0 */
-    chip8.pc = (chip8.opcode & 0x0FFF) + chip8.registers[0x0];
+    chip8->pc = (chip8->opcode & 0x0FFF) + chip8->registers[0x0];
+}
+
+/* This function returns the next PRNG byte (xorshift64*, high bits) */
+static UBIT8 c8_random(Chip8* chip8)
+{
+    chip8->rng ^= chip8->rng >> 12;
+    chip8->rng ^= chip8->rng << 25;
+    chip8->rng ^= chip8->rng >> 27;
+
+    return (UBIT8)((chip8->rng * 0x2545F4914F6CDD1DULL) >> 56);
+}
+
+void c8_seed(Chip8* chip8, UBIT64 seed)
+{
+    /* splitmix64 spreads small seeds over the state, which must not be zero */
+    UBIT64 z = seed + 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+
+    chip8->rng = (z != 0) ? z : 0x9E3779B97F4A7C15ULL;
 }
 
 /* This function performs RND Vx, byte */
-void c8_process_instruction_C()
+void c8_process_instruction_C(Chip8* chip8)
+{
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
+    UBIT16 kk = (chip8->opcode & 0x00FF);
+    chip8->registers[vx] = c8_random(chip8) & kk; /* random number [0, 255] AND kk */
+    c8_increment_pc(chip8);
+}
+
+/* DRW places every sprite row at the MSB of a row and rotates it to Vx, so */
+/* horizontal wrapping is free, collision is a single AND and drawing a      */
+/* single XOR per row word. Low resolution rows are one word, high          */
+/* resolution rows two. Dxy0 draws 16x16 sprites, two bytes per row.        */
+
+/* This function reads sprite row _r_ (8 or 16 pixels wide) at the MSB of a word */
+static inline UBIT64 c8_sprite_row(const Chip8* chip8, UBIT16 addr, UBIT8 r, STD_BOOL wide)
 {
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT16 kk = (chip8.opcode & 0x00FF);
-    chip8.registers[vx] = (rand() % 256) & kk; /* random number [0, 255] AND kk */
-    c8_increment_pc();
+    if(wide == STD_FALSE)
+    {
+        return (UBIT64)chip8->memory[(addr + r) & (C8_RAM_SIZE - 1)] << 56;
+    }
+
+    return ((UBIT64)chip8->memory[(addr + 2 * r) & (C8_RAM_SIZE - 1)] << 56)
+         | ((UBIT64)chip8->memory[(addr + 2 * r + 1) & (C8_RAM_SIZE - 1)] << 48);
 }
 
-/* This function performs DRW Vx, Vy, nibble */
-void c8_process_instruction_D()
+/* This function draws a sprite on a low resolution plane, returns the collisions. */
+/* The sprite starts at (Vx, Vy) modulo the display, the pixels past the edges    */
+/* wrap around or, with C8_QUIRK_CLIP, are not drawn.                             */
+C8_SPECIALIZE UBIT64 c8_draw_lores(Chip8* chip8, UBIT64* plane, UBIT16 addr, UBIT8 rows, STD_BOOL wide, UBIT64* drawn, const UBIT8 quirks)
 {
-    UBIT8 vx = (chip8.opcode & 0x0F00) >> 8;
-    UBIT8 vy = (chip8.opcode & 0x00F0) >> 4;
-    UBIT8 vz = 0xF;
-    UBIT8 nibble = (chip8.opcode & 0x000F);
+    UBIT8 shift = chip8->registers[(chip8->opcode & 0x0F00) >> 8] % DISP_W;
+    UBIT8 top = chip8->registers[(chip8->opcode & 0x00F0) >> 4] % DISP_H;
+    UBIT64 collision = 0;
 
-    chip8.registers[vz] = 0;
+    if(quirks & C8_QUIRK_CLIP)
+    {
+        rows = (top + rows > DISP_H) ? DISP_H - top : rows;
+    }
 
-    UBIT8 y = 0;
-    while(y < nibble)
+    for(UBIT8 y = 0; y < rows; y++)
     {
-        UBIT8 pixel = chip8.memory[chip8.index + y];
-        UBIT8 x = 0;
-        while(x < 8)
+        UBIT64 sprite = c8_sprite_row(chip8, addr, y, wide);
+        UBIT64 line = (sprite >> shift);
+        UBIT64* row = &plane[(top + y) % DISP_H];
+
+        if(!(quirks & C8_QUIRK_CLIP))
         {
-            UBIT8 msb = 0x80;
-            if((pixel & (msb >> x)) != 0)
-            {
-                UBIT8 tX = (chip8.registers[vx] + x) % DISP_W;
-                UBIT8 tY = (chip8.registers[vy] + y) % DISP_H;
+            line |= (sprite << ((DISP_W - shift) % DISP_W));
+        }
+
+        collision |= *row & line;
+        *drawn |= line;
+        *row ^= line;
+    }
+
+    return collision;
+}
+
+/* This function draws a sprite on a high resolution plane, returns the collisions */
+C8_SPECIALIZE UBIT64 c8_draw_hires(Chip8* chip8, UBIT64* plane, UBIT16 addr, UBIT8 rows, STD_BOOL wide, UBIT64* drawn, const UBIT8 quirks)
+{
+    UBIT8 shift = chip8->registers[(chip8->opcode & 0x0F00) >> 8] % C8_HIRES_W;
+    UBIT8 top = chip8->registers[(chip8->opcode & 0x00F0) >> 4] % C8_HIRES_H;
+    UBIT8 s = shift % 64;
+    UBIT64 collision = 0;
+
+    if(quirks & C8_QUIRK_CLIP)
+    {
+        rows = (top + rows > C8_HIRES_H) ? C8_HIRES_H - top : rows;
+    }
+
+    for(UBIT8 y = 0; y < rows; y++)
+    {
+        UBIT64 sprite = c8_sprite_row(chip8, addr, y, wide);
+        UBIT64 left = (sprite >> s);
+        UBIT64 right = (s == 0) ? 0 : sprite << (64 - s);
+        UBIT64* row = &plane[((top + y) % C8_HIRES_H) * 2];
+
+        /* Past the middle the halves swap: a 128-bit rotation */
+        if(shift >= 64)
+        {
+            UBIT64 t = left;
 
-                chip8.display[tY][tX] ^= 1;
+            left = right;
+            right = t;
 
-                /* In case that the pixel has been deleted */
-                if(chip8.display[tY][tX] == 0)
-                {
-                    chip8.registers[vz] = 1;
-                }
+            /* What wrapped around to the left half */
+            if(quirks & C8_QUIRK_CLIP)
+            {
+                left = 0;
             }
-            x++;
         }
-        y++;
+
+        collision |= (row[0] & left) | (row[1] & right);
+        *drawn |= left | right;
+        row[0] ^= left;
+        row[1] ^= right;
     }
 
-    c8_increment_pc();
+    return collision;
+}
+
+/* This function performs DRW Vx, Vy, nibble on every selected plane, the */
+/* planes take consecutive sprites from I                                  */
+C8_SPECIALIZE void c8_process_instruction_D(Chip8* chip8, const UBIT8 quirks)
+{
+    UBIT8 vz = 0xF;
+    UBIT8 nibble = (chip8->opcode & 0x000F);
+    STD_BOOL wide = (nibble == 0) ? STD_TRUE : STD_FALSE;
+    UBIT8 rows = (nibble == 0) ? 16 : nibble;
+    UBIT16 addr = chip8->index;
+    UBIT64 collision = 0;
+    UBIT64 drawn = 0;
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        if((chip8->planes & (1 << p)) == 0)
+        {
+            continue;
+        }
+
+        if(chip8->hires == 0)
+            collision |= c8_draw_lores(chip8, chip8->display[p], addr, rows, wide, &drawn, quirks);
+        else
+            collision |= c8_draw_hires(chip8, chip8->display[p], addr, rows, wide, &drawn, quirks);
+
+        addr += (wide == STD_TRUE) ? 32 : rows;
+    }
+
+    /* VF is set when any lit pixel has been deleted */
+    chip8->registers[vz] = (collision != 0) ? 1 : 0;
+
+    if(drawn != 0)
+    {
+        chip8->display_dirty = STD_TRUE;
+    }
+
+    c8_increment_pc(chip8);
 }
 
 /* This function performs the instruction SKP Vx */
-void c8_process_instruction_skp()
+void c8_process_instruction_skp(Chip8* chip8)
 {
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
 
-    if(chip8.keyboard[chip8.registers[vx]] == 1)
+    chip8->keys_read |= 1u << (chip8->registers[vx] & 0xF);
+
+    if(chip8->keyboard[chip8->registers[vx]] == 1)
     {
-        c8_increment_pc();
+        c8_skip_next(chip8);
     }
 }
 
 /* This function performs the instruction SKNP Vx */
-void c8_process_instruction_sknp()
+void c8_process_instruction_sknp(Chip8* chip8)
 {
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
+
+    chip8->keys_read |= 1u << (chip8->registers[vx] & 0xF);
 
-    if(chip8.keyboard[chip8.registers[vx]] != 1)
+    if(chip8->keyboard[chip8->registers[vx]] != 1)
     {
-        c8_increment_pc();
+        c8_skip_next(chip8);
     }
 }
 
 /* This function process the instruction set E */
-void c8_process_instruction_E()
+void c8_process_instruction_E(Chip8* chip8)
 {
-    UBIT16 last = (chip8.opcode & 0x00FF);
+    UBIT16 last = (chip8->opcode & 0x00FF);
 
     if(last == 0x9E)
     {
-        c8_process_instruction_skp();
+        c8_process_instruction_skp(chip8);
     }
 
     if(last == 0xA1)
     {
-        c8_process_instruction_sknp();
+        c8_process_instruction_sknp(chip8);
     }
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
-/* This function waits until a key is pressed and sets Vx to the value of the key pressed */
-void c8_process_keypress(const UBIT8 vx)
+/* This function waits until a key is pressed and sets Vx to the value of the key pressed. */
+/* Instead of spinning, the machine is parked until c8_key_event delivers a key press.     */
+void c8_process_keypress(Chip8* chip8, const UBIT8 vx)
 {
-    STD_BOOL loop = STD_TRUE;
-
-    while(STD_TRUE == loop)
+    /* A key already held completes the instruction right away */
+    for(int i = (KEYBOARD_SIZE * KEYBOARD_SIZE) - 1; i >= 0; i--)
     {
-        // loop keys checking a pressed key
-        for(UBIT8 i = 0; i < (KEYBOARD_SIZE * KEYBOARD_SIZE); i++)
+        if(chip8->keyboard[i] == 1)
         {
-            if(chip8.keyboard[i] == 1)
-            {
-                chip8.registers[vx] = i;
-                loop = STD_FALSE;
-            }
+            chip8->registers[vx] = i;
+            chip8->keys_read |= 1u << i;
+            return;
         }
     }
+
+    chip8->waiting_key = STD_TRUE;
+    chip8->key_register = vx;
 }
 
 /* This function process the instruction set F */
-void c8_process_instruction_F()
+C8_SPECIALIZE void c8_process_instruction_F(Chip8* chip8, const UBIT8 quirks)
 {
-    UBIT16 last = (chip8.opcode & 0x00FF);
-    UBIT8  vx = (chip8.opcode & 0x0F00) >> 8;
+    UBIT16 last = (chip8->opcode & 0x00FF);
+    UBIT8  vx = (chip8->opcode & 0x0F00) >> 8;
     UBIT8  aux = 0x0;
 
     switch (last)
     {
     case 0x07:
-        chip8.registers[vx] = chip8.delay_timer;
+        chip8->registers[vx] = chip8->delay_timer;
         break;
     case 0x0A:
-        c8_process_keypress(vx);
+        c8_process_keypress(chip8, vx);
         break;
     case 0x15:
-        chip8.delay_timer = chip8.registers[vx];
+        chip8->delay_timer = chip8->registers[vx];
         break;
     case 0x18:
-        chip8.sound_timer = chip8.registers[vx];
+        chip8->sound_timer = chip8->registers[vx];
         break;
     case 0x1E:
-        chip8.registers[0xF] = (chip8.index + chip8.registers[vx] > 0xFFF) ? 1 : 0;
-        chip8.index += chip8.registers[vx];
+        chip8->registers[0xF] = (chip8->index + chip8->registers[vx] > 0xFFF) ? 1 : 0;
+        chip8->index += chip8->registers[vx];
+        break;
+    case 0x00:
+        if(vx != 0)
+            return;
+        /* F000 nnnn: I takes the 16-bit word that follows */
+        chip8->index = (chip8->memory[chip8->pc + 2] << 8) | chip8->memory[chip8->pc + 3];
+        c8_increment_pc(chip8);
+        break;
+    case 0x01:
+        chip8->planes = vx & 0x3;
+        break;
+    case 0x02:
+        if(vx != 0)
+            return;
+        for(aux = 0; aux < 16; aux++)
+            chip8->pattern[aux] = chip8->memory[(chip8->index + aux) & (C8_RAM_SIZE - 1)];
+        chip8->xo_audio = STD_TRUE;
         break;
     case 0x29:
-        chip8.index = chip8.registers[vx] * FONTSET_SPRITE;
+        chip8->index = chip8->registers[vx] * FONTSET_SPRITE;
+        break;
+    case 0x30:
+        chip8->index = BIGFONT_ADDR + (chip8->registers[vx] & 0xF) * BIGFONT_SPRITE;
+        break;
+    case 0x3A:
+        chip8->pitch = chip8->registers[vx];
+        break;
+    case 0x75:
+        memcpy(chip8->flags, chip8->registers, vx + 1);
+        break;
+    case 0x85:
+        memcpy(chip8->registers, chip8->flags, vx + 1);
         break;
     case 0x33:
-        chip8.memory[chip8.index] = (chip8.registers[vx] / 100) % 10;
-        chip8.memory[chip8.index + 1] = (chip8.registers[vx] / 10) % 10;
-        chip8.memory[chip8.index + 2] = (chip8.registers[vx]) % 10;
+        chip8->memory[chip8->index] = (chip8->registers[vx] / 100) % 10;
+        chip8->memory[chip8->index + 1] = (chip8->registers[vx] / 10) % 10;
+        chip8->memory[chip8->index + 2] = (chip8->registers[vx]) % 10;
+        c8_invalidate(chip8, chip8->index, 3);
+        C8_DEBUG_STORE(chip8, chip8->index, 3);
         break;
     case 0x55:
         aux = 0x0;
         while(aux <= vx)
         {
-            chip8.memory[chip8.index + aux] = chip8.registers[aux];
+            chip8->memory[chip8->index + aux] = chip8->registers[aux];
             aux += 0x1;
         }
+        c8_invalidate(chip8, chip8->index, vx + 1);
+        C8_DEBUG_STORE(chip8, chip8->index, vx + 1);
+        if(quirks & C8_QUIRK_LOAD_I)
+            chip8->index += vx + 1;
         break;
     case 0x65:
         aux = 0x0;
         while(aux <= vx)
         {
-            chip8.registers[aux] = chip8.memory[chip8.index + aux];
+            chip8->registers[aux] = chip8->memory[chip8->index + aux];
             aux += 0x1;
         }
+        if(quirks & C8_QUIRK_LOAD_I)
+            chip8->index += vx + 1;
         break;
     default:
         return;
     }
 
-    c8_increment_pc();
+    c8_increment_pc(chip8);
 }
 
-/* This function processes an instruction contained in chip8.opcode */
-void c8_process_instruction()
+/* This function processes an instruction contained in chip8->opcode */
+C8_SPECIALIZE void c8_execute(Chip8* chip8, const UBIT8 quirks)
 {
-    UBIT8 first = chip8.opcode >> 12; /* Get first 4 bytes (instruction type)*/
+    UBIT8 first = chip8->opcode >> 12; /* Get first 4 bytes (instruction type)*/
+
+    C8_PROFILE_INSN(chip8);
 
     switch (first)
     {
     case 0x0:
-        c8_process_instruction_0();
+        c8_process_instruction_0(chip8);
         break;
     case 0x1:
-        c8_process_instruction_1();
+        c8_process_instruction_1(chip8);
         break;
     case 0x2:
-        c8_process_instruction_2();
+        c8_process_instruction_2(chip8);
         break;
     case 0x3:
-        c8_process_instruction_3();
+        c8_process_instruction_3(chip8);
         break;
     case 0x4:
-        c8_process_instruction_4();
+        c8_process_instruction_4(chip8);
         break;
     case 0x5:
-        c8_process_instruction_5();
+        c8_process_instruction_5(chip8);
         break;
     case 0x6:
-        c8_process_instruction_6();
+        c8_process_instruction_6(chip8);
         break;
     case 0x7:
-        c8_process_instruction_7();
+        c8_process_instruction_7(chip8);
         break;
     case 0x8:
-        c8_process_instruction_8();
+        c8_process_instruction_8(chip8, quirks);
         break;
     case 0x9:
-        c8_process_instruction_9();
+        c8_process_instruction_9(chip8);
         break;
     case 0xA:
-        c8_process_instruction_A();
+        c8_process_instruction_A(chip8);
         break;
     case 0xB:
-        c8_process_instruction_B();
+        c8_process_instruction_B(chip8);
         break;
     case 0xC:
-        c8_process_instruction_C();
+        c8_process_instruction_C(chip8);
         break;
     case 0xD:
-        c8_process_instruction_D();
+        c8_process_instruction_D(chip8, quirks);
         break;
     case 0xE:
-        c8_process_instruction_E();
+        c8_process_instruction_E(chip8);
         break;
     case 0xF:
-        c8_process_instruction_F();
+        c8_process_instruction_F(chip8, quirks);
         break;
     default:
         return;
     }
 }
 
+/* This function emulates a cycle of chip8 */
+C8_SPECIALIZE void c8_cycle(Chip8* chip8, const UBIT8 quirks)
+{
+    if(chip8->waiting_key == STD_TRUE)
+    {
+        return;
+    }
+
+    chip8->opcode = (chip8->memory[chip8->pc] << 8) | chip8->memory[chip8->pc + 1];
+    c8_execute(chip8, quirks);
+}
+
+/* This function emulates a cycle of the sandbox: the instruction at pc runs */
+/* only when it stays in bounds, otherwise its fault is returned              */
+C8_SPECIALIZE C8_FAULT c8_sandbox_cycle(Chip8* chip8, const UBIT8 quirks)
+{
+    C8_FAULT kind = c8_sandbox_fetch(chip8);
+
+    if(kind == C8_FAULT_NONE)
+    {
+        c8_execute(chip8, quirks);
+    }
+
+    return kind;
+}
+
+/* ---- Quirk sets ---- */
+
+#define C8_QUIRK_SET_LIST(X) \
+    X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15)
+
+/* One copy of the quirk dependent handlers per set */
+#define C8_QUIRK_SET_HANDLERS(q)                                                 \
+    static void c8_execute_##q(Chip8* chip8) { c8_execute(chip8, q); }           \
+    static void c8_cycle_##q(Chip8* chip8) { c8_cycle(chip8, q); }               \
+    static void c8_draw_##q(Chip8* chip8) { c8_process_instruction_D(chip8, q); } \
+    static void c8_misc_##q(Chip8* chip8) { c8_process_instruction_F(chip8, q); } \
+    static C8_FAULT c8_sandbox_##q(Chip8* chip8) { return c8_sandbox_cycle(chip8, q); }
+
+#define C8_QUIRK_SET_ENTRY(q) { c8_execute_##q, c8_cycle_##q, c8_draw_##q, c8_misc_##q, c8_sandbox_##q },
+
+C8_QUIRK_SET_LIST(C8_QUIRK_SET_HANDLERS)
+
+const C8QuirkHandlers c8_quirk_handlers[] = {
+    C8_QUIRK_SET_LIST(C8_QUIRK_SET_ENTRY)
+};
+
+_Static_assert(sizeof(c8_quirk_handlers) / sizeof(c8_quirk_handlers[0]) == C8_QUIRK_SETS,
+               "one handler set per combination of quirks");
+
+void c8_process_instruction(Chip8* chip8)
+{
+    c8_quirk_handlers[chip8->quirks].execute(chip8);
+}
+
+void c8_set_quirks(Chip8* chip8, UBIT8 quirks)
+{
+    chip8->quirks = quirks & (C8_QUIRK_SETS - 1);
+    chip8->loop = c8_quirk_handlers[chip8->quirks].loop;
+
+    /* Decoded and compiled code has the previous quirks built in */
+    c8_invalidate_all(chip8);
+}
+
 /* This function loads the chip8 rom memory */
-int c8_load_rom(char *filename)
+int c8_load_rom(Chip8* chip8, char *filename)
 {
     FILE* f = NULL;
-    size_t bytes_read = 0;
-    size_t total_bytes_read = 0;
-    UBIT8 buffer[128];
-    UBIT8* p_mem = NULL;
+    UBIT8* program = NULL;
+    size_t size = 0;
+    int ret = 1;
 
     if(0 == strlen(filename))
     {
@@ -589,54 +1007,415 @@ int c8_load_rom(char *filename)
         return 1;
     }
 
-    while((bytes_read = fread(buffer, 1, sizeof(buffer), f)))
+    /* One byte more than fits tells an oversize ROM, which must leave RAM untouched */
+    program = malloc(C8_PROGRAM_SIZE + 1);
+    if(program != NULL)
     {
-        if((total_bytes_read + bytes_read) >= 0xFFF - 0x200)
+        size = fread(program, 1, C8_PROGRAM_SIZE + 1, f);
+        if(ferror(f) == 0)
         {
-            return 1;
+            ret = c8_load_program(chip8, program, size);
         }
+    }
 
-        p_mem = &(chip8.memory[0x200 + total_bytes_read]);
-        memcpy((void*)p_mem, buffer, bytes_read);
+    free(program);
+    fclose(f);
+
+    return ret;
+}
 
-        total_bytes_read += bytes_read;
+int c8_load_program(Chip8* chip8, const UBIT8* program, size_t size)
+{
+    if(size > C8_PROGRAM_SIZE)
+    {
+        return 1;
     }
 
-    fclose(f);
+    memcpy(&chip8->memory[C8_PROGRAM_START], program, size);
+    c8_invalidate_all(chip8);
 
     return 0;
 }
 
-/* This function emulates a cycle of chip8 */
-void c8_loop()
+/* This function emulates a cycle of chip8 with its quirks */
+void c8_loop(Chip8* chip8)
+{
+    c8_quirk_handlers[chip8->quirks].loop(chip8);
+}
+
+int c8_engine_by_name(const char* name, C8_ENGINE* engine)
+{
+    if(strcmp(name, "switch") == 0)
+    {
+        *engine = C8_ENGINE_SWITCH;
+    }
+    else if(strcmp(name, "predecoded") == 0)
+    {
+        *engine = C8_ENGINE_PREDECODED;
+    }
+    else if(strcmp(name, "jit") == 0)
+    {
+        *engine = C8_ENGINE_JIT;
+    }
+    else if(strcmp(name, "sandbox") == 0)
+    {
+        *engine = C8_ENGINE_SANDBOX;
+    }
+    else
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+int c8_set_engine(Chip8* chip8, const char* name)
+{
+    return c8_engine_by_name(name, &chip8->engine);
+}
+
+/* This function reads the opcode at _addr_ */
+static inline UBIT16 c8_word(const Chip8* chip8, UBIT16 addr)
+{
+    return (chip8->memory[addr] << 8) | chip8->memory[addr + 1];
+}
+
+/* This function tells whether the skip _skip_ (3xkk or 4xkk) falls through */
+/* to the next instruction when Vx holds _value_                             */
+static STD_BOOL c8_skip_falls(UBIT16 skip, UBIT8 value)
 {
-    chip8.opcode = (chip8.memory[chip8.pc] << 8) | chip8.memory[chip8.pc + 1];
-    c8_process_instruction();
+    if((skip & 0xF000) == 0x3000)
+    {
+        return (value != (skip & 0xFF)) ? STD_TRUE : STD_FALSE;
+    }
+
+    return (value == (skip & 0xFF)) ? STD_TRUE : STD_FALSE;
+}
+
+/* This function returns the skip of the FX07 / 3xkk or 4xkk / 1nnn loop */
+/* starting at _head_, 0 when _head_ does not start such a loop           */
+static UBIT16 c8_timer_loop(const Chip8* chip8, UBIT16 head)
+{
+    UBIT16 load = 0;
+    UBIT16 skip = 0;
+
+    if(head > C8_MEM_SIZE - 6)
+    {
+        return 0;
+    }
+
+    load = c8_word(chip8, head);
+    skip = c8_word(chip8, head + 2);
+
+    if((load & 0xF0FF) != 0xF007 || c8_word(chip8, head + 4) != (0x1000 | head))
+    {
+        return 0;
+    }
+
+    /* The skip must test the register the timer was loaded into */
+    if(((skip & 0xF000) != 0x3000 && (skip & 0xF000) != 0x4000) || (skip & 0x0F00) != (load & 0x0F00))
+    {
+        return 0;
+    }
+
+    return skip;
 }
 
-Chip8* c8_init()
+unsigned long c8_idle_skip(Chip8* chip8, unsigned long cycles)
 {
-    chip8.pc = 0x200;
-    chip8.sp = 0;
-    chip8.opcode = 0;
-    chip8.index = 0;
-    chip8.delay_timer = 0;
-    chip8.sound_timer = 0;
+    UBIT16 pc = chip8->pc;
+
+    if(cycles == 0 || pc > C8_MEM_SIZE - 2)
+    {
+        return 0;
+    }
+
+    /* A jump to itself: nothing but a reset gets the machine out */
+    if(c8_word(chip8, pc) == (0x1000 | pc))
+    {
+        chip8->opcode = 0x1000 | pc;
+        return cycles;
+    }
+
+    /* A delay timer loop, pc being its instruction _phase_ (0 FX07, 1 skip, 2 jump) */
+    for(UBIT16 phase = 0; phase < 3 && pc >= 2 * phase; phase++)
+    {
+        UBIT16 head = pc - 2 * phase;
+        UBIT16 skip = c8_timer_loop(chip8, head);
+        UBIT8 x = (skip & 0x0F00) >> 8;
+
+        if(skip == 0 || c8_skip_falls(skip, (UBIT8)chip8->delay_timer) == STD_FALSE)
+        {
+            continue;
+        }
+
+        /* Entered on the skip, Vx still holds the value loaded before */
+        if(phase == 1 && c8_skip_falls(skip, chip8->registers[x]) == STD_FALSE)
+        {
+            continue;
+        }
+
+        /* The loop runs _cycles_ instructions from _phase_, FX07 among them */
+        /* unless it stops before reaching it                                */
+        if(cycles >= (3 - phase) % 3 + 1u)
+        {
+            chip8->registers[x] = (UBIT8)chip8->delay_timer;
+        }
+
+        chip8->pc = head + 2 * ((phase + cycles) % 3);
+        chip8->opcode = c8_word(chip8, head + 2 * ((phase + cycles - 1) % 3));
 
-    memset(&chip8.memory, 0, sizeof(chip8.memory));
-    memset(&chip8.registers, 0, sizeof(chip8.registers));
-    memset(&chip8.stack, 0, sizeof(chip8.stack));
-    memset(&chip8.keyboard, 0, sizeof(chip8.keyboard));
+        return cycles;
+    }
 
-    c8_clear_disp();
+    return 0;
+}
+
+/* This function runs up to _cycles_ cycles and returns the executed ones */
+unsigned long c8_run(Chip8* chip8, unsigned long cycles)
+{
+    unsigned long executed = 0;
+    STD_BOOL idle = chip8->fast_idle;
+
+    /* An attached debugger steps the switch interpreter itself */
+    if(chip8->debug != NULL)
+    {
+        return c8_debug_run(chip8, cycles);
+    }
+
+#ifdef C8_PROFILE
+    /* Only the switch interpreter is instrumented, and every cycle is counted */
+    if(chip8->profile != NULL)
+    {
+        idle = STD_FALSE;
+        goto interpret;
+    }
+#endif
+
+    if(chip8->engine == C8_ENGINE_PREDECODED)
+    {
+        return c8_predecoded_run(chip8, cycles);
+    }
+
+    if(chip8->engine == C8_ENGINE_JIT)
+    {
+        return c8_jit_run(chip8, cycles);
+    }
+
+    if(chip8->engine == C8_ENGINE_SANDBOX)
+    {
+        return c8_sandbox_run(chip8, cycles);
+    }
+
+#ifdef C8_PROFILE
+interpret:
+#endif
+
+    while(executed < cycles && chip8->waiting_key == STD_FALSE)
+    {
+        chip8->loop(chip8);
+        executed++;
+
+        /* Idle loops are only entered through a jump */
+        if(idle == STD_TRUE && (chip8->opcode & 0xF000) == 0x1000)
+        {
+            executed += c8_idle_skip(chip8, cycles - executed);
+        }
+    }
+
+    return executed;
+}
+
+void c8_key_event(Chip8* chip8, UBIT8 key, STD_BOOL pressed)
+{
+    key &= (KEYBOARD_SIZE * KEYBOARD_SIZE) - 1;
+    chip8->keyboard[key] = (pressed == STD_TRUE) ? 1 : 0;
+
+    if(pressed == STD_TRUE && chip8->waiting_key == STD_TRUE)
+    {
+        /* Resume the FX0A that parked the machine */
+        chip8->registers[chip8->key_register] = key;
+        chip8->waiting_key = STD_FALSE;
+        chip8->keys_read |= 1u << key;
+    }
+}
+
+/* This function updates the timers, it must be called with a 60Hz frequency */
+STD_BOOL c8_tick_timers(Chip8* chip8)
+{
+    C8_PROFILE_FRAME(chip8);
+
+    chip8->frame++;
+    chip8->clock = 0;
+
+    if(chip8->delay_timer > 0)
+    {
+        chip8->delay_timer--;
+    }
+
+    if(chip8->sound_timer > 0)
+    {
+        chip8->sound_timer--;
+        if(chip8->sound_timer == 0)
+        {
+            return STD_TRUE;
+        }
+    }
+
+    return STD_FALSE;
+}
+
+unsigned long c8_run_clocked(Chip8* chip8, unsigned long cycles, unsigned long ipf)
+{
+    unsigned long executed = 0;
+    unsigned long ran = 0;
+
+    if(ipf == 0)
+    {
+        return c8_run(chip8, cycles);
+    }
+
+    while(cycles > 0)
+    {
+        unsigned long slice = (chip8->clock < ipf) ? ipf - chip8->clock : 0;
+
+        if(slice > cycles)
+        {
+            slice = cycles;
+        }
+
+        /* A parked machine executes nothing but its slice still elapses */
+        ran = c8_run(chip8, slice);
+        executed += ran;
+
+        /* A debugger stop freezes the clock on the instruction it stopped at */
+        if(c8_debug_stopped(chip8) == STD_TRUE)
+        {
+            slice = ran;
+            cycles = slice;
+        }
+
+        chip8->clock += slice;
+        cycles -= slice;
+
+        if(chip8->clock >= ipf)
+        {
+            c8_tick_timers(chip8);
+        }
+    }
+
+    return executed;
+}
+
+/* This function emulates the rest of a 60Hz frame followed by a timer tick */
+unsigned long c8_run_frame(Chip8* chip8, unsigned long ipf)
+{
+    unsigned long left = (chip8->clock < ipf) ? ipf - chip8->clock : 0;
+    unsigned long executed = c8_run(chip8, left);
+
+    /* Stopped in the debugger: the rest of the frame runs when it resumes */
+    if(c8_debug_stopped(chip8) == STD_TRUE && executed < left)
+    {
+        chip8->clock += executed;
+        return executed;
+    }
+
+    c8_tick_timers(chip8);
+
+    return executed;
+}
+
+Chip8* c8_init(Chip8* chip8)
+{
+    chip8->pc = C8_PROGRAM_START;
+    chip8->sp = 0;
+    chip8->opcode = 0;
+    chip8->index = 0;
+    chip8->delay_timer = 0;
+    chip8->sound_timer = 0;
+
+    memset(&chip8->memory, 0, sizeof(chip8->memory));
+    memset(&chip8->registers, 0, sizeof(chip8->registers));
+    memset(&chip8->stack, 0, sizeof(chip8->stack));
+    memset(&chip8->keyboard, 0, sizeof(chip8->keyboard));
+
+    c8_clear_disp(chip8);
+    chip8->display_dirty = STD_TRUE; /* Present the blank screen once */
+    chip8->waiting_key = STD_FALSE;
+    chip8->key_register = 0;
+    chip8->keys_read = 0;
+    chip8->frame = 0;
+    chip8->clock = 0;
+    chip8->fast_idle = STD_TRUE;
+    chip8->fault.kind = C8_FAULT_NONE;
+    chip8->fault.pc = 0;
+    chip8->fault.opcode = 0;
+    c8_seed(chip8, C8_DEFAULT_SEED);
 
     for(int i = 0; i < KEYBOARD_SIZE; i++)
-        memset(&(chip8.keyboard[i]), 0, sizeof(chip8.keyboard[i]));
+        memset(&(chip8->keyboard[i]), 0, sizeof(chip8->keyboard[i]));
+
+    memcpy(&(chip8->memory[0]), c8_fontset, 80 * sizeof(UBIT8));
+    memcpy(&(chip8->memory[BIGFONT_ADDR]), c8_bigfont, sizeof(c8_bigfont));
+
+    chip8->hires = 0;
+    chip8->planes = 0x1;
+    memset(chip8->flags, 0, sizeof(chip8->flags));
+    memset(chip8->pattern, 0, sizeof(chip8->pattern));
+    chip8->pitch = 64;
+    chip8->xo_audio = STD_FALSE;
+
+    chip8->engine = C8_ENGINE_SWITCH;
+    chip8->jit = NULL;
+    chip8->debug = NULL;
+#ifdef C8_PROFILE
+    chip8->profile = NULL;
+#endif
+    c8_invalidate_all(chip8);
+
+    chip8->quirks = 0;
+    chip8->load_rom = &c8_load_rom;
+    chip8->loop = c8_quirk_handlers[0].loop;
+
+    return chip8;
+}
 
-    memcpy(&(chip8.memory[0]), c8_fontset, 80 * sizeof(UBIT8));
+void c8_deinit(Chip8* chip8)
+{
+    c8_jit_free(chip8);
+    c8_debug_detach(chip8);
+#ifdef C8_PROFILE
+    c8_profile_detach(chip8);
+#endif
+}
 
-    chip8.load_rom = &c8_load_rom;
-    chip8.loop = &c8_loop;
+UBIT32 c8_display_hash(const Chip8* chip8)
+{
+    UBIT32 hash = 2166136261u; /* FNV offset basis */
 
-    return &chip8;
-}
\ No newline at end of file
+    int words = c8_disp_w(chip8) * c8_disp_h(chip8) / 64;
+
+    /* Hash the rows byte by byte from the MSB, so the result is host independent. */
+    /* The second plane only counts once drawn on, so CHIP-8 hashes do not change. */
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        UBIT64 used = 0;
+
+        for(int i = 0; p > 0 && i < words; i++)
+            used |= chip8->display[p][i];
+
+        if(p > 0 && used == 0)
+            continue;
+
+        for(int i = 0; i < words; i++)
+        {
+            for(int b = 56; b >= 0; b -= 8)
+            {
+                hash ^= (UBIT8)(chip8->display[p][i] >> b);
+                hash *= 16777619u; /* FNV prime */
+            }
+        }
+    }
+
+    return hash;
+}
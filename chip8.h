@@ -1,24 +1,98 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
 /* Type Definition */
 
 #define UBIT8    unsigned char
 #define UBIT16   unsigned int
+#define UBIT32   uint32_t
+#define UBIT64   uint64_t
 
 typedef enum {
     STD_FALSE = 0,
     STD_TRUE  = 1
 } STD_BOOL;
 
-typedef void (*loop_fn)(void); /* Loop function pointer */
-typedef int (*load_rom_fn)(char*); /* Load ROM function pointer */
+typedef struct Chip8 Chip8;
+typedef struct C8Jit C8Jit;
+typedef struct C8Profile C8Profile;
+typedef struct C8Debug C8Debug;
+
+typedef void (*loop_fn)(Chip8*); /* Loop function pointer */
+typedef int (*load_rom_fn)(Chip8*, char*); /* Load ROM function pointer */
 
 /* Chip-8 */
 
-#define DISP_W 64
+#define DISP_W 64 /* Low resolution display */
 #define DISP_H 32
 
+#define C8_HIRES_W 128 /* SUPER-CHIP / XO-CHIP high resolution display (00FF) */
+#define C8_HIRES_H 64
+
+#define C8_PLANES      2 /* XO-CHIP bitplanes */
+#define C8_PLANE_WORDS (C8_HIRES_W * C8_HIRES_H / 64) /* Words per plane */
+
 #define KEYBOARD_SIZE 4
 
+#define C8_MEM_SIZE 4096    /* Code address space: jumps and calls are 12-bit */
+#define C8_RAM_SIZE 0x10000 /* XO-CHIP memory, above C8_MEM_SIZE it is data only (F000 nnnn) */
+
+#define C8_PROGRAM_START 0x200 /* ROMs are loaded, and start, here */
+#define C8_PROGRAM_SIZE  (C8_RAM_SIZE - C8_PROGRAM_START) /* Largest (XO-CHIP) ROM */
+
+#define C8_FRAME_HZ     60 /* Timers and display refresh frequency */
+#define C8_DEFAULT_IPF  11 /* Instructions per frame (~660Hz CPU) */
+#define C8_DEFAULT_SEED 0x43484950u /* PRNG seed set by c8_init */
+
+/* Quirks: how the ambiguous instructions behave, CHIP-8 variants disagree */
+#define C8_QUIRK_SHIFT_VY (1u << 0) /* 8xy6/8xyE shift Vy into Vx (else Vx in place) */
+#define C8_QUIRK_LOAD_I   (1u << 1) /* FX55/FX65 leave I incremented past the last register */
+#define C8_QUIRK_VF_RESET (1u << 2) /* 8xy1/8xy2/8xy3 clear VF */
+#define C8_QUIRK_CLIP     (1u << 3) /* DRW clips sprites at the edges (else wraps) */
+#define C8_QUIRK_SETS     16        /* Combinations of the quirks above */
+
+/* Execution engines */
+typedef enum {
+    C8_ENGINE_SWITCH     = 0, /* Reference switch interpreter (c8_process_instruction), set by c8_init */
+    C8_ENGINE_PREDECODED = 1, /* Predecoded instruction cache with threaded dispatch */
+    C8_ENGINE_JIT        = 2, /* x86-64 recompiler for hot blocks, predecoded otherwise */
+    C8_ENGINE_SANDBOX    = 3  /* Switch interpreter trapping the accesses out of bounds, for untrusted ROMs */
+} C8_ENGINE;
+
+/* Sandbox faults: what stopped a machine on C8_ENGINE_SANDBOX. The other */
+/* engines trust the ROM and leave these accesses undefined.              */
+typedef enum {
+    C8_FAULT_NONE = 0,
+    C8_FAULT_PC,              /* Fetch (or skip, F000 lookahead) past the end of memory */
+    C8_FAULT_STACK_OVERFLOW,  /* 2nnn with the 16 stack levels in use */
+    C8_FAULT_STACK_UNDERFLOW, /* 00EE with an empty stack */
+    C8_FAULT_MEMORY,          /* FX33/FX55/FX65 past the end of memory */
+    C8_FAULT_KEY              /* Ex9E/ExA1 on a key above F */
+} C8_FAULT;
+
+/* Fault record, the faulting instruction has not been executed */
+typedef struct
+{
+    C8_FAULT kind;
+    UBIT16   pc;
+    UBIT16   opcode; /* 0 for C8_FAULT_PC */
+} C8Fault;
+
+/* Predecoded instruction, one per memory address */
 typedef struct
+{
+    UBIT8    op;     /* Handler (C8_OP_*), C8_OP_DECODE when not decoded yet */
+    UBIT8    x;      /* Vx register */
+    UBIT8    y;      /* Vy register */
+    UBIT8    kk;     /* Lowest byte (n is kk & 0xF) */
+    uint16_t nnn;    /* Address */
+    uint16_t opcode; /* Raw opcode, for the handlers shared with the switch interpreter */
+} C8Decoded;
+
+struct Chip8
 {
     UBIT16 pc;            /* PC (Program Counter) */
     UBIT16 sp;            /* SP (Stack Pointer) */
@@ -26,15 +100,116 @@ typedef struct
     UBIT16 index;         /* Index register */
     UBIT16 delay_timer;   /* Delay Timer (60Hz freq) */
     UBIT16 sound_timer;   /* Sound Timer (60Hz freq) */
-    UBIT8  memory[4096];  /* 4096 bytes */
+    UBIT8  memory[C8_RAM_SIZE]; /* 64 KB, CHIP-8 and SUPER-CHIP ROMs use the first 4096 bytes */
     UBIT8  registers[16]; /* 16 8bit registers (V0...VF) */
     UBIT16 stack[16];     /* Stack (up to 16 nested levels) */
-    UBIT8  display[DISP_H][DISP_W]; /* Display is DISP_WxDISP_H pixels */
+    UBIT64 display[C8_PLANES][C8_PLANE_WORDS]; /* One bitmap per plane, rows of one word (low resolution) */
+                                                /* or two (high resolution) packed from word 0 (MSB is x = 0) */
+    UBIT8  hires;         /* 128x64 display (00FF), 64x32 otherwise (00FE) */
+    UBIT8  planes;        /* Planes drawn, cleared and scrolled (FN01), bit p is plane p */
+    UBIT8  flags[16];     /* SUPER-CHIP RPL user flags (Fx75/Fx85) */
+    UBIT8  pattern[16];   /* XO-CHIP audio pattern, 128 1-bit samples (F002) */
+    UBIT8  pitch;         /* XO-CHIP pattern playback rate (Fx3A), 4000 * 2^((pitch - 64) / 48) Hz */
+    STD_BOOL xo_audio;    /* The buzzer plays _pattern_ instead of a square wave (set by F002) */
     UBIT8  keyboard[KEYBOARD_SIZE * KEYBOARD_SIZE]; /* 0...9 A...F */
+    STD_BOOL display_dirty; /* Display changed since the last present (set by CLS/DRW) */
+    STD_BOOL waiting_key;   /* Parked by FX0A until a key is pressed */
+    UBIT8    key_register;  /* Register receiving the key when FX0A resumes */
+    UBIT16   keys_read;     /* Keys read by Ex9E/ExA1/FX0A since the frontend cleared them, bit k is key k */
+    UBIT64   rng;           /* Cxkk PRNG state (xorshift64*), set by c8_seed */
+    UBIT64   frame;         /* Virtual clock: timer ticks since c8_init */
+    unsigned long clock;    /* Virtual clock: cycles since the last timer tick */
+    STD_BOOL fast_idle;     /* Idle loops are fast-forwarded (set by c8_init), clear to run them cycle by cycle */
+    UBIT8    quirks;        /* C8_QUIRK_* set, selected by c8_set_quirks */
+    C8Fault  fault;         /* Set by C8_ENGINE_SANDBOX, the machine executes nothing more */
+
+    C8_ENGINE engine; /* Engine used by c8_run */
+    C8Decoded decoded[C8_MEM_SIZE]; /* Predecoded instruction cache (C8_ENGINE_PREDECODED) */
+    C8Jit*    jit; /* Recompiler state, allocated on first use (C8_ENGINE_JIT) */
+    C8Debug*  debug; /* Attached debugger, see chip8_debug.h */
+#ifdef C8_PROFILE
+    C8Profile* profile; /* Instrumentation, see chip8_profile.h */
+#endif
+
+    load_rom_fn load_rom; /* Function to load the ROM (Parameters: Chip8* chip8, char* filename) */
+    loop_fn loop; /* CPU Cycle Function (Parameters: Chip8* chip8) */
+};
+
+/* This function inits the Chip8 structure passed as parameter and returns it. */
+/* Every instance is independent, so many machines can run side by side.      */
+Chip8* c8_init(Chip8* chip8);
+
+/* This function releases the engine resources, call it before reusing or freeing an instance */
+void c8_deinit(Chip8* chip8);
+
+/* This function returns the display width in pixels for the current mode */
+static inline int c8_disp_w(const Chip8* chip8)
+{
+    return chip8->hires ? C8_HIRES_W : DISP_W;
+}
+
+/* This function returns the display height in pixels for the current mode */
+static inline int c8_disp_h(const Chip8* chip8)
+{
+    return chip8->hires ? C8_HIRES_H : DISP_H;
+}
+
+/* This function returns the colour (bit p set when lit in plane p) at the given display position */
+static inline UBIT8 c8_pixel(const Chip8* chip8, int x, int y)
+{
+    int words = c8_disp_w(chip8) / 64;
+    int w = y * words + x / 64;
+    int b = 63 - (x % 64);
+
+    return ((chip8->display[0][w] >> b) & 1) | (((chip8->display[1][w] >> b) & 1) << 1);
+}
+
+/* This function looks up an engine by name ("switch", "predecoded", "jit", "sandbox"), returns 0 on success */
+int c8_engine_by_name(const char* name, C8_ENGINE* engine);
+
+/* This function selects the engine by name ("switch", "predecoded", "jit", "sandbox"), returns 0 on success */
+int c8_set_engine(Chip8* chip8, const char* name);
+
+/* This function returns the name of a fault kind */
+const char* c8_fault_name(C8_FAULT kind);
+
+/* This function selects the C8_QUIRK_* set of a machine, usually when its ROM */
+/* is loaded (none after c8_init). Every set has its own handlers with the     */
+/* quirks compiled in, so the choice costs nothing per instruction.            */
+void c8_set_quirks(Chip8* chip8, UBIT8 quirks);
+
+/* This function runs up to _cycles_ CPU cycles and returns the executed ones.   */
+/* It returns early, and executes nothing, while the machine waits on FX0A or,  */
+/* on C8_ENGINE_SANDBOX, once it faulted (see _fault_).                          */
+/* With _fast_idle_, a machine spinning on a jump to itself or on a FX07 / 3xkk  */
+/* / 1nnn delay timer loop skips the rest of the cycles: they are counted as     */
+/* executed and leave the machine exactly as running them would.                */
+unsigned long c8_run(Chip8* chip8, unsigned long cycles);
+
+/* This function decrements the timers (60Hz) and advances the virtual clock by */
+/* one frame, returns STD_TRUE when the sound timer expires                      */
+STD_BOOL c8_tick_timers(Chip8* chip8);
+
+/* This function advances the virtual clock by _cycles_ cycles, ticking the timers */
+/* every _ipf_ cycles. Cycles spent parked on FX0A still elapse, so the timers do  */
+/* not depend on the host. Returns the executed cycles.                            */
+unsigned long c8_run_clocked(Chip8* chip8, unsigned long cycles, unsigned long ipf);
+
+/* This function emulates up to the end of the current 60Hz frame: the cycles left */
+/* before the next timer tick (_ipf_ from a frame boundary) and the tick itself    */
+unsigned long c8_run_frame(Chip8* chip8, unsigned long ipf);
+
+/* This function seeds the Cxkk PRNG, equal seeds give equal runs */
+void c8_seed(Chip8* chip8, UBIT64 seed);
+
+/* This function updates the state of a key (0x0...0xF), a press resumes a pending FX0A */
+void c8_key_event(Chip8* chip8, UBIT8 key, STD_BOOL pressed);
+
+/* This function copies a _size_ bytes program (e.g. a read-only ROM mapping) */
+/* to C8_PROGRAM_START, returns 0 on success, 1 if it does not fit            */
+int c8_load_program(Chip8* chip8, const UBIT8* program, size_t size);
 
-    load_rom_fn load_rom; /* Function to load the ROM (Parameters: char* filename) */
-    loop_fn loop; /* CPU Cycle Function */
-} Chip8;
+/* This function returns a FNV-1a hash of the display contents */
+UBIT32 c8_display_hash(const Chip8* chip8);
 
-/* This function inits the Chip8 structure and returns it */
-Chip8* c8_init();
\ No newline at end of file
+#endif /* CHIP8_H */
@@ -0,0 +1,130 @@
+#include <math.h>
+#include <string.h>
+
+#include "chip8_audio.h"
+
+/* ---- Buzzer ---- */
+
+void c8_audio_init(C8Audio* audio, int rate)
+{
+    memset(audio, 0, sizeof(C8Audio));
+
+    atomic_init(&audio->head, 0);
+    atomic_init(&audio->tail, 0);
+    atomic_init(&audio->frame, 0);
+
+    audio->rate = rate;
+}
+
+/* This function returns the buzzer state _chip8_ asks for */
+static C8BuzzerEdge audio_state(const C8Audio* audio, const Chip8* chip8)
+{
+    C8BuzzerEdge buzzer;
+
+    memset(&buzzer, 0, sizeof(buzzer));
+    buzzer.frame = chip8->frame;
+    buzzer.on = (chip8->sound_timer > 0) ? 1 : 0;
+
+    if(chip8->xo_audio == STD_TRUE)
+    {
+        /* 128 bits loop at 4000 * 2^((pitch - 64) / 48) bits per second */
+        double bits = 4000.0 * pow(2.0, (chip8->pitch - 64) / 48.0);
+
+        buzzer.xo = 1;
+        memcpy(buzzer.pattern, chip8->pattern, sizeof(buzzer.pattern));
+        buzzer.step = (UBIT32)(bits / 128.0 * 4294967296.0 / audio->rate);
+    }
+    else
+    {
+        buzzer.step = (UBIT32)(((UBIT64)C8_AUDIO_TONE << 32) / audio->rate);
+    }
+
+    return buzzer;
+}
+
+void c8_audio_frame(C8Audio* audio, const Chip8* chip8)
+{
+    C8BuzzerEdge buzzer = audio_state(audio, chip8);
+    size_t head = 0;
+
+    /* A silent buzzer publishes no pattern changes */
+    if(buzzer.on != audio->buzzer.on || (buzzer.on != 0 && (buzzer.xo != audio->buzzer.xo
+        || buzzer.step != audio->buzzer.step || memcmp(buzzer.pattern, audio->buzzer.pattern, sizeof(buzzer.pattern)) != 0)))
+    {
+        head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+
+        if(head - atomic_load_explicit(&audio->tail, memory_order_acquire) == C8_AUDIO_EDGES)
+        {
+            /* The audio thread is stalled: keep the old state, retry next frame */
+            audio->dropped++;
+        }
+        else
+        {
+            audio->edges[head & (C8_AUDIO_EDGES - 1)] = buzzer;
+            atomic_store_explicit(&audio->head, head + 1, memory_order_release);
+
+            audio->buzzer = buzzer;
+        }
+    }
+
+    atomic_store_explicit(&audio->frame, chip8->frame, memory_order_release);
+}
+
+void c8_audio_render(C8Audio* audio, int16_t* out, size_t samples)
+{
+    UBIT64 frame = atomic_load_explicit(&audio->frame, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&audio->head, memory_order_acquire);
+    UBIT64 now = audio->base + audio->pos * C8_FRAME_HZ / audio->rate;
+
+    /* Anchor the sample clock on the emulation, again when they drift apart */
+    if(audio->synced == STD_FALSE || now + 1 < frame || now > frame + 1)
+    {
+        audio->synced = STD_TRUE;
+        audio->base = frame;
+        audio->pos = 0;
+    }
+
+    for(size_t i = 0; i < samples; i++)
+    {
+        now = audio->base + audio->pos * C8_FRAME_HZ / audio->rate;
+
+        /* Late edges apply at once, the others when their frame starts */
+        while(tail != head)
+        {
+            const C8BuzzerEdge* e = &audio->edges[tail & (C8_AUDIO_EDGES - 1)];
+
+            if(e->frame > now)
+            {
+                break;
+            }
+
+            audio->playing = *e;
+            tail++;
+        }
+
+        if(audio->playing.on != 0)
+        {
+            STD_BOOL high = (audio->phase & 0x80000000u) ? STD_TRUE : STD_FALSE;
+
+            if(audio->playing.xo != 0)
+            {
+                /* The top 7 bits of the phase index the 128-bit pattern */
+                UBIT32 bit = audio->phase >> 25;
+
+                high = ((audio->playing.pattern[bit / 8] >> (7 - bit % 8)) & 1) ? STD_TRUE : STD_FALSE;
+            }
+
+            out[i] = (high == STD_TRUE) ? C8_AUDIO_VOLUME : -C8_AUDIO_VOLUME;
+            audio->phase += audio->playing.step;
+        }
+        else
+        {
+            out[i] = 0;
+        }
+
+        audio->pos++;
+    }
+
+    atomic_store_explicit(&audio->tail, tail, memory_order_release);
+}
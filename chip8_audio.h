@@ -0,0 +1,69 @@
+#ifndef CHIP8_AUDIO_H
+#define CHIP8_AUDIO_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/* Buzzer                                                               */
+/*                                                                      */
+/* The emulation thread publishes the buzzer on/off edges, stamped with */
+/* the frame they start at, into a lock-free single-producer single-    */
+/* consumer ring, along with the frame it is running. The audio thread  */
+/* turns them into a square wave, or loops the XO-CHIP 1-bit pattern at */
+/* its pitch, so neither side ever waits for the other. A new pattern   */
+/* or pitch is published as an edge too. The generator follows its own */
+/* sample clock, which keeps the edges spaced in frames, and jumps to   */
+/* the emulation frame when the two clocks drift apart by more than one */
+/* frame.                                                               */
+
+#define C8_AUDIO_RATE   44100 /* Samples per second */
+#define C8_AUDIO_TONE   440   /* Square wave frequency (Hz) */
+#define C8_AUDIO_VOLUME 6000  /* Square wave amplitude (int16) */
+#define C8_AUDIO_EDGES  64    /* Ring capacity, power of two */
+
+typedef struct
+{
+    UBIT64 frame;       /* Frame (chip8->frame) the edge starts at */
+    UBIT8  on;          /* Buzzer state from that frame on */
+    UBIT8  xo;          /* Play _pattern_ instead of the square wave */
+    UBIT8  pattern[16]; /* XO-CHIP pattern, 128 bits, MSB first */
+    UBIT32 step;        /* Phase increment per sample, 32-bit fixed point */
+} C8BuzzerEdge;
+
+typedef struct
+{
+    C8BuzzerEdge   edges[C8_AUDIO_EDGES];
+    _Atomic size_t head; /* Next edge to write, owned by the producer */
+    _Atomic size_t tail; /* Next edge to read, owned by the consumer */
+    _Atomic UBIT64 frame; /* Frame the emulation is running, owned by the producer */
+
+    int      rate;
+
+    /* Producer (emulation thread) */
+    C8BuzzerEdge buzzer; /* Last published state */
+    unsigned dropped;    /* Edges delayed by a frame because the ring was full */
+
+    /* Consumer (audio thread) */
+    UBIT32   phase;      /* Position in the wave or the pattern, 32-bit fixed point */
+    C8BuzzerEdge playing; /* Buzzer state being played */
+    STD_BOOL synced;     /* The frame clock was anchored */
+    UBIT64   base;       /* Frame at the anchor */
+    UBIT64   pos;        /* Samples rendered since the anchor */
+} C8Audio;
+
+/* This function initializes the buzzer for a _rate_ Hz output */
+void c8_audio_init(C8Audio* audio, int rate);
+
+/* This function publishes the buzzer state (on while the sound timer runs), call */
+/* it from the emulation thread once per frame, before the timer tick. It never   */
+/* blocks.                                                                        */
+void c8_audio_frame(C8Audio* audio, const Chip8* chip8);
+
+/* This function renders _samples_ mono int16 samples, call it from the audio */
+/* thread. It never blocks.                                                    */
+void c8_audio_render(C8Audio* audio, int16_t* out, size_t samples);
+
+#endif /* CHIP8_AUDIO_H */
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "chip8_batch.h"
+
+/* Every worker owns a range of pending jobs. The owner takes jobs from the */
+/* head of its range and idle workers steal the back half of another range, */
+/* so the ranges always stay contiguous and no job is ever copied.          */
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t head; /* Next job to run */
+    size_t tail; /* One past the last job */
+} c8_batch_deque;
+
+typedef struct
+{
+    C8BatchJob*     jobs;
+    c8_batch_deque* deques;
+    int             workers;
+    unsigned long   cycles;
+    C8_ENGINE       engine;
+} c8_batch_pool;
+
+typedef struct
+{
+    c8_batch_pool* pool;
+    int            id;
+} c8_batch_worker;
+
+/* This function pops a job from the head of the worker's own range */
+static int c8_batch_pop(c8_batch_deque* d, size_t* job)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&d->lock);
+    if(d->head < d->tail)
+    {
+        *job = d->head++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+/* This function steals the back half of a victim range into the thief range */
+static int c8_batch_steal(c8_batch_pool* pool, int thief)
+{
+    for(int i = 1; i < pool->workers; i++)
+    {
+        c8_batch_deque* victim = &pool->deques[(thief + i) % pool->workers];
+        c8_batch_deque* own = &pool->deques[thief];
+        size_t from = 0;
+        size_t to = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if(victim->head < victim->tail)
+        {
+            to = victim->tail;
+            from = victim->head + (victim->tail - victim->head) / 2;
+            victim->tail = from;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if(from < to)
+        {
+            pthread_mutex_lock(&own->lock);
+            own->head = from;
+            own->tail = to;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* This function runs a single ROM on the worker's machine */
+static void c8_batch_exec(Chip8* chip8, C8BatchJob* job, const c8_batch_pool* pool, int id)
+{
+    c8_init(chip8);
+    chip8->engine = pool->engine;
+
+    job->worker = id;
+    job->cycles = 0;
+
+    if((job->image != NULL) ? c8_romlib_load(chip8, job->image) != 0 : chip8->load_rom(chip8, job->rom) != 0)
+    {
+        job->status = C8_BATCH_LOAD;
+    }
+    else
+    {
+        job->cycles = c8_run(chip8, pool->cycles);
+        job->display_hash = c8_display_hash(chip8);
+        job->fault = chip8->fault;
+
+        if(chip8->fault.kind != C8_FAULT_NONE)
+            job->status = C8_BATCH_FAULT;
+        else
+            job->status = (chip8->waiting_key == STD_TRUE) ? C8_BATCH_KEYWAIT : C8_BATCH_OK;
+    }
+
+    c8_deinit(chip8);
+}
+
+static void* c8_batch_thread(void* arg)
+{
+    c8_batch_worker* w = (c8_batch_worker*)arg;
+    c8_batch_pool* pool = w->pool;
+    Chip8* chip8 = malloc(sizeof(Chip8));
+    size_t job = 0;
+
+    if(chip8 == NULL)
+    {
+        return NULL;
+    }
+
+    for(;;)
+    {
+        while(c8_batch_pop(&pool->deques[w->id], &job))
+        {
+            c8_batch_exec(chip8, &pool->jobs[job], pool, w->id);
+        }
+
+        if(!c8_batch_steal(pool, w->id))
+        {
+            break;
+        }
+    }
+
+    free(chip8);
+
+    return NULL;
+}
+
+int c8_batch_cores(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n > 0) ? (int)n : 1;
+}
+
+int c8_batch_run(C8BatchJob* jobs, size_t count, unsigned long cycles, C8_ENGINE engine, int threads)
+{
+    c8_batch_pool pool;
+    c8_batch_worker* workers = NULL;
+    pthread_t* tids = NULL;
+    int started = 0;
+    int ret = 0;
+
+    if(threads <= 0)
+    {
+        threads = c8_batch_cores();
+    }
+
+    if((size_t)threads > count)
+    {
+        threads = (count > 0) ? (int)count : 1;
+    }
+
+    pool.jobs = jobs;
+    pool.workers = threads;
+    pool.cycles = cycles;
+    pool.engine = engine;
+    pool.deques = calloc(threads, sizeof(c8_batch_deque));
+    workers = calloc(threads, sizeof(c8_batch_worker));
+    tids = calloc(threads, sizeof(pthread_t));
+
+    if(pool.deques == NULL || workers == NULL || tids == NULL)
+    {
+        ret = 1;
+        goto out;
+    }
+
+    /* Split the corpus in one contiguous range per worker */
+    for(int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].head = count * i / threads;
+        pool.deques[i].tail = count * (i + 1) / threads;
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        jobs[i].status = C8_BATCH_PENDING;
+    }
+
+    for(started = 0; started < threads; started++)
+    {
+        if(pthread_create(&tids[started], NULL, c8_batch_thread, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    /* Workers already running drain the whole corpus by stealing */
+    for(int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+
+    if(started == 0)
+    {
+        ret = 1;
+    }
+
+    for(int i = 0; i < threads; i++)
+    {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+
+out:
+    free(pool.deques);
+    free(workers);
+    free(tids);
+
+    return ret;
+}
@@ -0,0 +1,39 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+#include "chip8_romlib.h"
+
+/* Batch runner */
+
+typedef enum {
+    C8_BATCH_PENDING = 0, /* Not processed yet */
+    C8_BATCH_OK      = 1, /* ROM executed the requested cycles */
+    C8_BATCH_LOAD    = 2, /* ROM could not be loaded */
+    C8_BATCH_KEYWAIT = 3, /* ROM parked on FX0A, no key will ever come */
+    C8_BATCH_FAULT   = 4  /* ROM quarantined: the sandbox trapped an access out of bounds (_fault_) */
+} C8_BATCH_STATUS;
+
+typedef struct
+{
+    char*           rom;          /* ROM file name */
+    const C8Rom*    image;        /* Preloaded shared mapping, NULL to read _rom_ */
+    C8_BATCH_STATUS status;       /* Result of the run */
+    unsigned long   cycles;       /* Executed CPU cycles */
+    UBIT32          display_hash; /* Display hash after the run */
+    int             worker;       /* Worker that processed the job */
+    C8Fault         fault;        /* C8_BATCH_FAULT: what the sandbox trapped */
+} C8BatchJob;
+
+/* This function runs every job of the batch for the given amount of cycles on */
+/* _engine_, spreading them over a pool of work-stealing threads (0 = one per  */
+/* core). Returns 0 when the pool ran, 1 if the threads could not be created.  */
+/* Only C8_ENGINE_SANDBOX survives malformed ROMs: the others trust them.     */
+int c8_batch_run(C8BatchJob* jobs, size_t count, unsigned long cycles, C8_ENGINE engine, int threads);
+
+/* This function returns the number of online cores */
+int c8_batch_cores(void);
+
+#endif /* CHIP8_BATCH_H */
@@ -0,0 +1,67 @@
+#include "chip8_blit.h"
+
+#if defined(C8_BLIT_X86)
+#include <immintrin.h>
+#endif
+
+/* ---- Display expansion ---- */
+
+void c8_blit_scalar(const UBIT64* plane, int width, int height, void* pixels, int pitch)
+{
+    for(int y = 0; y < height; y++)
+    {
+        UBIT32* out = (UBIT32*)((UBIT8*)pixels + (size_t)y * pitch);
+
+        for(int x = 0; x < width; x++)
+        {
+            UBIT64 word = plane[(y * width + x) / 64];
+
+            /* 0 - 1 is all ones: no branch per pixel */
+            out[x] = 0u - (UBIT32)((word >> (63 - (x % 64))) & 1);
+        }
+    }
+}
+
+#if defined(C8_BLIT_X86)
+
+__attribute__((target("sse2")))
+void c8_blit_sse2(const UBIT64* plane, int width, int height, void* pixels, int pitch)
+{
+    /* Lane i tests bit 3 - i of a nibble, the leftmost pixel is the MSB */
+    const __m128i bits = _mm_set_epi32(1, 2, 4, 8);
+
+    for(int y = 0; y < height; y++)
+    {
+        UBIT8* out = (UBIT8*)pixels + (size_t)y * pitch;
+        const UBIT64* row = plane + y * (width / 64);
+
+        for(int x = 0; x < width; x += 4)
+        {
+            __m128i v = _mm_set1_epi32((int)((row[x / 64] >> (60 - (x % 64))) & 0xF));
+
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_cmpeq_epi32(_mm_and_si128(v, bits), bits));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void c8_blit_avx2(const UBIT64* plane, int width, int height, void* pixels, int pitch)
+{
+    /* Lane i tests bit 7 - i of a byte, the leftmost pixel is the MSB */
+    const __m256i bits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+    for(int y = 0; y < height; y++)
+    {
+        UBIT8* out = (UBIT8*)pixels + (size_t)y * pitch;
+        const UBIT64* row = plane + y * (width / 64);
+
+        for(int x = 0; x < width; x += 8)
+        {
+            __m256i v = _mm256_set1_epi32((int)((row[x / 64] >> (56 - (x % 64))) & 0xFF));
+
+            _mm256_storeu_si256((__m256i*)(out + x * 4), _mm256_cmpeq_epi32(_mm256_and_si256(v, bits), bits));
+        }
+    }
+}
+
+#endif /* C8_BLIT_X86 */
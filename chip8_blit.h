@@ -0,0 +1,32 @@
+#ifndef CHIP8_BLIT_H
+#define CHIP8_BLIT_H
+
+#include "chip8.h"
+
+/* Display expansion                                                    */
+/*                                                                      */
+/* These kernels turn a bit-packed plane of _width_ x _height_ pixels   */
+/* (_width_ / 64 words per row, MSB first) into 32-bit pixels at native  */
+/* resolution: lit pixels become 0xFFFFFFFF, dark ones 0x00000000.      */
+/* Colours and scaling are left to the GPU, which modulates the lit     */
+/* pixels with a palette colour and blends the transparent dark ones    */
+/* over the background. Rows are _pitch_ bytes apart.                   */
+
+typedef void (*C8BlitFunc)(const UBIT64* plane, int width, int height, void* pixels, int pitch);
+
+/* This function expands a plane one pixel at a time, on every host */
+void c8_blit_scalar(const UBIT64* plane, int width, int height, void* pixels, int pitch);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define C8_BLIT_X86
+
+/* This function expands a plane four pixels at a time, needs SSE2 */
+void c8_blit_sse2(const UBIT64* plane, int width, int height, void* pixels, int pitch);
+
+/* This function expands a plane eight pixels at a time, needs AVX2 */
+void c8_blit_avx2(const UBIT64* plane, int width, int height, void* pixels, int pitch);
+
+#endif /* __x86_64__ || __i386__ */
+
+#endif /* CHIP8_BLIT_H */
@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8_capture.h"
+
+/* ---- Frame capture ---- */
+
+#define C8_CAPTURE_IDLE_NS 4000000 /* Writer sleep when the ring is empty */
+#define C8_CAPTURE_FULL_NS 100000  /* Lossless capture: producer sleep when the ring is full, writer sleep */
+
+/* This function writes a display as C8_CAPTURE_BYTES bytes, in columns: byte  */
+/* k of every word, then byte k + 1. A sprite moving down the screen changes  */
+/* one run of bytes per column instead of a few bytes on every row.           */
+static void capture_bytes(const UBIT64 display[C8_PLANES][C8_PLANE_WORDS], UBIT8* bytes)
+{
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        for(int k = 0; k < 8; k++)
+        {
+            for(int w = 0; w < C8_PLANE_WORDS; w++)
+            {
+                *bytes++ = (UBIT8)(display[p][w] >> (56 - 8 * k));
+            }
+        }
+    }
+}
+
+static size_t capture_varint(UBIT8* out, UBIT64 value)
+{
+    size_t n = 0;
+
+    while(value >= 0x80)
+    {
+        out[n++] = (UBIT8)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (UBIT8)value;
+
+    return n;
+}
+
+/* This function run-length encodes a frame difference, returns the encoded size */
+static size_t capture_encode(const UBIT8* diff, UBIT8* out)
+{
+    size_t n = 0;
+    size_t i = 0;
+
+    while(i < C8_CAPTURE_BYTES)
+    {
+        size_t z = i;
+        size_t end = 0;
+
+        while(z < C8_CAPTURE_BYTES && diff[z] == 0)
+        {
+            z++;
+        }
+
+        /* Trailing unchanged bytes are implied */
+        if(z == C8_CAPTURE_BYTES)
+        {
+            break;
+        }
+
+        if(z - i >= 64)
+        {
+            out[n++] = 0xC0 | ((z - i) & 0x3F);
+            out[n++] = (UBIT8)((z - i) >> 6);
+        }
+        else if(z > i)
+        {
+            out[n++] = 0x80 | (UBIT8)(z - i);
+        }
+
+        /* Literals absorb runs of one or two unchanged bytes, a token costs as much */
+        i = z;
+        end = z;
+        while(end < C8_CAPTURE_BYTES && end - i < 128)
+        {
+            size_t zeros = 0;
+
+            while(end + zeros < C8_CAPTURE_BYTES && diff[end + zeros] == 0 && zeros < 3)
+            {
+                zeros++;
+            }
+
+            if(zeros == 3 || end + zeros == C8_CAPTURE_BYTES || end - i + zeros > 128)
+            {
+                break;
+            }
+
+            end += (zeros > 0) ? zeros : 1;
+        }
+
+        out[n++] = (UBIT8)(end - i - 1);
+        memcpy(&out[n], &diff[i], end - i);
+        n += end - i;
+        i = end;
+    }
+
+    return n;
+}
+
+/* This function stores the records the emulation thread publishes */
+static void* capture_writer(void* arg)
+{
+    C8Capture* capture = arg;
+    struct timespec idle = { 0, (capture->lossless == STD_TRUE) ? C8_CAPTURE_FULL_NS : C8_CAPTURE_IDLE_NS };
+
+    for(;;)
+    {
+        /* Closing is read first: every record published before it is then visible */
+        int closing = atomic_load_explicit(&capture->closing, memory_order_acquire);
+        size_t head = atomic_load_explicit(&capture->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&capture->tail, memory_order_relaxed);
+
+        if(tail == head)
+        {
+            if(closing)
+            {
+                break;
+            }
+
+            /* Drained: hand the data to the OS before sleeping, a crash loses little */
+            if(fflush(capture->f) != 0)
+            {
+                capture->error = 1;
+            }
+
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        for(; tail != head; tail++)
+        {
+            const C8CaptureRecord* record = &capture->records[tail & (C8_CAPTURE_SLOTS - 1)];
+
+            if(fwrite(record->data, 1, record->size, capture->f) != record->size)
+            {
+                capture->error = 1;
+            }
+        }
+
+        atomic_store_explicit(&capture->tail, tail, memory_order_release);
+    }
+
+    return NULL;
+}
+
+C8Capture* c8_capture_open(const char* filename, STD_BOOL lossless)
+{
+    C8Capture* capture = calloc(1, sizeof(C8Capture));
+
+    if(capture == NULL)
+    {
+        return NULL;
+    }
+
+    capture->f = fopen(filename, "wb");
+    if(capture->f == NULL)
+    {
+        free(capture);
+        return NULL;
+    }
+
+    atomic_init(&capture->head, 0);
+    atomic_init(&capture->tail, 0);
+    atomic_init(&capture->closing, 0);
+
+    capture->lossless = lossless;
+    capture->bytes = strlen(C8_CAPTURE_MAGIC);
+
+    if(fwrite(C8_CAPTURE_MAGIC, 1, capture->bytes, capture->f) != capture->bytes ||
+       pthread_create(&capture->writer, NULL, capture_writer, capture) != 0)
+    {
+        fclose(capture->f);
+        free(capture);
+        return NULL;
+    }
+
+    return capture;
+}
+
+void c8_capture_frame(C8Capture* capture, const Chip8* chip8)
+{
+    UBIT64 xor[C8_PLANES][C8_PLANE_WORDS];
+    UBIT8 diff[C8_CAPTURE_BYTES];
+    UBIT8 payload[C8_CAPTURE_RECORD];
+    UBIT8 hires = chip8->hires ? 1 : 0;
+    size_t head = atomic_load_explicit(&capture->head, memory_order_relaxed);
+    struct timespec full = { 0, C8_CAPTURE_FULL_NS };
+    C8CaptureRecord* record = NULL;
+    size_t size = 0;
+
+    /* Most frames show the same display, compare the words before encoding */
+    if(hires == capture->hires && memcmp(chip8->display, capture->previous, sizeof(capture->previous)) == 0)
+    {
+        return;
+    }
+
+    while(head - atomic_load_explicit(&capture->tail, memory_order_acquire) == C8_CAPTURE_SLOTS)
+    {
+        /* Real-time: keep diffing against the last stored frame */
+        if(capture->lossless == STD_FALSE)
+        {
+            capture->dropped++;
+            return;
+        }
+
+        nanosleep(&full, NULL);
+    }
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        for(int w = 0; w < C8_PLANE_WORDS; w++)
+        {
+            xor[p][w] = chip8->display[p][w] ^ capture->previous[p][w];
+        }
+    }
+
+    capture_bytes((const UBIT64 (*)[C8_PLANE_WORDS])xor, diff);
+
+    record = &capture->records[head & (C8_CAPTURE_SLOTS - 1)];
+    size = capture_encode(diff, payload);
+
+    record->size = capture_varint(record->data, ((chip8->frame - capture->frame) << 1) | hires);
+    record->size += capture_varint(&record->data[record->size], size);
+    memcpy(&record->data[record->size], payload, size);
+    record->size += size;
+
+    memcpy(capture->previous, chip8->display, sizeof(capture->previous));
+    capture->hires = hires;
+    capture->frame = chip8->frame;
+    capture->frames++;
+    capture->bytes += record->size;
+
+    atomic_store_explicit(&capture->head, head + 1, memory_order_release);
+}
+
+int c8_capture_close(C8Capture* capture)
+{
+    int ret = 0;
+
+    atomic_store_explicit(&capture->closing, 1, memory_order_release);
+    pthread_join(capture->writer, NULL);
+
+    ret = capture->error;
+    if(fclose(capture->f) != 0)
+    {
+        ret = 1;
+    }
+
+    free(capture);
+
+    return ret;
+}
+
+/* ---- Decoding ---- */
+
+/* This function reads a varint, returns 0 on success */
+static int capture_read_varint(FILE* f, UBIT64* value)
+{
+    int c = 0;
+
+    *value = 0;
+
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        if((c = fgetc(f)) == EOF)
+        {
+            return 1;
+        }
+
+        *value |= (UBIT64)(c & 0x7F) << shift;
+
+        if((c & 0x80) == 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int c8_capture_reader_open(C8CaptureReader* reader, const char* filename)
+{
+    char magic[sizeof(C8_CAPTURE_MAGIC) - 1];
+
+    memset(reader, 0, sizeof(C8CaptureReader));
+
+    reader->f = fopen(filename, "rb");
+    if(reader->f == NULL)
+    {
+        return 1;
+    }
+
+    if(fread(magic, 1, sizeof(magic), reader->f) != sizeof(magic) ||
+       memcmp(magic, C8_CAPTURE_MAGIC, sizeof(magic)) != 0)
+    {
+        fclose(reader->f);
+        reader->f = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+int c8_capture_read(C8CaptureReader* reader)
+{
+    UBIT8 payload[C8_CAPTURE_RECORD];
+    UBIT64 delta = 0;
+    UBIT64 size = 0;
+    size_t pos = 0;
+
+    if(capture_read_varint(reader->f, &delta) != 0)
+    {
+        /* A clean end is right after a record */
+        return feof(reader->f) ? 1 : 2;
+    }
+
+    if(capture_read_varint(reader->f, &size) != 0 || size > sizeof(payload) ||
+       fread(payload, 1, size, reader->f) != size)
+    {
+        return 2;
+    }
+
+    for(size_t i = 0; i < size; )
+    {
+        UBIT8 token = payload[i++];
+
+        if(token < 0x80)
+        {
+            size_t count = (size_t)token + 1;
+
+            if(i + count > size || pos + count > C8_CAPTURE_BYTES)
+            {
+                return 2;
+            }
+
+            for(size_t k = 0; k < count; k++)
+            {
+                reader->bytes[pos++] ^= payload[i++];
+            }
+        }
+        else if(token < 0xC0)
+        {
+            pos += token & 0x3F;
+        }
+        else
+        {
+            if(i == size)
+            {
+                return 2;
+            }
+
+            pos += (token & 0x3F) + ((size_t)payload[i++] << 6);
+        }
+
+        if(pos > C8_CAPTURE_BYTES)
+        {
+            return 2;
+        }
+    }
+
+    reader->frame += delta >> 1;
+    reader->hires = delta & 1;
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        for(int w = 0; w < C8_PLANE_WORDS; w++)
+        {
+            UBIT64 word = 0;
+
+            for(int k = 0; k < 8; k++)
+            {
+                word = (word << 8) | reader->bytes[(p * 8 + k) * C8_PLANE_WORDS + w];
+            }
+
+            reader->display[p][w] = word;
+        }
+    }
+
+    return 0;
+}
+
+void c8_capture_reader_close(C8CaptureReader* reader)
+{
+    if(reader->f != NULL)
+    {
+        fclose(reader->f);
+        reader->f = NULL;
+    }
+}
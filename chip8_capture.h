@@ -0,0 +1,123 @@
+#ifndef CHIP8_CAPTURE_H
+#define CHIP8_CAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+/* Frame capture                                                        */
+/*                                                                      */
+/* A capture records every display the emulation shows. Each frame is   */
+/* XORed with the previous one, so only the pixels that changed are     */
+/* set, and the difference is run-length encoded; frames equal to the   */
+/* previous one are not stored at all. The emulation thread encodes     */
+/* into a lock-free single-producer single-consumer ring of records,    */
+/* and a writer thread appends them to the file: the emulation never    */
+/* waits for the disk. When the ring is full a real-time capture drops  */
+/* the frame and encodes the next one against the last stored frame,    */
+/* so the file stays consistent and only intermediate frames are lost;  */
+/* a lossless capture (unthrottled runs) waits for the writer instead.  */
+/*                                                                      */
+/* The file is the header "C8CAP 1\n", then one record per changed      */
+/* frame:                                                               */
+/*                                                                      */
+/*   varint  frames since the previous record (since frame 0 first),    */
+/*           shifted left once, bit 0 = hires                           */
+/*   varint  size of the encoded difference                             */
+/*   ...     encoded difference of the 2048 display bytes: for plane 0   */
+/*           then 1, byte 0 (MSB) of the 128 Chip8.display words, then  */
+/*           byte 1 and so on                                           */
+/*                                                                      */
+/* The difference is a list of tokens, the bytes after the last token   */
+/* are unchanged:                                                       */
+/*                                                                      */
+/*   0nnnnnnn           n + 1 literal bytes follow                      */
+/*   10nnnnnn           n unchanged bytes (1...63)                      */
+/*   11nnnnnn mmmmmmmm  n + 64 * m unchanged bytes                      */
+/*                                                                      */
+/* Varints are 7 bits per byte, least significant first, bit 7 set on   */
+/* all bytes but the last.                                              */
+
+#define C8_CAPTURE_VERSION 1
+#define C8_CAPTURE_MAGIC   "C8CAP 1\n"
+#define C8_CAPTURE_BYTES   (C8_PLANES * C8_PLANE_WORDS * 8) /* Display bytes per frame */
+#define C8_CAPTURE_SLOTS   128 /* Ring capacity in records, power of two */
+#define C8_CAPTURE_RECORD  (C8_CAPTURE_BYTES + C8_CAPTURE_BYTES / 128 + 32) /* Largest record */
+
+typedef struct
+{
+    size_t size;                      /* Bytes used in _data_ */
+    UBIT8  data[C8_CAPTURE_RECORD];   /* One encoded record */
+} C8CaptureRecord;
+
+typedef struct
+{
+    C8CaptureRecord records[C8_CAPTURE_SLOTS];
+    _Atomic size_t  head;    /* Next record to write, owned by the producer */
+    _Atomic size_t  tail;    /* Next record to store, owned by the writer */
+    _Atomic int     closing; /* Set by c8_capture_close: store what is left and exit */
+
+    FILE*     f;
+    pthread_t writer;
+    int       error;         /* Writer thread: a write failed */
+
+    /* Producer (emulation thread) */
+    STD_BOOL lossless;                            /* Wait for the writer instead of dropping frames */
+    UBIT64   previous[C8_PLANES][C8_PLANE_WORDS]; /* Last stored display */
+    UBIT8    hires;                               /* Last stored mode */
+    UBIT64   frame;                               /* Frame of the last stored record */
+    UBIT64   frames;                              /* Records stored */
+    UBIT64   dropped;                             /* Frames dropped because the ring was full (real-time) */
+    UBIT64   bytes;                               /* Bytes encoded, header included */
+} C8Capture;
+
+/* This function creates the file, writes the header and starts the writer  */
+/* thread. A _lossless_ capture keeps every frame, for runs faster than the */
+/* disk; a real-time one never waits. Returns NULL when the file cannot be  */
+/* created or out of memory.                                                */
+C8Capture* c8_capture_open(const char* filename, STD_BOOL lossless);
+
+/* This function records the display of the machine if it changed since the  */
+/* last stored frame: call it once per frame, after the frame ran. Only the */
+/* emulation thread may call it; it only blocks in a lossless capture.      */
+void c8_capture_frame(C8Capture* capture, const Chip8* chip8);
+
+/* This function stores the pending records, stops the writer thread, closes */
+/* the file and releases the capture. Returns 0 when everything was written. */
+int c8_capture_close(C8Capture* capture);
+
+/* Decoding */
+
+typedef struct
+{
+    FILE*  f;
+    UBIT8  bytes[C8_CAPTURE_BYTES];            /* Display being rebuilt */
+    UBIT64 display[C8_PLANES][C8_PLANE_WORDS]; /* Same layout as Chip8.display */
+    UBIT8  hires;                              /* Same as Chip8.hires */
+    UBIT64 frame;                              /* Frame of the current record */
+} C8CaptureReader;
+
+/* This function opens a capture and checks its header, returns 0 on success */
+int c8_capture_reader_open(C8CaptureReader* reader, const char* filename);
+
+/* This function applies the next record, returns 0 on success, 1 at the end */
+/* of the file, 2 on a malformed record                                       */
+int c8_capture_read(C8CaptureReader* reader);
+
+/* This function closes the capture file */
+void c8_capture_reader_close(C8CaptureReader* reader);
+
+/* This function returns the colour (bit p set when lit in plane p) of a pixel, like c8_pixel */
+static inline UBIT8 c8_capture_pixel(const C8CaptureReader* reader, int x, int y)
+{
+    int words = reader->hires ? C8_HIRES_W / 64 : DISP_W / 64;
+    int w = y * words + x / 64;
+    int b = 63 - (x % 64);
+
+    return ((reader->display[0][w] >> b) & 1) | (((reader->display[1][w] >> b) & 1) << 1);
+}
+
+#endif /* CHIP8_CAPTURE_H */
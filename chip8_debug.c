@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_debug.h"
+#include "chip8_engine.h"
+
+/* ---- Debugger ---- */
+
+C8Debug* c8_debug_attach(Chip8* chip8)
+{
+    C8Debug* debug = calloc(1, sizeof(C8Debug));
+
+    if(debug == NULL)
+    {
+        return NULL;
+    }
+
+    debug->resume = C8_DEBUG_NO_PC;
+    debug->stop_pc = chip8->pc;
+
+    c8_debug_detach(chip8);
+    chip8->debug = debug;
+
+    return debug;
+}
+
+void c8_debug_detach(Chip8* chip8)
+{
+    free(chip8->debug);
+    chip8->debug = NULL;
+}
+
+void c8_debug_break(C8Debug* debug, UBIT16 addr, STD_BOOL on)
+{
+    addr &= C8_MEM_SIZE - 1;
+
+    if(on == STD_TRUE)
+        debug->breakpoints[addr / 64] |= (UBIT64)1 << (addr % 64);
+    else
+        debug->breakpoints[addr / 64] &= ~((UBIT64)1 << (addr % 64));
+}
+
+void c8_debug_watch(C8Debug* debug, UBIT32 addr, UBIT32 len, STD_BOOL on)
+{
+    for(UBIT32 i = 0; i < len && i < C8_RAM_SIZE; i++)
+    {
+        UBIT32 a = (addr + i) & (C8_RAM_SIZE - 1);
+
+        if(on == STD_TRUE)
+            debug->watchpoints[a / 64] |= (UBIT64)1 << (a % 64);
+        else
+            debug->watchpoints[a / 64] &= ~((UBIT64)1 << (a % 64));
+    }
+}
+
+int c8_debug_condition(C8Debug* debug, UBIT8 reg, C8_DEBUG_CMP cmp, UBIT16 value)
+{
+    C8DebugCondition* c = NULL;
+
+    if(debug->condition_count == C8_DEBUG_CONDITIONS || reg > C8_DEBUG_REG_SP || cmp > C8_DEBUG_GE)
+    {
+        return -1;
+    }
+
+    c = &debug->conditions[debug->condition_count];
+    c->reg = reg;
+    c->cmp = cmp;
+    c->value = value;
+    c->held = STD_FALSE;
+    debug->armed |= C8_DEBUG_ARM_COND;
+
+    return (int)debug->condition_count++;
+}
+
+void c8_debug_uncondition(C8Debug* debug, size_t i)
+{
+    if(i >= debug->condition_count)
+    {
+        return;
+    }
+
+    memmove(&debug->conditions[i], &debug->conditions[i + 1], (debug->condition_count - i - 1) * sizeof(C8DebugCondition));
+
+    if(--debug->condition_count == 0)
+    {
+        debug->armed &= ~C8_DEBUG_ARM_COND;
+    }
+}
+
+void c8_debug_step(Chip8* chip8, C8_DEBUG_MODE mode)
+{
+    C8Debug* debug = chip8->debug;
+
+    debug->mode = mode;
+    debug->depth = chip8->sp;
+
+    if(mode == C8_DEBUG_CONTINUE)
+        debug->armed &= ~C8_DEBUG_ARM_STEP;
+    else
+        debug->armed |= C8_DEBUG_ARM_STEP;
+}
+
+UBIT16 c8_debug_register(const Chip8* chip8, UBIT8 reg)
+{
+    switch(reg)
+    {
+    case C8_DEBUG_REG_I:
+        return chip8->index;
+    case C8_DEBUG_REG_DT:
+        return chip8->delay_timer;
+    case C8_DEBUG_REG_ST:
+        return chip8->sound_timer;
+    case C8_DEBUG_REG_SP:
+        return chip8->sp;
+    default:
+        return chip8->registers[reg & 0xF];
+    }
+}
+
+/* This function evaluates a condition on the machine */
+static STD_BOOL c8_debug_holds(const Chip8* chip8, const C8DebugCondition* c)
+{
+    UBIT16 v = c8_debug_register(chip8, c->reg);
+
+    switch(c->cmp)
+    {
+    case C8_DEBUG_EQ:
+        return (v == c->value) ? STD_TRUE : STD_FALSE;
+    case C8_DEBUG_NE:
+        return (v != c->value) ? STD_TRUE : STD_FALSE;
+    case C8_DEBUG_LT:
+        return (v < c->value) ? STD_TRUE : STD_FALSE;
+    case C8_DEBUG_LE:
+        return (v <= c->value) ? STD_TRUE : STD_FALSE;
+    case C8_DEBUG_GT:
+        return (v > c->value) ? STD_TRUE : STD_FALSE;
+    default:
+        return (v >= c->value) ? STD_TRUE : STD_FALSE;
+    }
+}
+
+/* This function checks what the _armed_ flag stands for after an instruction, */
+/* returns the reason to stop or C8_DEBUG_RUNNING                              */
+static C8_DEBUG_STOP c8_debug_check(Chip8* chip8, C8Debug* debug)
+{
+    C8_DEBUG_STOP stop = C8_DEBUG_RUNNING;
+
+    if(debug->armed & C8_DEBUG_ARM_WATCH)
+    {
+        debug->armed &= ~C8_DEBUG_ARM_WATCH;
+        stop = C8_DEBUG_WATCHPOINT;
+    }
+
+    /* Every condition is evaluated, so each one sees every instruction */
+    for(size_t i = 0; i < debug->condition_count; i++)
+    {
+        C8DebugCondition* c = &debug->conditions[i];
+        STD_BOOL held = c->held;
+
+        c->held = c8_debug_holds(chip8, c);
+
+        if(stop == C8_DEBUG_RUNNING && held == STD_FALSE && c->held == STD_TRUE)
+        {
+            debug->stop_condition = i;
+            stop = C8_DEBUG_CONDITION;
+        }
+    }
+
+    if(stop == C8_DEBUG_RUNNING && (debug->armed & C8_DEBUG_ARM_STEP))
+    {
+        /* 2nnn pushes and 00EE pops: back at the starting depth the call returned */
+        if(debug->mode == C8_DEBUG_INTO ||
+           (debug->mode == C8_DEBUG_OVER && chip8->sp <= debug->depth) ||
+           (debug->mode == C8_DEBUG_OUT && chip8->sp < debug->depth))
+        {
+            stop = C8_DEBUG_STEP;
+        }
+    }
+
+    return stop;
+}
+
+unsigned long c8_debug_run(Chip8* chip8, unsigned long cycles)
+{
+    C8Debug* debug = chip8->debug;
+    const C8QuirkHandlers* handlers = &c8_quirk_handlers[chip8->quirks];
+    STD_BOOL sandbox = (chip8->engine == C8_ENGINE_SANDBOX) ? STD_TRUE : STD_FALSE;
+    unsigned long executed = 0;
+    C8_DEBUG_STOP stop = C8_DEBUG_RUNNING;
+
+    debug->stop = C8_DEBUG_RUNNING;
+
+    /* A faulted sandbox executes nothing more */
+    if(sandbox == STD_TRUE && chip8->fault.kind != C8_FAULT_NONE)
+    {
+        stop = C8_DEBUG_FAULT;
+    }
+
+    while(stop == C8_DEBUG_RUNNING && executed < cycles && chip8->waiting_key == STD_FALSE)
+    {
+        if(c8_debug_has_break(debug, chip8->pc) == STD_TRUE && chip8->pc != debug->resume)
+        {
+            stop = C8_DEBUG_BREAKPOINT;
+            break;
+        }
+
+        if(sandbox == STD_TRUE)
+        {
+            C8_FAULT kind = handlers->sandbox(chip8);
+
+            if(kind != C8_FAULT_NONE)
+            {
+                c8_sandbox_fault(chip8, kind);
+                stop = C8_DEBUG_FAULT;
+                break;
+            }
+        }
+        else
+        {
+            chip8->loop(chip8);
+        }
+
+        executed++;
+        debug->resume = C8_DEBUG_NO_PC;
+
+        if(debug->armed != 0 && (stop = c8_debug_check(chip8, debug)) != C8_DEBUG_RUNNING)
+        {
+            break;
+        }
+    }
+
+    if(stop != C8_DEBUG_RUNNING)
+    {
+        /* Any stop ends the pending step, resuming runs the instruction at the pc */
+        debug->stop = stop;
+        debug->stop_pc = chip8->pc;
+        debug->resume = chip8->pc;
+        debug->mode = C8_DEBUG_CONTINUE;
+        debug->armed &= ~C8_DEBUG_ARM_STEP;
+    }
+
+    return executed;
+}
+
+/* ---- Disassembler ---- */
+
+int c8_disassemble(UBIT16 opcode, UBIT16 next, char* out, size_t size)
+{
+    UBIT8  x = (opcode & 0x0F00) >> 8;
+    UBIT8  y = (opcode & 0x00F0) >> 4;
+    UBIT8  n = opcode & 0x000F;
+    UBIT8  kk = opcode & 0x00FF;
+    UBIT16 nnn = opcode & 0x0FFF;
+    int    length = 2;
+
+    static const char* alu[16] = {
+        "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+        NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL
+    };
+
+    switch(opcode >> 12)
+    {
+    case 0x0:
+        if(opcode == 0x00E0)
+            snprintf(out, size, "CLS");
+        else if(opcode == 0x00EE)
+            snprintf(out, size, "RET");
+        else if((opcode & 0xFFF0) == 0x00C0)
+            snprintf(out, size, "SCD %u", n);
+        else if((opcode & 0xFFF0) == 0x00D0)
+            snprintf(out, size, "SCU %u", n);
+        else if(opcode == 0x00FB)
+            snprintf(out, size, "SCR");
+        else if(opcode == 0x00FC)
+            snprintf(out, size, "SCL");
+        else if(opcode == 0x00FD)
+            snprintf(out, size, "EXIT");
+        else if(opcode == 0x00FE)
+            snprintf(out, size, "LOW");
+        else if(opcode == 0x00FF)
+            snprintf(out, size, "HIGH");
+        else
+            snprintf(out, size, "SYS 0x%03X", nnn);
+        break;
+    case 0x1:
+        snprintf(out, size, "JP 0x%03X", nnn);
+        break;
+    case 0x2:
+        snprintf(out, size, "CALL 0x%03X", nnn);
+        break;
+    case 0x3:
+        snprintf(out, size, "SE V%X, 0x%02X", x, kk);
+        break;
+    case 0x4:
+        snprintf(out, size, "SNE V%X, 0x%02X", x, kk);
+        break;
+    case 0x5:
+        if(n == 0x0)
+            snprintf(out, size, "SE V%X, V%X", x, y);
+        else if(n == 0x2)
+            snprintf(out, size, "SAVE V%X-V%X", x, y);
+        else if(n == 0x3)
+            snprintf(out, size, "LOAD V%X-V%X", x, y);
+        else
+            snprintf(out, size, "DW 0x%04X", opcode);
+        break;
+    case 0x6:
+        snprintf(out, size, "LD V%X, 0x%02X", x, kk);
+        break;
+    case 0x7:
+        snprintf(out, size, "ADD V%X, 0x%02X", x, kk);
+        break;
+    case 0x8:
+        if(alu[n] != NULL)
+            snprintf(out, size, "%s V%X, V%X", alu[n], x, y);
+        else
+            snprintf(out, size, "DW 0x%04X", opcode);
+        break;
+    case 0x9:
+        if(n == 0x0)
+            snprintf(out, size, "SNE V%X, V%X", x, y);
+        else
+            snprintf(out, size, "DW 0x%04X", opcode);
+        break;
+    case 0xA:
+        snprintf(out, size, "LD I, 0x%03X", nnn);
+        break;
+    case 0xB:
+        snprintf(out, size, "JP V0, 0x%03X", nnn);
+        break;
+    case 0xC:
+        snprintf(out, size, "RND V%X, 0x%02X", x, kk);
+        break;
+    case 0xD:
+        snprintf(out, size, "DRW V%X, V%X, %u", x, y, n);
+        break;
+    case 0xE:
+        if(kk == 0x9E)
+            snprintf(out, size, "SKP V%X", x);
+        else if(kk == 0xA1)
+            snprintf(out, size, "SKNP V%X", x);
+        else
+            snprintf(out, size, "DW 0x%04X", opcode);
+        break;
+    default:
+        switch(kk)
+        {
+        case 0x00:
+            if(x == 0)
+            {
+                snprintf(out, size, "LD I, 0x%04X", next);
+                length = 4;
+            }
+            else
+            {
+                snprintf(out, size, "DW 0x%04X", opcode);
+            }
+            break;
+        case 0x01:
+            snprintf(out, size, "PLANE %u", x & 0x3);
+            break;
+        case 0x02:
+            if(x == 0)
+                snprintf(out, size, "AUDIO");
+            else
+                snprintf(out, size, "DW 0x%04X", opcode);
+            break;
+        case 0x07:
+            snprintf(out, size, "LD V%X, DT", x);
+            break;
+        case 0x0A:
+            snprintf(out, size, "LD V%X, K", x);
+            break;
+        case 0x15:
+            snprintf(out, size, "LD DT, V%X", x);
+            break;
+        case 0x18:
+            snprintf(out, size, "LD ST, V%X", x);
+            break;
+        case 0x1E:
+            snprintf(out, size, "ADD I, V%X", x);
+            break;
+        case 0x29:
+            snprintf(out, size, "LD F, V%X", x);
+            break;
+        case 0x30:
+            snprintf(out, size, "LD HF, V%X", x);
+            break;
+        case 0x33:
+            snprintf(out, size, "LD B, V%X", x);
+            break;
+        case 0x3A:
+            snprintf(out, size, "PITCH V%X", x);
+            break;
+        case 0x55:
+            snprintf(out, size, "LD [I], V%X", x);
+            break;
+        case 0x65:
+            snprintf(out, size, "LD V%X, [I]", x);
+            break;
+        case 0x75:
+            snprintf(out, size, "LD R, V%X", x);
+            break;
+        case 0x85:
+            snprintf(out, size, "LD V%X, R", x);
+            break;
+        default:
+            snprintf(out, size, "DW 0x%04X", opcode);
+            break;
+        }
+        break;
+    }
+
+    return length;
+}
@@ -0,0 +1,177 @@
+#ifndef CHIP8_DEBUG_H
+#define CHIP8_DEBUG_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* Debugger                                                             */
+/*                                                                      */
+/* Breakpoints, watchpoints, register conditions and stepping for a     */
+/* machine, embeddable in any frontend. A machine without a debugger    */
+/* pays nothing: c8_run tests the _debug_ pointer once per call and the */
+/* memory stores once per FX33/FX55/5xy2. With one attached, c8_run     */
+/* steps the switch interpreter itself: before each instruction it      */
+/* tests the breakpoint bit of the pc, after it the _armed_ flag, only  */
+/* set while a step, a condition or a watchpoint hit is pending.        */
+/*                                                                      */
+/* A stop ends c8_run early with _stop_ set, the machine on the next    */
+/* instruction to execute. c8_run_clocked and c8_run_frame keep the     */
+/* clock where it stopped, so resuming (any c8_run* call) finishes the  */
+/* frame exactly as an uninterrupted run would. Resuming from a         */
+/* breakpoint executes the instruction under it.                        */
+/*                                                                      */
+/* On C8_ENGINE_SANDBOX every step goes through the sandbox check: a    */
+/* faulting instruction is not executed, the fault is recorded as the  */
+/* engine would and the machine stops with C8_DEBUG_FAULT for good.     */
+
+#define C8_DEBUG_CONDITIONS 16 /* Register conditions per debugger */
+
+/* Why c8_run returned */
+typedef enum {
+    C8_DEBUG_RUNNING = 0, /* Not stopped: the cycles ran out or FX0A parked the machine */
+    C8_DEBUG_BREAKPOINT,  /* The pc reached a breakpoint */
+    C8_DEBUG_WATCHPOINT,  /* The last instruction stored to a watched address (_stop_addr_) */
+    C8_DEBUG_CONDITION,   /* Condition _stop_condition_ became true */
+    C8_DEBUG_STEP,        /* The step requested by c8_debug_step is over */
+    C8_DEBUG_FAULT        /* C8_ENGINE_SANDBOX trapped the instruction at the pc, see chip8->fault */
+} C8_DEBUG_STOP;
+
+/* Stepping */
+typedef enum {
+    C8_DEBUG_CONTINUE = 0, /* Run until something stops the machine */
+    C8_DEBUG_INTO,         /* Execute one instruction */
+    C8_DEBUG_OVER,         /* Execute one instruction, a 2nnn up to its 00EE */
+    C8_DEBUG_OUT           /* Run until the current subroutine returns (00EE) */
+} C8_DEBUG_MODE;
+
+/* Registers a condition can test, besides V0...VF (0...15) */
+enum {
+    C8_DEBUG_REG_I  = 16,
+    C8_DEBUG_REG_DT = 17,
+    C8_DEBUG_REG_ST = 18,
+    C8_DEBUG_REG_SP = 19
+};
+
+/* Comparisons of a condition */
+typedef enum {
+    C8_DEBUG_EQ = 0,
+    C8_DEBUG_NE,
+    C8_DEBUG_LT,
+    C8_DEBUG_LE,
+    C8_DEBUG_GT,
+    C8_DEBUG_GE
+} C8_DEBUG_CMP;
+
+/* Condition: stops after the instruction that makes _reg_ _cmp_ _value_ true */
+typedef struct
+{
+    UBIT8        reg;   /* 0...15 for V0...VF, or C8_DEBUG_REG_* */
+    C8_DEBUG_CMP cmp;
+    UBIT16       value;
+    STD_BOOL     held;  /* True after the last instruction */
+} C8DebugCondition;
+
+/* _armed_ bits */
+#define C8_DEBUG_ARM_STEP  (1u << 0)
+#define C8_DEBUG_ARM_COND  (1u << 1)
+#define C8_DEBUG_ARM_WATCH (1u << 2)
+
+#define C8_DEBUG_NO_PC 0xFFFF
+
+struct C8Debug
+{
+    UBIT64 breakpoints[C8_MEM_SIZE / 64]; /* Bit a (word a / 64, bit a % 64): stop before executing address a */
+    UBIT64 watchpoints[C8_RAM_SIZE / 64]; /* Bit a: stop after a store to address a */
+
+    C8DebugCondition conditions[C8_DEBUG_CONDITIONS];
+    size_t           condition_count;
+
+    C8_DEBUG_MODE mode;   /* Pending step */
+    UBIT16        depth;  /* Stack depth when the step started */
+    UBIT8         armed;  /* C8_DEBUG_ARM_*, the only flag tested after each instruction */
+    UBIT16        resume; /* Breakpoint to step over on the next instruction, C8_DEBUG_NO_PC if none */
+
+    C8_DEBUG_STOP stop;            /* Why the last c8_run returned */
+    UBIT16        stop_pc;         /* Next instruction when it stopped */
+    UBIT32        stop_addr;       /* C8_DEBUG_WATCHPOINT: first watched address stored to */
+    size_t        stop_condition;  /* C8_DEBUG_CONDITION: index of the condition */
+};
+
+/* This function allocates a debugger, without any breakpoint, and attaches */
+/* it to the machine. Returns NULL when out of memory.                       */
+C8Debug* c8_debug_attach(Chip8* chip8);
+
+/* This function detaches and releases the debugger of the machine */
+void c8_debug_detach(Chip8* chip8);
+
+/* This function sets (_on_) or clears the breakpoint at _addr_ */
+void c8_debug_break(C8Debug* debug, UBIT16 addr, STD_BOOL on);
+
+/* This function tells whether there is a breakpoint at _addr_ */
+static inline STD_BOOL c8_debug_has_break(const C8Debug* debug, UBIT16 addr)
+{
+    addr &= C8_MEM_SIZE - 1;
+
+    return ((debug->breakpoints[addr / 64] >> (addr % 64)) & 1) ? STD_TRUE : STD_FALSE;
+}
+
+/* This function sets (_on_) or clears the watchpoints on _len_ bytes from _addr_ */
+void c8_debug_watch(C8Debug* debug, UBIT32 addr, UBIT32 len, STD_BOOL on);
+
+/* This function adds a condition, returns its index or -1 when they are all used. */
+/* A condition already true stops after the next instruction.                     */
+int c8_debug_condition(C8Debug* debug, UBIT8 reg, C8_DEBUG_CMP cmp, UBIT16 value);
+
+/* This function removes condition _i_, the next ones move down one index */
+void c8_debug_uncondition(C8Debug* debug, size_t i);
+
+/* This function requests a step, run by the next c8_run* calls. OVER and OUT */
+/* use the stack depth, so they follow the 2nnn/00EE pairs of the program.     */
+/* A breakpoint, watchpoint or condition on the way stops the step early.     */
+void c8_debug_step(Chip8* chip8, C8_DEBUG_MODE mode);
+
+/* This function returns the value of a condition register (V0...VF, C8_DEBUG_REG_*) */
+UBIT16 c8_debug_register(const Chip8* chip8, UBIT8 reg);
+
+/* This function writes the mnemonic of _opcode_ (_next_ is the word after it, */
+/* for F000 nnnn) to _out_ and returns the instruction size: 4 for F000 nnnn,  */
+/* 2 otherwise. Unknown opcodes are written as "DW 0xNNNN".                    */
+int c8_disassemble(UBIT16 opcode, UBIT16 next, char* out, size_t size);
+
+/* Hooks, called by c8_run and the store instructions */
+
+/* This function runs up to _cycles_ cycles under the debugger, like c8_run */
+unsigned long c8_debug_run(Chip8* chip8, unsigned long cycles);
+
+/* This function tells whether the last c8_run stopped in the debugger */
+static inline STD_BOOL c8_debug_stopped(const Chip8* chip8)
+{
+    return (chip8->debug != NULL && chip8->debug->stop != C8_DEBUG_RUNNING) ? STD_TRUE : STD_FALSE;
+}
+
+/* This function checks a store of _len_ bytes at _addr_ against the watchpoints */
+static inline void c8_debug_store(Chip8* chip8, UBIT32 addr, UBIT32 len)
+{
+    C8Debug* debug = chip8->debug;
+
+    for(UBIT32 i = 0; i < len; i++)
+    {
+        UBIT32 a = (addr + i) & (C8_RAM_SIZE - 1);
+
+        if((debug->watchpoints[a / 64] >> (a % 64)) & 1)
+        {
+            debug->stop_addr = a;
+            debug->armed |= C8_DEBUG_ARM_WATCH;
+            return;
+        }
+    }
+}
+
+#define C8_DEBUG_STORE(chip8, addr, len)                  \
+    do {                                                  \
+        if((chip8)->debug != NULL)                        \
+            c8_debug_store((chip8), (addr), (len));       \
+    } while(0)
+
+#endif /* CHIP8_DEBUG_H */
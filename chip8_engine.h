@@ -0,0 +1,176 @@
+#ifndef CHIP8_ENGINE_H
+#define CHIP8_ENGINE_H
+
+#include "chip8.h"
+
+/* Interface shared by the execution engines, not meant for frontends */
+
+enum {
+    FONTSET_LEN = 16,
+    FONTSET_SPRITE = 5,
+    BIGFONT_ADDR = FONTSET_LEN * FONTSET_SPRITE, /* 8x10 digits (Fx30) follow the small ones */
+    BIGFONT_SPRITE = 10
+};
+
+/* Small (Fx29) and big (Fx30) hexadecimal digits, copied to the start of memory */
+extern const UBIT8 c8_fontset[FONTSET_LEN * FONTSET_SPRITE];
+extern const UBIT8 c8_bigfont[FONTSET_LEN * BIGFONT_SPRITE];
+
+/* Predecoded handlers */
+typedef enum {
+    C8_OP_DECODE = 0, /* Entry not decoded yet (or invalidated) */
+    C8_OP_SYS,        /* 0nnn and unknown 8xyN/ExNN: only advance the PC */
+    C8_OP_CLS,        /* 00E0 */
+    C8_OP_RET,        /* 00EE */
+    C8_OP_JP,         /* 1nnn */
+    C8_OP_CALL,       /* 2nnn */
+    C8_OP_SE_KK,      /* 3xkk */
+    C8_OP_SNE_KK,     /* 4xkk */
+    C8_OP_SE_REG,     /* 5xy0 */
+    C8_OP_LD_KK,      /* 6xkk */
+    C8_OP_ADD_KK,     /* 7xkk */
+    C8_OP_LD_REG,     /* 8xy0 */
+    C8_OP_OR,         /* 8xy1 */
+    C8_OP_AND,        /* 8xy2 */
+    C8_OP_XOR,        /* 8xy3 */
+    C8_OP_ADD_REG,    /* 8xy4 */
+    C8_OP_SUB,        /* 8xy5 */
+    C8_OP_SHR,        /* 8xy6 */
+    C8_OP_SUBN,       /* 8xy7 */
+    C8_OP_SHL,        /* 8xyE */
+    C8_OP_SNE_REG,    /* 9xy0 */
+    C8_OP_LD_I,       /* Annn */
+    C8_OP_JP_V0,      /* Bnnn */
+    C8_OP_RND,        /* Cxkk */
+    C8_OP_DRW,        /* Dxyn */
+    C8_OP_SKEY,       /* Ex9E/ExA1 */
+    C8_OP_LD_VX_DT,   /* Fx07 */
+    C8_OP_LD_DT,      /* Fx15 */
+    C8_OP_LD_ST,      /* Fx18 */
+    C8_OP_ADD_I,      /* Fx1E */
+    C8_OP_LD_F,       /* Fx29 */
+    C8_OP_MISC,       /* Fx0A, Fx33, Fx55, Fx65, SUPER-CHIP/XO-CHIP FxNN and unknown FxNN */
+    C8_OP_EXT,        /* 00Cn, 00Dn, 00FB...00FF, 5xy2, 5xy3: run on the switch handlers */
+    C8_OP_OR_VF,      /* 8xy1 with C8_QUIRK_VF_RESET */
+    C8_OP_AND_VF,     /* 8xy2 with C8_QUIRK_VF_RESET */
+    C8_OP_XOR_VF,     /* 8xy3 with C8_QUIRK_VF_RESET */
+    C8_OP_SHR_VY,     /* 8xy6 with C8_QUIRK_SHIFT_VY */
+    C8_OP_SHL_VY,     /* 8xyE with C8_QUIRK_SHIFT_VY */
+    C8_OP_COUNT
+} C8_OP;
+
+/* This function tells whether _opcode_ is a 00NN display or control instruction */
+/* of SUPER-CHIP/XO-CHIP: 00Cn/00Dn scroll, 00FB...00FF                           */
+static inline int c8_is_ext_0(UBIT16 opcode)
+{
+    return (opcode & 0xFFF0) == 0x00C0 || (opcode & 0xFFF0) == 0x00D0 || (opcode >= 0x00FB && opcode <= 0x00FF);
+}
+
+/* This function tells whether _opcode_ is a XO-CHIP 5xy2/5xy3 register range store/load */
+static inline int c8_is_ext_5(UBIT16 opcode)
+{
+    return (opcode & 0xF00E) == 0x5002;
+}
+
+/* This function returns how far a taken skip at _pc_ jumps: over 4 bytes when */
+/* the next instruction is the XO-CHIP F000 nnnn double word, 2 otherwise      */
+static inline UBIT16 c8_skip_len(const Chip8* chip8, UBIT16 pc)
+{
+    return (chip8->memory[pc + 2] == 0xF0 && chip8->memory[pc + 3] == 0x00) ? 6 : 4;
+}
+
+/* Switch interpreter handlers (chip8.c), they read chip8->opcode */
+void c8_process_instruction(Chip8* chip8);
+void c8_process_instruction_cls(Chip8* chip8);
+void c8_process_instruction_C(Chip8* chip8);
+void c8_process_instruction_E(Chip8* chip8);
+void c8_loop(Chip8* chip8);
+
+/* Switch interpreter handlers compiled for one quirk set */
+typedef struct
+{
+    void (*execute)(Chip8* chip8); /* c8_process_instruction */
+    void (*loop)(Chip8* chip8);    /* c8_loop */
+    void (*draw)(Chip8* chip8);    /* Dxyn */
+    void (*misc)(Chip8* chip8);    /* FxNN */
+    C8_FAULT (*sandbox)(Chip8* chip8); /* Sandbox cycle: fetch, check, execute (c8_sandbox_fetch) */
+} C8QuirkHandlers;
+
+/* Handlers of every quirk set, indexed by chip8->quirks */
+extern const C8QuirkHandlers c8_quirk_handlers[C8_QUIRK_SETS];
+
+/* This function fast-forwards an idle loop. When the instruction at pc is a */
+/* jump to itself, or part of a FX07 / 3xkk (or 4xkk) / 1nnn loop that spins */
+/* while the delay timer keeps its value, it leaves the machine as _cycles_  */
+/* cycles of the loop would and returns _cycles_. Returns 0 otherwise.       */
+/* Timers only tick between runs, so the loop cannot end within one.         */
+unsigned long c8_idle_skip(Chip8* chip8, unsigned long cycles);
+
+/* Predecoded engine (chip8_predecode.c) */
+
+/* This function decodes the instruction at _addr_ into the cache */
+void c8_predecode(Chip8* chip8, UBIT16 addr);
+
+/* This function drops the cached instructions overlapping [addr, addr + len) */
+void c8_invalidate(Chip8* chip8, UBIT16 addr, UBIT16 len);
+
+/* This function drops every cached instruction */
+void c8_invalidate_all(Chip8* chip8);
+
+/* This function runs up to _cycles_ cycles with the predecoded engine */
+unsigned long c8_predecoded_run(Chip8* chip8, unsigned long cycles);
+
+/* Recompiler (chip8_jit.c) */
+
+/* This function runs up to _cycles_ cycles with the recompiler */
+unsigned long c8_jit_run(Chip8* chip8, unsigned long cycles);
+
+/* This function drops the compiled blocks reading [addr, addr + len) */
+void c8_jit_invalidate(Chip8* chip8, UBIT16 addr, UBIT16 len);
+
+/* This function drops every compiled block */
+void c8_jit_invalidate_all(Chip8* chip8);
+
+/* This function releases the recompiler */
+void c8_jit_free(Chip8* chip8);
+
+/* Sandbox (chip8_sandbox.c) */
+
+/* Groups holding an instruction that can fault: 00EE (0), 2nnn, ExNN and FxNN. */
+/* The other groups only test this mask, so they cost one shift and a branch.   */
+#define C8_SANDBOX_GROUPS ((1u << 0x0) | (1u << 0x2) | (1u << 0xE) | (1u << 0xF))
+
+/* This function returns the fault the instruction _opcode_ at pc would raise */
+/* if executed now, C8_FAULT_NONE when it stays in bounds                      */
+C8_FAULT c8_sandbox_check(const Chip8* chip8, UBIT16 opcode);
+
+/* This function fetches the instruction at pc into chip8->opcode and returns */
+/* the fault executing it would raise, C8_FAULT_NONE when it is safe to run    */
+static inline C8_FAULT c8_sandbox_fetch(Chip8* chip8)
+{
+    UBIT16 pc = chip8->pc;
+
+    /* The fetch reads two bytes, the skips and F000 nnnn two more: */
+    /* the last word of memory cannot hold an instruction           */
+    if(pc > C8_RAM_SIZE - 4)
+    {
+        return C8_FAULT_PC;
+    }
+
+    chip8->opcode = (chip8->memory[pc] << 8) | chip8->memory[pc + 1];
+
+    if((C8_SANDBOX_GROUPS >> (chip8->opcode >> 12)) & 1)
+    {
+        return c8_sandbox_check(chip8, chip8->opcode);
+    }
+
+    return C8_FAULT_NONE;
+}
+
+/* This function records a fault raised by the instruction at pc, which is not executed */
+void c8_sandbox_fault(Chip8* chip8, C8_FAULT kind);
+
+/* This function runs up to _cycles_ cycles with the sandbox engine */
+unsigned long c8_sandbox_run(Chip8* chip8, unsigned long cycles);
+
+#endif /* CHIP8_ENGINE_H */
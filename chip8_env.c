@@ -0,0 +1,331 @@
+#define _GNU_SOURCE /* memfd_create */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "chip8_env.h"
+
+/* ---- Training environments ---- */
+
+#define C8_ENV_PAGE 4096
+
+struct C8Env
+{
+    int          fd;       /* Shared segment */
+    UBIT8*       base;
+    size_t       size;
+    char*        shm_name; /* Unlinked by c8_env_free, NULL for a memfd */
+    C8EnvHeader* header;
+    C8EnvResult* results;
+    UBIT8*       rom;      /* Private copy of the program */
+    size_t       rom_size;
+    C8EnvOptions options;
+    C8EnvHooks   hooks;
+};
+
+Chip8* c8_env_machine(C8Env* env, size_t i)
+{
+    return (Chip8*)(env->base + env->header->machine_offset + i * env->header->machine_stride);
+}
+
+const UBIT64* c8_env_observation(const C8Env* env, size_t i)
+{
+    const UBIT8* machine = env->base + env->header->machine_offset + i * env->header->machine_stride;
+
+    return &((const Chip8*)machine)->display[0][0];
+}
+
+int c8_env_fd(const C8Env* env)
+{
+    return env->fd;
+}
+
+const C8EnvHeader* c8_env_header(const C8Env* env)
+{
+    return env->header;
+}
+
+size_t c8_env_size(const C8Env* env)
+{
+    return env->size;
+}
+
+void c8_env_set_hooks(C8Env* env, const C8EnvHooks* hooks)
+{
+    if(hooks == NULL)
+    {
+        memset(&env->hooks, 0, sizeof(env->hooks));
+        return;
+    }
+
+    env->hooks = *hooks;
+
+    /* The running episodes get their reset call too */
+    for(size_t i = 0; env->hooks.reset != NULL && i < env->header->envs; i++)
+    {
+        env->hooks.reset(i, c8_env_machine(env, i), env->hooks.user);
+    }
+}
+
+/* This function maps a new segment of _size_ bytes, returns 0 on success */
+static int env_map(C8Env* env, const char* shm_name, size_t size)
+{
+    if(shm_name != NULL)
+    {
+        env->fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        env->shm_name = (env->fd >= 0) ? strdup(shm_name) : NULL;
+    }
+    else
+    {
+        env->fd = memfd_create("chip8-env", 0);
+    }
+
+    if(env->fd < 0 || ftruncate(env->fd, (off_t)size) != 0)
+    {
+        return 1;
+    }
+
+    env->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, env->fd, 0);
+    if(env->base == MAP_FAILED)
+    {
+        env->base = NULL;
+        return 1;
+    }
+
+    env->size = size;
+
+    return 0;
+}
+
+C8Env* c8_env_create(const UBIT8* rom, size_t size, size_t envs, const char* shm_name, const C8EnvOptions* options)
+{
+    C8Env* env = NULL;
+    size_t results = sizeof(C8EnvHeader) + envs * sizeof(C8EnvResult);
+    size_t machine_offset = (results + C8_ENV_PAGE - 1) / C8_ENV_PAGE * C8_ENV_PAGE;
+    size_t machine_stride = (sizeof(Chip8) + 63) / 64 * 64; /* Machines do not share cache lines */
+    C8EnvHeader* h = NULL;
+
+    if(envs == 0 || size > C8_PROGRAM_SIZE)
+    {
+        return NULL;
+    }
+
+    env = calloc(1, sizeof(C8Env));
+    if(env == NULL)
+    {
+        return NULL;
+    }
+
+    env->fd = -1;
+    env->rom = malloc(size);
+    env->rom_size = size;
+
+    if(env->rom == NULL || env_map(env, shm_name, machine_offset + envs * machine_stride) != 0)
+    {
+        c8_env_free(env);
+        return NULL;
+    }
+
+    memcpy(env->rom, rom, size);
+
+    if(options != NULL)
+    {
+        env->options = *options;
+    }
+    else
+    {
+        env->options.engine = C8_ENGINE_PREDECODED;
+    }
+
+    if(env->options.ipf == 0)
+    {
+        env->options.ipf = C8_DEFAULT_IPF;
+    }
+
+    h = (C8EnvHeader*)env->base;
+    h->magic = C8_ENV_MAGIC;
+    h->version = C8_ENV_VERSION;
+    h->envs = (UBIT32)envs;
+    h->header_size = sizeof(C8EnvHeader);
+    h->result_offset = sizeof(C8EnvHeader);
+    h->result_stride = sizeof(C8EnvResult);
+    h->machine_offset = (UBIT32)machine_offset;
+    h->machine_stride = (UBIT32)machine_stride;
+    h->display_offset = offsetof(Chip8, display);
+    h->hires_offset = offsetof(Chip8, hires);
+    h->planes = C8_PLANES;
+    h->plane_words = C8_PLANE_WORDS;
+    atomic_init(&h->steps, 0);
+
+    env->header = h;
+    env->results = (C8EnvResult*)(env->base + h->result_offset);
+
+    for(size_t i = 0; i < envs; i++)
+    {
+        c8_init(c8_env_machine(env, i));
+    }
+
+    c8_env_reset_all(env, 0);
+
+    return env;
+}
+
+void c8_env_free(C8Env* env)
+{
+    if(env == NULL)
+    {
+        return;
+    }
+
+    if(env->base != NULL)
+    {
+        for(size_t i = 0; i < env->header->envs; i++)
+        {
+            c8_deinit(c8_env_machine(env, i));
+        }
+
+        munmap(env->base, env->size);
+    }
+
+    if(env->fd >= 0)
+    {
+        close(env->fd);
+    }
+
+    if(env->shm_name != NULL)
+    {
+        shm_unlink(env->shm_name);
+        free(env->shm_name);
+    }
+
+    free(env->rom);
+    free(env);
+}
+
+void c8_env_reset(C8Env* env, size_t i, UBIT64 seed)
+{
+    Chip8* chip8 = c8_env_machine(env, i);
+    C8EnvResult* r = &env->results[i];
+
+    c8_deinit(chip8);
+    c8_init(chip8);
+    chip8->engine = env->options.engine;
+    c8_set_quirks(chip8, env->options.quirks);
+    c8_load_program(chip8, env->rom, env->rom_size);
+    c8_seed(chip8, seed);
+
+    r->reward = 0;
+    r->done = 0;
+    r->truncated = 0;
+    r->action = 0;
+    r->frames = 0;
+    r->episode++;
+    r->seed = seed;
+
+    if(env->hooks.reset != NULL)
+    {
+        env->hooks.reset(i, chip8, env->hooks.user);
+    }
+}
+
+void c8_env_reset_all(C8Env* env, UBIT64 seed)
+{
+    for(size_t i = 0; i < env->header->envs; i++)
+    {
+        c8_env_reset(env, i, seed + i);
+    }
+}
+
+/* This function tells whether the program halted: it sits on 00FD (EXIT) */
+/* or on a jump to itself, which nothing can break out of                  */
+static STD_BOOL env_halted(const Chip8* chip8)
+{
+    UBIT16 opcode = 0;
+
+    if(chip8->waiting_key == STD_TRUE || chip8->pc > C8_MEM_SIZE - 2)
+    {
+        return STD_FALSE;
+    }
+
+    opcode = (chip8->memory[chip8->pc] << 8) | chip8->memory[chip8->pc + 1];
+
+    return (opcode == 0x00FD || opcode == (0x1000 | chip8->pc)) ? STD_TRUE : STD_FALSE;
+}
+
+const C8EnvResult* c8_env_step(C8Env* env, size_t i, UBIT16 action, unsigned frameskip)
+{
+    Chip8* chip8 = c8_env_machine(env, i);
+    C8EnvResult* r = &env->results[i];
+    STD_BOOL done = STD_FALSE;
+
+    /* Only the keys that changed generate events, a press resumes FX0A */
+    for(UBIT8 k = 0; k < KEYBOARD_SIZE * KEYBOARD_SIZE; k++)
+    {
+        if(((r->action ^ action) >> k) & 1)
+        {
+            c8_key_event(chip8, k, ((action >> k) & 1) ? STD_TRUE : STD_FALSE);
+        }
+    }
+
+    r->action = action;
+    r->reward = 0;
+    r->done = 0;
+    r->truncated = 0;
+
+    for(unsigned f = 0; f < ((frameskip > 0) ? frameskip : 1); f++)
+    {
+        c8_run_frame(chip8, env->options.ipf);
+        r->frames++;
+
+        if(env->hooks.reward != NULL)
+        {
+            r->reward += env->hooks.reward(i, chip8, env->hooks.user, &done);
+        }
+
+        if(done == STD_FALSE)
+        {
+            done = env_halted(chip8);
+        }
+
+        if(done == STD_TRUE)
+        {
+            r->done = 1;
+            break;
+        }
+
+        if(env->options.max_frames != 0 && r->frames >= env->options.max_frames)
+        {
+            r->truncated = 1;
+            break;
+        }
+    }
+
+    return r;
+}
+
+void c8_env_step_all(C8Env* env, const UBIT16* actions, unsigned frameskip)
+{
+    size_t envs = env->header->envs;
+
+    for(size_t i = 0; i < envs; i++)
+    {
+        const C8EnvResult* r = c8_env_step(env, i, actions[i], frameskip);
+
+        if(env->options.autoreset == STD_TRUE && (r->done || r->truncated))
+        {
+            C8EnvResult last = *r;
+
+            c8_env_reset(env, i, r->seed + envs);
+
+            /* Report the episode that ended, observe the one that starts */
+            env->results[i].reward = last.reward;
+            env->results[i].done = last.done;
+            env->results[i].truncated = last.truncated;
+        }
+    }
+
+    atomic_fetch_add_explicit(&env->header->steps, 1, memory_order_release);
+}
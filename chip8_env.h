@@ -0,0 +1,130 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* Training environments                                                */
+/*                                                                      */
+/* A Gym-style API over one or many machines running the same ROM:      */
+/* reset an environment with a seed, step it with the keys held for    */
+/* _frameskip_ frames, read back the reward, the done flag and the      */
+/* observation. The machines themselves live in a shared memory segment */
+/* (a memfd, or a named POSIX segment), so the observation is the       */
+/* packed display the interpreter draws into: another process maps the  */
+/* segment and reads frames without any copy or serialization.          */
+/*                                                                      */
+/* Segment layout: a C8EnvHeader, the C8EnvResult of every environment  */
+/* and, from _machine_offset_ (page aligned), one Chip8 every           */
+/* _machine_stride_ bytes. Environment i is displayed at               */
+/* machine_offset + i * machine_stride + display_offset: C8_PLANES      */
+/* planes of C8_PLANE_WORDS words, rows of one word (64x32) or two      */
+/* words (128x64, the byte at _hires_offset_ is set), MSB is x = 0.     */
+/* _steps_ is incremented once every environment has stepped.           */
+
+#define C8_ENV_MAGIC   0x56453843u /* "C8EV" */
+#define C8_ENV_VERSION 1
+
+typedef struct
+{
+    UBIT32 magic;          /* C8_ENV_MAGIC */
+    UBIT32 version;        /* C8_ENV_VERSION */
+    UBIT32 envs;           /* Environments */
+    UBIT32 header_size;    /* sizeof(C8EnvHeader) */
+    UBIT32 result_offset;  /* First C8EnvResult */
+    UBIT32 result_stride;  /* sizeof(C8EnvResult) */
+    UBIT32 machine_offset; /* First machine */
+    UBIT32 machine_stride; /* Bytes between machines */
+    UBIT32 display_offset; /* Display of a machine, from its start */
+    UBIT32 hires_offset;   /* High resolution flag of a machine, from its start */
+    UBIT32 planes;         /* C8_PLANES */
+    UBIT32 plane_words;    /* C8_PLANE_WORDS */
+    _Atomic UBIT64 steps;  /* c8_env_step_all calls, bumped after the results are written */
+} C8EnvHeader;
+
+typedef struct
+{
+    float  reward;    /* Reward of the last step, summed over its frames */
+    UBIT8  done;      /* The episode ended: reward hook, or the program halted */
+    UBIT8  truncated; /* The episode ran _max_frames_ frames */
+    UBIT16 action;    /* Keys held during the last step, bit k is key k */
+    UBIT32 frames;    /* Frames emulated in the episode */
+    UBIT32 episode;   /* Episodes started */
+    UBIT64 seed;      /* Seed of the episode */
+} C8EnvResult;
+
+typedef struct
+{
+    C8_ENGINE     engine;     /* Engine of every machine */
+    unsigned long ipf;        /* Instructions per frame, 0 = C8_DEFAULT_IPF */
+    UBIT32        max_frames; /* Episode length limit, 0 = none */
+    STD_BOOL      autoreset;  /* c8_env_step_all restarts finished episodes */
+    UBIT8         quirks;     /* C8_QUIRK_* set the ROM expects */
+} C8EnvOptions;
+
+typedef struct
+{
+    /* Called after every frame of environment _env_: returns the reward */
+    /* of the frame and sets *done when the episode is over              */
+    float (*reward)(size_t env, const Chip8* chip8, void* user, STD_BOOL* done);
+
+    /* Called after environment _env_ is reset, e.g. to read the starting score */
+    void (*reset)(size_t env, const Chip8* chip8, void* user);
+
+    void* user;
+} C8EnvHooks;
+
+typedef struct C8Env C8Env;
+
+/* This function creates _envs_ environments running a copy of _rom_ in a   */
+/* shared segment: the POSIX shared memory object _shm_name_ (e.g. "/c8env", */
+/* removed by c8_env_free), or an anonymous memfd when NULL. _options_ may  */
+/* be NULL for the defaults. Every environment starts reset with seed i.    */
+/* Returns NULL on failure.                                                  */
+C8Env* c8_env_create(const UBIT8* rom, size_t size, size_t envs, const char* shm_name, const C8EnvOptions* options);
+
+/* This function releases the environments and the segment */
+void c8_env_free(C8Env* env);
+
+/* This function installs the reward and reset hooks (NULL removes them), */
+/* the reset hook is called right away for the running episodes           */
+void c8_env_set_hooks(C8Env* env, const C8EnvHooks* hooks);
+
+/* This function returns the descriptor of the segment, for mmap or for */
+/* another process (/proc/<pid>/fd/<fd> or SCM_RIGHTS)                   */
+int c8_env_fd(const C8Env* env);
+
+/* This function returns the mapped segment, starting with its header */
+const C8EnvHeader* c8_env_header(const C8Env* env);
+
+/* This function returns the segment size in bytes */
+size_t c8_env_size(const C8Env* env);
+
+/* This function returns the machine of environment _i_ */
+Chip8* c8_env_machine(C8Env* env, size_t i);
+
+/* This function returns the observation of environment _i_: the display */
+/* planes of its machine, inside the segment                              */
+const UBIT64* c8_env_observation(const C8Env* env, size_t i);
+
+/* This function starts a new episode of environment _i_ from a fresh */
+/* machine seeded with _seed_                                          */
+void c8_env_reset(C8Env* env, size_t i, UBIT64 seed);
+
+/* This function resets every environment, environment i with _seed_ + i */
+void c8_env_reset_all(C8Env* env, UBIT64 seed);
+
+/* This function holds the keys of _action_ (bit k is key k) on environment */
+/* _i_ and runs _frameskip_ frames (at least one), stopping early when the  */
+/* episode ends. Returns the result, which is also in the segment.          */
+const C8EnvResult* c8_env_step(C8Env* env, size_t i, UBIT16 action, unsigned frameskip);
+
+/* This function steps every environment, environment i with _actions_[i].  */
+/* With _autoreset_, a finished episode restarts right away (seed + envs);  */
+/* its result keeps the done flags and the observation is the new episode. */
+/* _steps_ is bumped in the header afterwards.                              */
+void c8_env_step_all(C8Env* env, const UBIT16* actions, unsigned frameskip);
+
+#endif /* CHIP8_ENV_H */
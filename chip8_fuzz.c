@@ -0,0 +1,907 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8_debug.h"
+#include "chip8_engine.h"
+#include "chip8_fuzz.h"
+#include "chip8_state.h"
+
+/* ---- Differential fuzzer ---- */
+
+#define C8_FUZZ_SLICE   64 /* Longest candidate slice, in cycles */
+#define C8_FUZZ_PASSES  4  /* Shrinking passes over a failing case */
+#define C8_FUZZ_CLOCK   64 /* Cases between two looks at the clock */
+
+/* Registers of the reference after a given number of steps */
+typedef struct
+{
+    UBIT16 pc;
+    UBIT16 sp;
+    UBIT16 index;
+    UBIT8  registers[16];
+} c8_fuzz_point;
+
+typedef struct
+{
+    C8Fuzz*         fuzz;
+    pthread_mutex_t lock;
+    _Atomic int     stop;     /* A divergence was found, or the time is up */
+    UBIT64          deadline; /* CLOCK_MONOTONIC ns, 0 = none */
+} c8_fuzz_pool;
+
+typedef struct
+{
+    c8_fuzz_pool*  pool;
+    int            id;
+    int            threads;
+    Chip8*         setup;  /* Turns a case into a state, never runs */
+    Chip8*         ref;
+    Chip8*         cand;
+    UBIT8*         init;   /* Initial state of the current case */
+    UBIT8*         a;      /* Reference and candidate states being compared */
+    UBIT8*         b;
+    c8_fuzz_point* trace;  /* Reference registers after each step */
+    unsigned long  ran;
+    unsigned long  executed;
+} c8_fuzz_worker;
+
+static UBIT64 fuzz_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UBIT64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* This function returns the next number of a xorshift64* generator */
+static UBIT64 fuzz_next(UBIT64* s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+
+    return *s * 2685821657736338717ull;
+}
+
+/* This function returns a number in [0, n) */
+static UBIT32 fuzz_below(UBIT64* s, UBIT32 n)
+{
+    return (UBIT32)(((fuzz_next(s) >> 32) * n) >> 32);
+}
+
+/* This function returns a byte, a small one half of the time so comparisons hit */
+static UBIT8 fuzz_byte(UBIT64* s)
+{
+    return fuzz_below(s, 2) ? fuzz_below(s, 16) : (UBIT8)(fuzz_next(s) >> 56);
+}
+
+/* This function returns the address of one of the first _length_ + 1 instructions */
+static UBIT16 fuzz_target(UBIT64* s, UBIT8 length)
+{
+    return C8_PROGRAM_START + 2 * fuzz_below(s, length + 1);
+}
+
+/* This function returns an address for I: the data, the program itself (self- */
+/* modifying code), the fonts or anywhere in the 12-bit space                  */
+static UBIT16 fuzz_address(UBIT64* s, UBIT8 length)
+{
+    switch(fuzz_below(s, 4))
+    {
+    case 0:
+        return C8_FUZZ_DATA_START + fuzz_below(s, C8_FUZZ_DATA);
+    case 1:
+        return fuzz_target(s, length);
+    case 2:
+        return fuzz_below(s, C8_PROGRAM_START);
+    default:
+        return fuzz_below(s, C8_MEM_SIZE);
+    }
+}
+
+/* This function draws a random instruction */
+static UBIT16 fuzz_opcode(UBIT64* s, UBIT8 length)
+{
+    static const UBIT16 sys[] = { 0x00E0, 0x00EE, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF };
+    static const UBIT8 regs[] = { 0x0, 0x2, 0x3 }; /* 5xy0, 5xy2, 5xy3 */
+    static const UBIT8 alu[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+    static const UBIT8 misc[] = { 0x00, 0x01, 0x02, 0x07, 0x0A, 0x15, 0x18, 0x1E,
+                                  0x29, 0x30, 0x33, 0x3A, 0x55, 0x65, 0x75, 0x85 };
+    UBIT16 x = fuzz_below(s, 16) << 8;
+    UBIT16 y = fuzz_below(s, 16) << 4;
+    UBIT16 kk = fuzz_byte(s);
+
+    switch(fuzz_below(s, 16))
+    {
+    case 0x0:
+        switch(fuzz_below(s, 4))
+        {
+        case 0:
+            return 0x00C0 | (1 + fuzz_below(s, 15));         /* 00Cn scroll down */
+        case 1:
+            return 0x00D0 | fuzz_below(s, 16);               /* 00Dn scroll up */
+        case 2:
+            return fuzz_below(s, C8_MEM_SIZE);               /* 0nnn, mostly SYS */
+        default:
+            return sys[fuzz_below(s, sizeof(sys) / sizeof(sys[0]))];
+        }
+    case 0x1:
+        return 0x1000 | fuzz_target(s, length);
+    case 0x2:
+        return 0x2000 | fuzz_target(s, length);
+    case 0x3:
+        return 0x3000 | x | kk;
+    case 0x4:
+        return 0x4000 | x | kk;
+    case 0x5:
+        return 0x5000 | x | y | regs[fuzz_below(s, sizeof(regs))];
+    case 0x6:
+        return 0x6000 | x | kk;
+    case 0x7:
+        return 0x7000 | x | kk;
+    case 0x8:
+        return 0x8000 | x | y | alu[fuzz_below(s, sizeof(alu))];
+    case 0x9:
+        return 0x9000 | x | y;
+    case 0xA:
+        return 0xA000 | fuzz_address(s, length);
+    case 0xB:
+        return 0xB000 | fuzz_target(s, length);
+    case 0xC:
+        return 0xC000 | x | kk;
+    case 0xD:
+        return 0xD000 | x | y | fuzz_below(s, 16);
+    case 0xE:
+        return 0xE000 | x | (fuzz_below(s, 2) ? 0x9E : 0xA1);
+    default:
+        kk = misc[fuzz_below(s, sizeof(misc))];
+        /* F000 and F002 only exist with x = 0 */
+        return 0xF000 | ((kk == 0x00 || kk == 0x02) ? 0 : x) | kk;
+    }
+}
+
+void c8_fuzz_generate(C8FuzzCase* input, UBIT64 seed)
+{
+    /* SplitMix64 spreads consecutive seeds, xorshift64* must not start at 0 */
+    UBIT64 s = (seed + 0x9E3779B97F4A7C15ull);
+
+    s = (s ^ (s >> 30)) * 0xBF58476D1CE4E5B9ull;
+    s = (s ^ (s >> 27)) * 0x94D049BB133111EBull;
+    s = (s ^ (s >> 31)) | 1;
+
+    memset(input, 0, sizeof(C8FuzzCase));
+    input->seed = seed;
+    input->length = 1 + fuzz_below(&s, C8_FUZZ_WORDS - 1);
+
+    for(int i = 0; i < input->length; i++)
+    {
+        input->program[i] = fuzz_opcode(&s, input->length);
+
+        /* F000 nnnn: the next word is the address, anywhere in memory */
+        if(input->program[i] == 0xF000 && i + 1 < input->length)
+        {
+            input->program[++i] = fuzz_below(&s, 2) ? fuzz_address(&s, input->length) : (UBIT16)fuzz_next(&s);
+        }
+    }
+
+    for(int i = 0; i < C8_FUZZ_DATA; i++)
+    {
+        input->data[i] = (UBIT8)(fuzz_next(&s) >> 56);
+    }
+
+    for(int i = 0; i < 16; i++)
+    {
+        input->registers[i] = fuzz_byte(&s);
+        input->keys |= (fuzz_below(&s, 8) == 0) ? (1u << i) : 0;
+    }
+
+    /* A few return addresses, as if the program had been called into */
+    input->sp = fuzz_below(&s, 4);
+    for(UBIT16 i = 0; i < input->sp; i++)
+    {
+        input->stack[i] = fuzz_target(&s, input->length);
+    }
+
+    input->index = fuzz_address(&s, input->length);
+    input->delay_timer = fuzz_below(&s, 4) ? 0 : fuzz_byte(&s);
+    input->sound_timer = fuzz_below(&s, 4) ? 0 : fuzz_byte(&s);
+    input->hires = (fuzz_below(&s, 4) == 0) ? 1 : 0;
+    input->planes = (fuzz_below(&s, 4) == 0) ? fuzz_below(&s, 4) : 0x1;
+    input->display = (fuzz_below(&s, 4) == 0) ? STD_TRUE : STD_FALSE;
+    input->rng = fuzz_next(&s) | 1;
+    input->slices = fuzz_next(&s) | 1;
+    input->ipf = fuzz_below(&s, 4) ? 1 + fuzz_below(&s, 20) : 0;
+    input->quirks = fuzz_below(&s, 2) ? 0 : fuzz_below(&s, C8_QUIRK_SETS);
+
+    /* Some programs wait on the delay timer like games do: FX07 / 3xkk or 4xkk / 1nnn */
+    if(input->length >= 3 && fuzz_below(&s, 8) == 0)
+    {
+        int at = fuzz_below(&s, input->length - 2);
+        UBIT16 x = fuzz_below(&s, 16) << 8;
+        UBIT16 kk = fuzz_below(&s, 2) ? 0 : fuzz_byte(&s);
+
+        input->program[at] = 0xF007 | x;
+        input->program[at + 1] = (fuzz_below(&s, 2) ? 0x3000 : 0x4000) | x | kk;
+        input->program[at + 2] = 0x1000 | (C8_PROGRAM_START + 2 * at);
+    }
+}
+
+/* This function loads a case into a machine fresh from c8_init */
+static void fuzz_setup(Chip8* chip8, const C8FuzzCase* input)
+{
+    UBIT64 s = input->rng;
+
+    for(int i = 0; i < C8_FUZZ_WORDS; i++)
+    {
+        UBIT16 op = (i == input->length) ? (0x1000 | C8_PROGRAM_START) : input->program[i];
+
+        chip8->memory[C8_PROGRAM_START + 2 * i] = op >> 8;
+        chip8->memory[C8_PROGRAM_START + 2 * i + 1] = op & 0xFF;
+    }
+
+    memcpy(&chip8->memory[C8_FUZZ_DATA_START], input->data, C8_FUZZ_DATA);
+    memcpy(chip8->registers, input->registers, sizeof(chip8->registers));
+    memcpy(chip8->stack, input->stack, sizeof(chip8->stack));
+
+    chip8->pc = C8_PROGRAM_START;
+    chip8->sp = input->sp;
+    chip8->index = input->index;
+    chip8->delay_timer = input->delay_timer;
+    chip8->sound_timer = input->sound_timer;
+    chip8->waiting_key = STD_FALSE;
+    chip8->key_register = 0;
+    chip8->hires = input->hires;
+    chip8->planes = input->planes;
+    chip8->rng = input->rng;
+    chip8->frame = 0;
+    chip8->clock = 0;
+
+    /* The state carries them to both engines */
+    c8_set_quirks(chip8, input->quirks);
+
+    for(int i = 0; i < KEYBOARD_SIZE * KEYBOARD_SIZE; i++)
+    {
+        chip8->keyboard[i] = (input->keys >> i) & 1;
+    }
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        for(int i = 0; i < C8_PLANE_WORDS; i++)
+        {
+            chip8->display[p][i] = (input->display == STD_TRUE) ? fuzz_next(&s) : 0;
+        }
+    }
+}
+
+/* This function tells whether the next instruction is defined on every engine: */
+/* in the instruction caches and not trapped by the sandbox                      */
+static int fuzz_safe(const Chip8* chip8)
+{
+    UBIT16 op = 0;
+
+    /* F000 reads two words, the instruction caches end at C8_MEM_SIZE */
+    if(chip8->pc > C8_MEM_SIZE - 4)
+    {
+        return 0;
+    }
+
+    op = (chip8->memory[chip8->pc] << 8) | chip8->memory[chip8->pc + 1];
+
+    return c8_sandbox_check(chip8, op) == C8_FAULT_NONE;
+}
+
+static void fuzz_point(c8_fuzz_point* p, const Chip8* chip8)
+{
+    p->pc = chip8->pc;
+    p->sp = chip8->sp;
+    p->index = chip8->index;
+    memcpy(p->registers, chip8->registers, sizeof(p->registers));
+}
+
+static int fuzz_point_same(const c8_fuzz_point* p, const Chip8* chip8)
+{
+    return p->pc == chip8->pc && p->sp == chip8->sp && p->index == chip8->index
+        && memcmp(p->registers, chip8->registers, sizeof(p->registers)) == 0;
+}
+
+/* This function steps the reference through the case while the next instruction */
+/* is defined, recording its registers when _trace_ is set. Returns the steps.  */
+static unsigned long fuzz_reference(c8_fuzz_worker* w, const C8FuzzCase* input, c8_fuzz_point* trace)
+{
+    unsigned long n = 0;
+
+    c8_state_load(w->ref, w->init, C8_STATE_SIZE);
+
+    for(n = 0; n < w->pool->fuzz->cycles; n++)
+    {
+        if(trace != NULL)
+        {
+            fuzz_point(&trace[n], w->ref);
+        }
+
+        if(!fuzz_safe(w->ref))
+        {
+            return n;
+        }
+
+        c8_run_clocked(w->ref, 1, input->ipf);
+    }
+
+    if(trace != NULL)
+    {
+        fuzz_point(&trace[n], w->ref);
+    }
+
+    return n;
+}
+
+/* This function runs the candidate for _cycles_ cycles in the case's slices. With */
+/* _trace_ it returns the cycles at the end of the first slice that disagrees with */
+/* the reference, 0 when none does.                                                */
+static unsigned long fuzz_candidate(c8_fuzz_worker* w, const C8FuzzCase* input, unsigned long cycles, const c8_fuzz_point* trace)
+{
+    UBIT64 s = input->slices;
+    unsigned long done = 0;
+
+    c8_state_load(w->cand, w->init, C8_STATE_SIZE);
+
+    while(done < cycles)
+    {
+        unsigned long slice = 1 + fuzz_below(&s, C8_FUZZ_SLICE);
+
+        if(slice > cycles - done)
+        {
+            slice = cycles - done;
+        }
+
+        c8_run_clocked(w->cand, slice, input->ipf);
+        done += slice;
+
+        if(trace != NULL && !fuzz_point_same(&trace[done], w->cand))
+        {
+            return done;
+        }
+    }
+
+    return 0;
+}
+
+/* This function compares the whole reference and candidate machines */
+static int fuzz_differs(c8_fuzz_worker* w)
+{
+    /* The opcode latch is bookkeeping of the switch interpreter, the */
+    /* other engines decode ahead and leave it stale                  */
+    w->ref->opcode = 0;
+    w->cand->opcode = 0;
+
+    c8_state_save(w->ref, w->a);
+    c8_state_save(w->cand, w->b);
+
+    return memcmp(w->a, w->b, C8_STATE_SIZE) != 0;
+}
+
+/* This function runs both engines _cycles_ cycles from the initial state and compares them */
+static int fuzz_diverges_at(c8_fuzz_worker* w, const C8FuzzCase* input, unsigned long cycles)
+{
+    c8_state_load(w->ref, w->init, C8_STATE_SIZE);
+    c8_run_clocked(w->ref, cycles, input->ipf);
+    fuzz_candidate(w, input, cycles, NULL);
+
+    return fuzz_differs(w);
+}
+
+/* This function returns the fault the sandbox raises on the next instruction */
+static C8_FAULT fuzz_fault(const Chip8* chip8)
+{
+    if(chip8->pc > C8_RAM_SIZE - 4)
+    {
+        return C8_FAULT_PC;
+    }
+
+    return c8_sandbox_check(chip8, (chip8->memory[chip8->pc] << 8) | chip8->memory[chip8->pc + 1]);
+}
+
+/* This function runs one more cycle on a sandbox candidate that agreed with the */
+/* reference up to its stop, returns 1 when it does not trap the same fault     */
+static int fuzz_traps_differ(c8_fuzz_worker* w, const C8FuzzCase* input)
+{
+    C8_FAULT expected = C8_FAULT_NONE;
+
+    /* Parked on FX0A, neither machine runs the next instruction */
+    if(w->ref->waiting_key == STD_TRUE)
+    {
+        return 0;
+    }
+
+    expected = fuzz_fault(w->ref);
+
+    /* The reference also stops at the end of the instruction caches, which is defined */
+    if(expected == C8_FAULT_NONE)
+    {
+        return 0;
+    }
+
+    c8_run_clocked(w->cand, 1, input->ipf);
+
+    return w->cand->fault.kind != expected || w->cand->fault.pc != w->ref->pc || w->cand->pc != w->ref->pc;
+}
+
+/* This function runs a case on both engines, returns the number of instructions */
+/* up to and including the first diverging one, 0 when the engines agree         */
+static unsigned long fuzz_check(c8_fuzz_worker* w, const C8FuzzCase* input)
+{
+    unsigned long total = 0;
+    unsigned long good = 0;
+    unsigned long bad = 0;
+
+    fuzz_setup(w->setup, input);
+    c8_state_save(w->setup, w->init);
+
+    total = fuzz_reference(w, input, w->trace);
+    w->executed += total;
+
+    bad = fuzz_candidate(w, input, total, w->trace);
+    if(bad == 0)
+    {
+        /* Registers agreed all along: compare memory and display once */
+        if(!fuzz_differs(w))
+        {
+            if(w->cand->engine == C8_ENGINE_SANDBOX && total < w->pool->fuzz->cycles
+                && fuzz_traps_differ(w, input))
+            {
+                return total + 1;
+            }
+
+            return 0;
+        }
+
+        bad = total;
+    }
+
+    /* Bisect: the engines agree after _good_ cycles and disagree after _bad_ */
+    while(bad - good > 1)
+    {
+        unsigned long mid = good + (bad - good) / 2;
+
+        if(fuzz_diverges_at(w, input, mid))
+            bad = mid;
+        else
+            good = mid;
+    }
+
+    return bad;
+}
+
+/* This function applies the _m_-th simplification to a case, returns 0 past the last one */
+static int fuzz_mutate(C8FuzzCase* input, int m)
+{
+    /* Shorter programs first, then blank instructions, registers and data */
+    if(m < C8_FUZZ_WORDS)
+    {
+        if(m < input->length)
+            input->length = m;
+        return 1;
+    }
+    m -= C8_FUZZ_WORDS;
+
+    if(m < C8_FUZZ_WORDS)
+    {
+        input->program[m] = 0x0000;
+        return 1;
+    }
+    m -= C8_FUZZ_WORDS;
+
+    if(m < 16)
+    {
+        input->registers[m] = 0;
+        return 1;
+    }
+    m -= 16;
+
+    switch(m)
+    {
+    case 0: input->index = 0; return 1;
+    case 1: input->sp = 0; return 1;
+    case 2: input->delay_timer = 0; return 1;
+    case 3: input->sound_timer = 0; return 1;
+    case 4: input->keys = 0; return 1;
+    case 5: input->hires = 0; return 1;
+    case 6: input->planes = 0x1; return 1;
+    case 7: input->display = STD_FALSE; return 1;
+    case 8: input->ipf = 0; return 1;
+    case 9: input->quirks = 0; return 1;
+    default: break;
+    }
+    m -= 10;
+
+    if(m < C8_FUZZ_DATA)
+    {
+        input->data[m] = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* This function shrinks a diverging case while it keeps diverging, returns the */
+/* diverging step of the shrunk case                                            */
+static unsigned long fuzz_shrink(c8_fuzz_worker* w, C8FuzzCase* input, unsigned long step)
+{
+    C8FuzzCase trial;
+    int changed = 1;
+
+    for(int pass = 0; pass < C8_FUZZ_PASSES && changed; pass++)
+    {
+        changed = 0;
+
+        for(int m = 0; ; m++)
+        {
+            unsigned long n = 0;
+
+            trial = *input;
+            if(!fuzz_mutate(&trial, m))
+            {
+                break;
+            }
+
+            if(memcmp(&trial, input, sizeof(C8FuzzCase)) == 0)
+            {
+                continue;
+            }
+
+            n = fuzz_check(w, &trial);
+            if(n != 0)
+            {
+                *input = trial;
+                step = n;
+                changed = 1;
+            }
+        }
+    }
+
+    return step;
+}
+
+/* This function appends "name ref/cand" to the description when the values differ */
+static void fuzz_field(char* out, size_t len, const char* name, UBIT64 ref, UBIT64 cand)
+{
+    size_t used = strlen(out);
+
+    if(ref == cand || used + 1 >= len)
+    {
+        return;
+    }
+
+    snprintf(out + used, len - used, "%s%s %llx/%llx", (used > 0) ? ", " : "", name,
+             (unsigned long long)ref, (unsigned long long)cand);
+}
+
+/* This function describes how the candidate differs from the reference */
+static void fuzz_diff(const Chip8* ref, const Chip8* cand, char* out, size_t len)
+{
+    char name[32];
+
+    out[0] = '\0';
+
+    fuzz_field(out, len, "pc", ref->pc, cand->pc);
+    fuzz_field(out, len, "sp", ref->sp, cand->sp);
+    fuzz_field(out, len, "I", ref->index, cand->index);
+    fuzz_field(out, len, "DT", ref->delay_timer, cand->delay_timer);
+    fuzz_field(out, len, "ST", ref->sound_timer, cand->sound_timer);
+
+    for(int i = 0; i < 16; i++)
+    {
+        snprintf(name, sizeof(name), "V%X", i);
+        fuzz_field(out, len, name, ref->registers[i], cand->registers[i]);
+        snprintf(name, sizeof(name), "stack[%d]", i);
+        fuzz_field(out, len, name, ref->stack[i], cand->stack[i]);
+    }
+
+    for(int i = 0; i < C8_RAM_SIZE; i++)
+    {
+        if(ref->memory[i] != cand->memory[i])
+        {
+            snprintf(name, sizeof(name), "memory[%04x]", i);
+            fuzz_field(out, len, name, ref->memory[i], cand->memory[i]);
+            break;
+        }
+    }
+
+    for(int p = 0; p < C8_PLANES; p++)
+    {
+        for(int i = 0; i < C8_PLANE_WORDS; i++)
+        {
+            if(ref->display[p][i] != cand->display[p][i])
+            {
+                snprintf(name, sizeof(name), "display[%d][%d]", p, i);
+                fuzz_field(out, len, name, ref->display[p][i], cand->display[p][i]);
+                p = C8_PLANES;
+                break;
+            }
+        }
+    }
+
+    fuzz_field(out, len, "hires", ref->hires, cand->hires);
+    fuzz_field(out, len, "planes", ref->planes, cand->planes);
+    fuzz_field(out, len, "waiting_key", ref->waiting_key, cand->waiting_key);
+    fuzz_field(out, len, "rng", ref->rng, cand->rng);
+    fuzz_field(out, len, "frame", ref->frame, cand->frame);
+    fuzz_field(out, len, "clock", ref->clock, cand->clock);
+    fuzz_field(out, len, "pitch", ref->pitch, cand->pitch);
+    fuzz_field(out, len, "xo_audio", ref->xo_audio, cand->xo_audio);
+
+    if(memcmp(ref->flags, cand->flags, sizeof(ref->flags)) != 0)
+        fuzz_field(out, len, "flags", 0, 1);
+    if(memcmp(ref->pattern, cand->pattern, sizeof(ref->pattern)) != 0)
+        fuzz_field(out, len, "pattern", 0, 1);
+}
+
+/* This function fills the failure record of a diverging case */
+static void fuzz_report(c8_fuzz_worker* w, const C8FuzzCase* input, unsigned long step, C8FuzzFailure* failure)
+{
+    Chip8* ref = w->ref;
+    unsigned long total = 0;
+
+    failure->input = *input;
+    failure->step = step;
+
+    fuzz_setup(w->setup, input);
+    c8_state_save(w->setup, w->init);
+    total = fuzz_reference(w, input, NULL);
+
+    /* The instruction the reference runs last */
+    c8_state_load(ref, w->init, C8_STATE_SIZE);
+    c8_run_clocked(ref, step - 1, input->ipf);
+    failure->pc = ref->pc;
+    failure->opcode = (ref->memory[ref->pc] << 8) | ref->memory[ref->pc + 1];
+
+    /* Past the stop of the reference: the sandbox did not trap the instruction */
+    if(step > total)
+    {
+        fuzz_candidate(w, input, step, NULL);
+        snprintf(failure->diff, sizeof(failure->diff), "fault %s/%s, pc %x/%x",
+                 c8_fault_name(fuzz_fault(ref)), c8_fault_name(w->cand->fault.kind), ref->pc, w->cand->pc);
+        return;
+    }
+
+    c8_run_clocked(ref, 1, input->ipf);
+    fuzz_candidate(w, input, step, NULL);
+    fuzz_diff(ref, w->cand, failure->diff, sizeof(failure->diff));
+}
+
+static void* fuzz_thread(void* arg)
+{
+    c8_fuzz_worker* w = arg;
+    c8_fuzz_pool* pool = w->pool;
+    C8Fuzz* fuzz = pool->fuzz;
+    C8FuzzCase input;
+    C8FuzzFailure failure;
+
+    for(unsigned long i = w->id; atomic_load_explicit(&pool->stop, memory_order_relaxed) == 0; i += w->threads)
+    {
+        unsigned long step = 0;
+
+        if(fuzz->cases != 0 && i >= fuzz->cases)
+        {
+            break;
+        }
+
+        if(pool->deadline != 0 && (w->ran % C8_FUZZ_CLOCK) == 0 && fuzz_now_ns() >= pool->deadline)
+        {
+            break;
+        }
+
+        c8_fuzz_generate(&input, fuzz->seed + i);
+        step = fuzz_check(w, &input);
+        w->ran++;
+
+        if(step != 0)
+        {
+            step = fuzz_shrink(w, &input, step);
+            fuzz_report(w, &input, step, &failure);
+
+            pthread_mutex_lock(&pool->lock);
+            if(fuzz->failed == 0)
+            {
+                fuzz->failed = 1;
+                fuzz->failure = failure;
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            atomic_store_explicit(&pool->stop, 1, memory_order_relaxed);
+        }
+    }
+
+    return NULL;
+}
+
+/* This function returns a machine running _engine_, NULL when out of memory */
+static Chip8* fuzz_machine(C8_ENGINE engine)
+{
+    Chip8* chip8 = malloc(sizeof(Chip8));
+
+    if(chip8 != NULL)
+    {
+        c8_init(chip8);
+        chip8->engine = engine;
+    }
+
+    return chip8;
+}
+
+static void fuzz_machine_free(Chip8* chip8)
+{
+    if(chip8 != NULL)
+    {
+        c8_deinit(chip8);
+        free(chip8);
+    }
+}
+
+/* This function allocates the machines and buffers of a worker, returns 0 on success */
+static int fuzz_worker_init(c8_fuzz_worker* w, c8_fuzz_pool* pool, int id, int threads)
+{
+    memset(w, 0, sizeof(c8_fuzz_worker));
+
+    w->pool = pool;
+    w->id = id;
+    w->threads = threads;
+    w->setup = fuzz_machine(C8_ENGINE_SWITCH);
+    w->ref = fuzz_machine(pool->fuzz->reference);
+    w->cand = fuzz_machine(pool->fuzz->candidate);
+    w->init = malloc(C8_STATE_SIZE);
+    w->a = malloc(C8_STATE_SIZE);
+    w->b = malloc(C8_STATE_SIZE);
+    w->trace = malloc((pool->fuzz->cycles + 1) * sizeof(c8_fuzz_point));
+
+    if(w->setup == NULL || w->ref == NULL || w->cand == NULL || w->init == NULL
+        || w->a == NULL || w->b == NULL || w->trace == NULL)
+    {
+        return 1;
+    }
+
+    if(pool->fuzz->debug == STD_TRUE && c8_debug_attach(w->cand) == NULL)
+    {
+        return 1;
+    }
+
+    /* Idle loops are stepped through by the reference, checking the candidate's fast-forward */
+    w->ref->fast_idle = STD_FALSE;
+
+    return 0;
+}
+
+static void fuzz_worker_free(c8_fuzz_worker* w)
+{
+    fuzz_machine_free(w->setup);
+    fuzz_machine_free(w->ref);
+    fuzz_machine_free(w->cand);
+    free(w->init);
+    free(w->a);
+    free(w->b);
+    free(w->trace);
+}
+
+int c8_fuzz_run(C8Fuzz* fuzz)
+{
+    c8_fuzz_pool pool;
+    c8_fuzz_worker* workers = NULL;
+    pthread_t* tids = NULL;
+    int threads = fuzz->threads;
+    int started = 0;
+    int ret = 0;
+
+    if(threads <= 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = (n > 0) ? (int)n : 1;
+    }
+
+    if(fuzz->cases != 0 && (unsigned long)threads > fuzz->cases)
+    {
+        threads = (int)fuzz->cases;
+    }
+
+    fuzz->ran = 0;
+    fuzz->executed = 0;
+    fuzz->failed = 0;
+
+    pool.fuzz = fuzz;
+    pool.deadline = (fuzz->seconds != 0) ? fuzz_now_ns() + fuzz->seconds * 1000000000ull : 0;
+    atomic_init(&pool.stop, 0);
+    pthread_mutex_init(&pool.lock, NULL);
+
+    workers = calloc(threads, sizeof(c8_fuzz_worker));
+    tids = calloc(threads, sizeof(pthread_t));
+
+    if(workers == NULL || tids == NULL)
+    {
+        ret = 1;
+        goto out;
+    }
+
+    for(int i = 0; i < threads; i++)
+    {
+        if(fuzz_worker_init(&workers[i], &pool, i, threads) != 0)
+        {
+            ret = 1;
+            threads = i + 1;
+            goto out;
+        }
+    }
+
+    for(started = 0; started < threads; started++)
+    {
+        if(pthread_create(&tids[started], NULL, fuzz_thread, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    for(int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+        fuzz->ran += workers[i].ran;
+        fuzz->executed += workers[i].executed;
+    }
+
+    /* Seeds are dealt round-robin, a missing worker would skip some of them */
+    if(started < threads)
+    {
+        ret = 1;
+    }
+
+out:
+    for(int i = 0; workers != NULL && i < threads; i++)
+    {
+        fuzz_worker_free(&workers[i]);
+    }
+
+    pthread_mutex_destroy(&pool.lock);
+    free(workers);
+    free(tids);
+
+    return ret;
+}
+
+int c8_fuzz_write(const C8FuzzFailure* failure, const char* prefix)
+{
+    char path[4096];
+    Chip8* chip8 = malloc(sizeof(Chip8));
+    FILE* f = NULL;
+    size_t size = C8_FUZZ_DATA_START + C8_FUZZ_DATA - C8_PROGRAM_START;
+    int ret = 0;
+
+    if(chip8 == NULL)
+    {
+        return 1;
+    }
+
+    c8_init(chip8);
+    fuzz_setup(chip8, &failure->input);
+
+    snprintf(path, sizeof(path), "%s.c8s", prefix);
+    ret = c8_state_write(chip8, path);
+
+    snprintf(path, sizeof(path), "%s.ch8", prefix);
+    if(ret == 0 && (f = fopen(path, "wb")) != NULL)
+    {
+        ret = (fwrite(&chip8->memory[C8_PROGRAM_START], 1, size, f) == size) ? 0 : 1;
+        ret |= (fclose(f) != 0) ? 1 : 0;
+    }
+    else
+    {
+        ret = 1;
+    }
+
+    c8_deinit(chip8);
+    free(chip8);
+
+    return ret;
+}
@@ -0,0 +1,92 @@
+#ifndef CHIP8_FUZZ_H
+#define CHIP8_FUZZ_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* Differential fuzzer                                                  */
+/*                                                                      */
+/* A case is a random program and a random machine state, both derived  */
+/* from a 64-bit seed. Jumps and calls stay inside the program, which   */
+/* loops back to its start so the JIT finds hot blocks. The reference   */
+/* engine steps through the case one instruction at a time and stops    */
+/* before anything the interpreters leave undefined (stack overflow or  */
+/* underflow, stores past the end of memory, keys above F, code past    */
+/* the 4 KB space). The candidate engine then runs as many cycles in    */
+/* random slices, in lockstep: the registers are compared after every   */
+/* slice and the whole machine state at the end. A divergence is        */
+/* bisected down to the first instruction that differs, then the case   */
+/* is shrunk for as long as it still diverges. A sandbox candidate must */
+/* also trap the instruction the reference stopped before, with the     */
+/* fault c8_sandbox_check gives and the pc unchanged.                   */
+
+#define C8_FUZZ_WORDS  32  /* Program instructions, the last one jumps back to the start */
+#define C8_FUZZ_DATA   256 /* Random bytes right after the program (sprites, FX65 sources) */
+#define C8_FUZZ_CYCLES 512 /* Default cycle budget per case */
+
+#define C8_FUZZ_DATA_START (C8_PROGRAM_START + 2 * C8_FUZZ_WORDS)
+
+typedef struct
+{
+    UBIT64   seed;                   /* Case seed the case was generated from */
+    UBIT16   program[C8_FUZZ_WORDS]; /* Loaded at C8_PROGRAM_START */
+    UBIT8    length;                 /* Random instructions, JP C8_PROGRAM_START follows them */
+    UBIT8    data[C8_FUZZ_DATA];     /* Loaded at C8_FUZZ_DATA_START */
+    UBIT8    registers[16];
+    UBIT16   index;
+    UBIT16   stack[16];
+    UBIT16   sp;
+    UBIT16   delay_timer;
+    UBIT16   sound_timer;
+    UBIT16   keys;                   /* Keys held, bit i is key i */
+    UBIT8    hires;
+    UBIT8    planes;
+    STD_BOOL display;                /* Start from random pixels instead of a blank display */
+    UBIT64   rng;                    /* Cxkk PRNG state, also draws the random pixels */
+    UBIT64   slices;                 /* Draws the lengths of the candidate slices */
+    unsigned long ipf;               /* Cycles per timer tick, 0 = the timers stand still */
+    UBIT8    quirks;                 /* C8_QUIRK_* set of both engines */
+} C8FuzzCase;
+
+typedef struct
+{
+    C8FuzzCase    input;     /* Shrunk case */
+    unsigned long step;      /* Instructions executed when the engines disagree */
+    UBIT16        pc;        /* Address of the first diverging instruction */
+    UBIT16        opcode;    /* First diverging instruction */
+    char          diff[256]; /* What differs after it, reference/candidate */
+} C8FuzzFailure;
+
+typedef struct
+{
+    C8_ENGINE     reference;
+    C8_ENGINE     candidate;
+    UBIT64        seed;     /* Case i has seed _seed_ + i */
+    unsigned long cases;    /* Cases to run, 0 = until _seconds_ elapsed */
+    unsigned      seconds;  /* Time limit, 0 = none */
+    unsigned long cycles;   /* Cycle budget per case */
+    int           threads;  /* 0 = one per core */
+    STD_BOOL      debug;    /* Attach a debugger, without breakpoints, to the candidate */
+
+    /* Results */
+    unsigned long ran;      /* Cases run */
+    unsigned long executed; /* Instructions run by the reference */
+    int           failed;   /* A divergence was found, see _failure_ */
+    C8FuzzFailure failure;
+} C8Fuzz;
+
+/* This function generates the case of _seed_ */
+void c8_fuzz_generate(C8FuzzCase* input, UBIT64 seed);
+
+/* This function runs the cases on a pool of threads, each one taking every */
+/* _threads_-th seed, and stops at the first divergence. Returns 0 when the */
+/* pool ran, 1 if the threads could not be created.                         */
+int c8_fuzz_run(C8Fuzz* fuzz);
+
+/* This function writes a failure as a reproducer: _prefix_.c8s holds the     */
+/* initial machine state and _prefix_.ch8 the program, for headless -l. Returns */
+/* 0 on success.                                                              */
+int c8_fuzz_write(const C8FuzzFailure* failure, const char* prefix);
+
+#endif /* CHIP8_FUZZ_H */
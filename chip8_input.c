@@ -0,0 +1,141 @@
+#include <string.h>
+
+#include "chip8_input.h"
+
+/* ---- Input pipeline ---- */
+
+#define C8_INPUT_MS 1000000ULL
+
+void c8_input_init(C8Input* input)
+{
+    atomic_init(&input->state, 0);
+
+    for(int i = 0; i < C8_INPUT_STAMPS; i++)
+    {
+        atomic_init(&input->stamps[i], 0);
+    }
+}
+
+void c8_input_key(C8Input* input, UBIT8 key, STD_BOOL pressed, UBIT64 event_ns)
+{
+    UBIT64 state = atomic_load_explicit(&input->state, memory_order_relaxed);
+    UBIT64 keys = state & 0xFFFF;
+    UBIT64 n = (state >> 16) + 1;
+
+    key &= 0xF;
+    keys = (pressed == STD_TRUE) ? keys | (1u << key) : keys & ~(1u << key);
+
+    if(keys == (state & 0xFFFF))
+    {
+        return;
+    }
+
+    /* The stamp is in place before the release store makes change n visible */
+    atomic_store_explicit(&input->stamps[n & (C8_INPUT_STAMPS - 1)], event_ns, memory_order_relaxed);
+    atomic_store_explicit(&input->state, keys | (n << 16), memory_order_release);
+}
+
+void c8_input_reader_init(C8InputReader* reader)
+{
+    memset(reader, 0, sizeof(C8InputReader));
+}
+
+UBIT16 c8_input_poll(const C8Input* input, C8InputReader* reader, Chip8* chip8)
+{
+    UBIT64 state = atomic_load_explicit(&input->state, memory_order_acquire);
+    UBIT16 keys = state & 0xFFFF;
+    UBIT64 changes = state >> 16;
+    UBIT16 changed = keys ^ reader->keys;
+
+    if(changes == reader->changes)
+    {
+        return 0;
+    }
+
+    /* Several changes since the last poll: time the latest one */
+    reader->changes = changes;
+    reader->keys = keys;
+    reader->pending = changed;
+    reader->sample.event_ns = atomic_load_explicit(&input->stamps[changes & (C8_INPUT_STAMPS - 1)], memory_order_relaxed);
+    reader->sample.observe_ns = 0;
+
+    /* Cleared first: resuming FX0A below reads the key */
+    chip8->keys_read &= ~changed;
+
+    for(UBIT8 k = 0; k < KEYBOARD_SIZE * KEYBOARD_SIZE; k++)
+    {
+        if((changed >> k) & 1)
+        {
+            c8_key_event(chip8, k, ((keys >> k) & 1) ? STD_TRUE : STD_FALSE);
+        }
+    }
+
+    return changed;
+}
+
+C8InputSample c8_input_sample(const C8InputReader* reader)
+{
+    C8InputSample none = { 0, 0 };
+
+    return (reader->sample.observe_ns != 0) ? reader->sample : none;
+}
+
+/* This function adds one stage latency to the statistics */
+static void c8_input_add(C8InputStats* stats, int stage, UBIT64 from, UBIT64 to)
+{
+    UBIT64 ns = (to > from) ? to - from : 0;
+    UBIT64 bucket = ns / C8_INPUT_MS;
+
+    stats->sum[stage] += ns;
+    stats->max[stage] = (ns > stats->max[stage]) ? ns : stats->max[stage];
+    stats->histogram[stage][(bucket < C8_INPUT_BUCKETS) ? bucket : C8_INPUT_BUCKETS - 1]++;
+}
+
+void c8_input_record(C8InputStats* stats, const C8InputSample* sample, UBIT64 present_ns)
+{
+    if(sample->event_ns == 0 || sample->event_ns == stats->last_event)
+    {
+        return;
+    }
+
+    stats->last_event = sample->event_ns;
+    stats->count++;
+
+    c8_input_add(stats, 0, sample->event_ns, sample->observe_ns);
+    c8_input_add(stats, 1, sample->observe_ns, present_ns);
+    c8_input_add(stats, 2, sample->event_ns, present_ns);
+}
+
+/* This function returns the upper bound (ms) of the bucket holding quantile _q_ */
+static double c8_input_quantile(const C8InputStats* stats, int stage, double q)
+{
+    UBIT64 seen = 0;
+
+    for(int b = 0; b < C8_INPUT_BUCKETS; b++)
+    {
+        seen += stats->histogram[stage][b];
+
+        if(seen > 0 && seen >= q * stats->count)
+        {
+            return b + 1;
+        }
+    }
+
+    return C8_INPUT_BUCKETS;
+}
+
+void c8_input_write_stats(const C8InputStats* stats, FILE* f)
+{
+    static const char* stages[3] = { "event->observe", "observe->present", "event->present" };
+
+    fprintf(f, "input latency: %llu samples (ms: mean, p50, p99, max)\n", (unsigned long long)stats->count);
+
+    for(int s = 0; s < 3 && stats->count > 0; s++)
+    {
+        fprintf(f, "  %-17s %7.2f %5.0f %5.0f %7.2f\n", stages[s],
+                (double)stats->sum[s] / stats->count / C8_INPUT_MS,
+                c8_input_quantile(stats, s, 0.50),
+                c8_input_quantile(stats, s, 0.99),
+                (double)stats->max[s] / C8_INPUT_MS);
+    }
+}
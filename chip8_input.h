@@ -0,0 +1,96 @@
+#ifndef CHIP8_INPUT_H
+#define CHIP8_INPUT_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+/* Input pipeline                                                       */
+/*                                                                      */
+/* The keypad goes from the thread reading the host events to the       */
+/* emulation thread as one atomic word: the 16 key bits and the count   */
+/* of changes so far, whose host timestamps are kept in a ring. The     */
+/* emulation thread polls the word as often as it likes (several times  */
+/* a frame) and gets the keys and the time of the change that produced */
+/* them together, without any lock.                                     */
+/*                                                                      */
+/* Each change is followed through the pipeline: its event timestamp,   */
+/* the first instruction reading one of the changed keys (Ex9E, ExA1 or */
+/* FX0A, see chip8->keys_read) and the presentation of the next frame.  */
+/* Published frames carry the sample, the presenting thread records it. */
+
+#define C8_INPUT_STAMPS  64  /* Change timestamps kept, power of two */
+#define C8_INPUT_BUCKETS 128 /* Latency histogram: 1 ms buckets, the last one is 127 ms and more */
+
+/* Shared by the producer (one thread) and the emulation thread */
+typedef struct
+{
+    _Atomic UBIT64 state;                   /* Keys in bits 0...15, change count above */
+    _Atomic UBIT64 stamps[C8_INPUT_STAMPS]; /* Host time (ns) of change n, at n % C8_INPUT_STAMPS */
+} C8Input;
+
+/* Latency sample of one change */
+typedef struct
+{
+    UBIT64 event_ns;   /* Host time of the event, 0 = no sample */
+    UBIT64 observe_ns; /* Host time of the slice whose instructions read a changed key */
+} C8InputSample;
+
+/* Owned by the emulation thread */
+typedef struct
+{
+    UBIT16        keys;    /* Keys applied to the machine */
+    UBIT64        changes; /* Change count applied */
+    UBIT16        pending; /* Keys of the last change the program did not read yet */
+    C8InputSample sample;  /* Last change, complete once _observe_ns_ is set */
+} C8InputReader;
+
+/* Latency statistics, owned by the presenting thread */
+typedef struct
+{
+    UBIT64 count;
+    UBIT64 sum[3];                       /* event -> observe, observe -> present, event -> present */
+    UBIT64 max[3];
+    UBIT32 histogram[3][C8_INPUT_BUCKETS];
+    UBIT64 last_event;                   /* Sample recorded last, frames repeat it */
+} C8InputStats;
+
+/* This function clears the keys and the change count */
+void c8_input_init(C8Input* input);
+
+/* This function publishes a key change stamped _event_ns_ (host time), a */
+/* key already in that state publishes nothing. One producer thread only. */
+void c8_input_key(C8Input* input, UBIT8 key, STD_BOOL pressed, UBIT64 event_ns);
+
+/* This function starts a reader on a machine without any key held */
+void c8_input_reader_init(C8InputReader* reader);
+
+/* This function applies the keys published since the last poll to the machine */
+/* and starts measuring the latest change. Returns the keys that changed.      */
+UBIT16 c8_input_poll(const C8Input* input, C8InputReader* reader, Chip8* chip8);
+
+/* This function completes the pending measurement when the instructions run   */
+/* since the poll read a changed key: _now_ns_ is taken right after them.       */
+static inline void c8_input_observe(C8InputReader* reader, const Chip8* chip8, UBIT64 now_ns)
+{
+    if((reader->pending & chip8->keys_read) != 0)
+    {
+        reader->pending = 0;
+        reader->sample.observe_ns = now_ns;
+    }
+}
+
+/* This function returns the sample a published frame carries: the last change */
+/* once observed, a zero sample otherwise                                      */
+C8InputSample c8_input_sample(const C8InputReader* reader);
+
+/* This function records a sample carried by a frame presented at _present_ns_, */
+/* a sample already recorded by an earlier frame is skipped                     */
+void c8_input_record(C8InputStats* stats, const C8InputSample* sample, UBIT64 present_ns);
+
+/* This function writes the mean, median, 99th percentile and maximum of each */
+/* stage in milliseconds                                                      */
+void c8_input_write_stats(const C8InputStats* stats, FILE* f);
+
+#endif /* CHIP8_INPUT_H */
@@ -0,0 +1,667 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_engine.h"
+
+/* x86-64 dynamic recompiler.                                               */
+/*                                                                          */
+/* Basic blocks end at 1nnn/2nnn/00EE/Bnnn, at the skips and before any     */
+/* instruction the recompiler does not handle (CLS, RND, DRW, key and       */
+/* memory FX codes). Those, and blocks that are not hot yet, run on the     */
+/* predecoded interpreter. Compiled code keeps the machine in memory and    */
+/* uses fixed host registers:                                               */
+/*   rbx: Chip8*   r12: remaining cycle budget   r13: block table           */
+/* Every block checks the budget on entry, so static successors can be      */
+/* chained with a direct jmp and dynamic ones go through a table lookup.    */
+/* The quirks of the machine are compiled in, c8_set_quirks flushes blocks. */
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+#define C8_JIT_CACHE_SIZE  (256 * 1024) /* Executable code cache */
+#define C8_JIT_MAX_BLOCK   64           /* Instructions per block */
+#define C8_JIT_MAX_INSN    64           /* Worst case bytes per instruction */
+#define C8_JIT_HOT         4            /* Entries before a block gets compiled */
+#define C8_JIT_COLD        0xFF         /* Heat of addresses that cannot start a block */
+#define C8_JIT_MAX_LINKS   2048         /* Pending chain patches */
+
+typedef struct
+{
+    UBIT32 site;   /* Offset of the rel32 to patch */
+    UBIT16 target; /* Block address it should jump to */
+} c8_jit_link;
+
+struct C8Jit
+{
+    UBIT8* code;                      /* Code cache (RWX) */
+    size_t used;                      /* Bytes in use */
+    size_t base;                      /* Bytes taken by the trampolines */
+    size_t exit_off;                  /* Exit stub: eax = next pc */
+    size_t dispatch_off;              /* Dynamic successor lookup: eax = next pc */
+    void*  blocks[C8_MEM_SIZE];       /* Block entry per address */
+    UBIT8  heat[C8_MEM_SIZE];         /* Entry counter per address */
+    UBIT8  covered[C8_MEM_SIZE / 8];  /* Addresses read by compiled blocks */
+    c8_jit_link links[C8_JIT_MAX_LINKS];
+    size_t nlinks;
+};
+
+typedef UBIT64 (*c8_jit_enter_fn)(Chip8* chip8, UBIT64 budget, void** blocks, void* entry);
+
+/* ---- Emitter ---- */
+
+#define C8_OFF_REG(r)   (UBIT32)(offsetof(Chip8, registers) + (r))
+#define C8_OFF_PC       (UBIT32)offsetof(Chip8, pc)
+#define C8_OFF_SP       (UBIT32)offsetof(Chip8, sp)
+#define C8_OFF_INDEX    (UBIT32)offsetof(Chip8, index)
+#define C8_OFF_DT       (UBIT32)offsetof(Chip8, delay_timer)
+#define C8_OFF_ST       (UBIT32)offsetof(Chip8, sound_timer)
+#define C8_OFF_STACK    (UBIT32)offsetof(Chip8, stack)
+
+/* Host registers in ModRM encoding */
+enum { RAX = 0, RCX = 1, RDX = 2 };
+
+static void emit8(C8Jit* jit, UBIT8 b)
+{
+    jit->code[jit->used++] = b;
+}
+
+static void emit32(C8Jit* jit, UBIT32 v)
+{
+    memcpy(&jit->code[jit->used], &v, sizeof(v));
+    jit->used += sizeof(v);
+}
+
+/* op reg, [rbx + disp32] (mod = 10, rm = rbx) */
+static void emit_rbx(C8Jit* jit, UBIT8 opcode, UBIT8 reg, UBIT32 disp)
+{
+    emit8(jit, opcode);
+    emit8(jit, 0x80 | (reg << 3) | 0x3);
+    emit32(jit, disp);
+}
+
+/* Same with a two bytes opcode */
+static void emit_rbx2(C8Jit* jit, UBIT8 op1, UBIT8 op2, UBIT8 reg, UBIT32 disp)
+{
+    emit8(jit, op1);
+    emit_rbx(jit, op2, reg, disp);
+}
+
+static void emit_load8(C8Jit* jit, UBIT8 reg, UBIT8 vx)
+{
+    emit_rbx(jit, 0x8A, reg, C8_OFF_REG(vx)); /* mov r8, [Vx] */
+}
+
+static void emit_store8(C8Jit* jit, UBIT8 reg, UBIT8 vx)
+{
+    emit_rbx(jit, 0x88, reg, C8_OFF_REG(vx)); /* mov [Vx], r8 */
+}
+
+/* jmp/jcc rel32 to an absolute cache offset, returns the rel32 offset */
+static size_t emit_jump(C8Jit* jit, UBIT8 cc, size_t target)
+{
+    size_t site = 0;
+
+    if(cc == 0)
+    {
+        emit8(jit, 0xE9);
+    }
+    else
+    {
+        emit8(jit, 0x0F);
+        emit8(jit, cc);
+    }
+
+    site = jit->used;
+    emit32(jit, (UBIT32)(target - (site + 4)));
+
+    return site;
+}
+
+static void patch_jump(C8Jit* jit, size_t site, size_t target)
+{
+    UBIT32 rel = (UBIT32)(target - (site + 4));
+
+    memcpy(&jit->code[site], &rel, sizeof(rel));
+}
+
+/* mov eax, imm32 */
+static void emit_mov_eax(C8Jit* jit, UBIT32 v)
+{
+    emit8(jit, 0xB8);
+    emit32(jit, v);
+}
+
+/* Leave the block towards a fixed address, chained when possible */
+static void emit_static_exit(C8Jit* jit, UBIT16 target)
+{
+    size_t site = 0;
+
+    emit_mov_eax(jit, target);
+
+    if(target < C8_MEM_SIZE && jit->blocks[target] != NULL)
+    {
+        emit_jump(jit, 0, (UBIT8*)jit->blocks[target] - jit->code);
+        return;
+    }
+
+    site = emit_jump(jit, 0, jit->exit_off);
+
+    if(target < C8_MEM_SIZE - 1 && jit->heat[target] != C8_JIT_COLD && jit->nlinks < C8_JIT_MAX_LINKS)
+    {
+        jit->links[jit->nlinks].site = (UBIT32)site;
+        jit->links[jit->nlinks].target = target;
+        jit->nlinks++;
+    }
+}
+
+/* Give back _count_ cycles and leave at _pc_ without executing it */
+static void emit_bail(C8Jit* jit, UBIT16 pc, UBIT32 count)
+{
+    emit8(jit, 0x49); emit8(jit, 0x81); emit8(jit, 0xC4); emit32(jit, count); /* add r12, count */
+    emit_mov_eax(jit, pc);
+    emit_jump(jit, 0, jit->exit_off);
+}
+
+/* ---- Trampolines ---- */
+
+static void c8_jit_emit_trampolines(C8Jit* jit)
+{
+    static const UBIT8 enter[] = {
+        0x53,             /* push rbx */
+        0x41, 0x54,       /* push r12 */
+        0x41, 0x55,       /* push r13 */
+        0x48, 0x89, 0xFB, /* mov rbx, rdi */
+        0x49, 0x89, 0xF4, /* mov r12, rsi */
+        0x49, 0x89, 0xD5, /* mov r13, rdx */
+        0xFF, 0xE1        /* jmp rcx */
+    };
+    static const UBIT8 leave[] = {
+        0x4C, 0x89, 0xE0, /* mov rax, r12 */
+        0x41, 0x5D,       /* pop r13 */
+        0x41, 0x5C,       /* pop r12 */
+        0x5B,             /* pop rbx */
+        0xC3              /* ret */
+    };
+    jit->used = 0;
+    memcpy(jit->code, enter, sizeof(enter));
+    jit->used += sizeof(enter);
+
+    /* Exit: store the pc held in eax */
+    jit->exit_off = jit->used;
+    emit_rbx(jit, 0x89, RAX, C8_OFF_PC); /* mov [pc], eax */
+    memcpy(&jit->code[jit->used], leave, sizeof(leave));
+    jit->used += sizeof(leave);
+
+    /* Dispatch: jump to the block at eax if there is one */
+    jit->dispatch_off = jit->used;
+    emit8(jit, 0x3D); emit32(jit, C8_MEM_SIZE - 2);          /* cmp eax, 4094 */
+    emit_jump(jit, 0x87, jit->exit_off);                     /* ja exit */
+    emit8(jit, 0x49); emit8(jit, 0x8B); emit8(jit, 0x54);    /* mov rdx, [r13 + rax * 8] */
+    emit8(jit, 0xC5); emit8(jit, 0x00);
+    emit8(jit, 0x48); emit8(jit, 0x85); emit8(jit, 0xD2);    /* test rdx, rdx */
+    emit_jump(jit, 0x84, jit->exit_off);                     /* jz exit */
+    emit8(jit, 0xFF); emit8(jit, 0xE2);                      /* jmp rdx */
+
+    jit->base = jit->used;
+}
+
+/* ---- Compiler ---- */
+
+static void c8_jit_flush(C8Jit* jit)
+{
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->heat, 0, sizeof(jit->heat));
+    memset(jit->covered, 0, sizeof(jit->covered));
+    jit->nlinks = 0;
+    jit->used = jit->base;
+}
+
+/* This function emits a non terminating instruction for the C8_QUIRK_* set */
+/* _quirks_, returns 0 if unsupported                                        */
+static int c8_jit_emit_simple(C8Jit* jit, UBIT16 opcode, UBIT8 quirks)
+{
+    UBIT8 x = (opcode & 0x0F00) >> 8;
+    UBIT8 y = (opcode & 0x00F0) >> 4;
+    UBIT8 kk = (opcode & 0x00FF);
+    UBIT8 s = (quirks & C8_QUIRK_SHIFT_VY) ? y : x; /* Shifted register */
+
+    switch(opcode >> 12)
+    {
+    case 0x0:
+        /* 0nnn: nothing to do, CLS, RET and the SUPER-CHIP codes are handled elsewhere */
+        return (opcode != 0x00E0 && opcode != 0x00EE && !c8_is_ext_0(opcode));
+    case 0x6:
+        emit_rbx(jit, 0xC6, 0, C8_OFF_REG(x)); emit8(jit, kk);  /* mov byte [Vx], kk */
+        return 1;
+    case 0x7:
+        emit_rbx(jit, 0x80, 0, C8_OFF_REG(x)); emit8(jit, kk);  /* add byte [Vx], kk */
+        return 1;
+    case 0x8:
+        switch(opcode & 0x000F)
+        {
+        case 0x0:
+            emit_load8(jit, RAX, y);
+            emit_store8(jit, RAX, x);
+            return 1;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            emit_load8(jit, RAX, x);
+            emit_load8(jit, RCX, y);
+            emit8(jit, (opcode & 0xF) == 0x1 ? 0x08 : (opcode & 0xF) == 0x2 ? 0x20 : 0x30);
+            emit8(jit, 0xC8);                                   /* or/and/xor al, cl */
+            emit_store8(jit, RAX, x);
+            if(quirks & C8_QUIRK_VF_RESET)
+            {
+                emit_rbx(jit, 0xC6, 0, C8_OFF_REG(0xF)); emit8(jit, 0); /* mov byte [VF], 0 */
+            }
+            return 1;
+        case 0x4:
+            emit_load8(jit, RAX, x);
+            emit_load8(jit, RCX, y);
+            emit8(jit, 0x00); emit8(jit, 0xC8);                 /* add al, cl */
+            emit8(jit, 0x0F); emit8(jit, 0x92); emit8(jit, 0xC2); /* setc dl */
+            emit_store8(jit, RDX, 0xF);
+            emit_store8(jit, RAX, x);
+            return 1;
+        case 0x5:
+        case 0x7:
+            emit_load8(jit, RAX, x);
+            emit_load8(jit, RCX, y);
+            emit8(jit, 0x38); emit8(jit, 0xC8);                 /* cmp al, cl */
+            emit8(jit, 0x0F); emit8(jit, 0x97); emit8(jit, 0xC2); /* seta dl */
+            emit_store8(jit, RDX, 0xF);
+            /* Reload, VF may be one of the operands */
+            emit_load8(jit, RAX, (opcode & 0xF) == 0x5 ? x : y);
+            emit_load8(jit, RCX, (opcode & 0xF) == 0x5 ? y : x);
+            emit8(jit, 0x28); emit8(jit, 0xC8);                 /* sub al, cl */
+            emit_store8(jit, RAX, x);
+            return 1;
+        case 0x6:
+            emit_load8(jit, RAX, s);
+            emit8(jit, 0x24); emit8(jit, 0x01);                 /* and al, 1 */
+            emit_store8(jit, RAX, 0xF);
+            emit_load8(jit, RAX, s);
+            emit8(jit, 0xD0); emit8(jit, 0xE8);                 /* shr al, 1 */
+            emit_store8(jit, RAX, x);
+            return 1;
+        case 0xE:
+            emit_load8(jit, RAX, s);
+            emit8(jit, 0xC0); emit8(jit, 0xE8); emit8(jit, 7);  /* shr al, 7 */
+            emit_store8(jit, RAX, 0xF);
+            emit_load8(jit, RAX, s);
+            emit8(jit, 0xD0); emit8(jit, 0xE0);                 /* shl al, 1 */
+            emit_store8(jit, RAX, x);
+            return 1;
+        default:
+            return 1; /* Unknown ALU op: nothing to do */
+        }
+    case 0xA:
+        emit_rbx(jit, 0xC7, 0, C8_OFF_INDEX); emit32(jit, opcode & 0x0FFF); /* mov dword [index], nnn */
+        return 1;
+    case 0xF:
+        switch(kk)
+        {
+        case 0x07:
+            emit_rbx(jit, 0x8B, RAX, C8_OFF_DT);                /* mov eax, [dt] */
+            emit_store8(jit, RAX, x);
+            return 1;
+        case 0x15:
+        case 0x18:
+            emit_rbx2(jit, 0x0F, 0xB6, RAX, C8_OFF_REG(x));     /* movzx eax, byte [Vx] */
+            emit_rbx(jit, 0x89, RAX, (kk == 0x15) ? C8_OFF_DT : C8_OFF_ST);
+            return 1;
+        case 0x1E:
+            emit_rbx2(jit, 0x0F, 0xB6, RCX, C8_OFF_REG(x));     /* movzx ecx, byte [Vx] */
+            emit_rbx(jit, 0x8B, RAX, C8_OFF_INDEX);             /* mov eax, [index] */
+            emit8(jit, 0x01); emit8(jit, 0xC8);                 /* add eax, ecx */
+            emit8(jit, 0x3D); emit32(jit, 0xFFF);               /* cmp eax, 0xFFF */
+            emit8(jit, 0x0F); emit8(jit, 0x97); emit8(jit, 0xC2); /* seta dl */
+            emit_store8(jit, RDX, 0xF);
+            emit_rbx2(jit, 0x0F, 0xB6, RCX, C8_OFF_REG(x));     /* reload, x may be VF */
+            emit_rbx(jit, 0x01, RCX, C8_OFF_INDEX);             /* add [index], ecx */
+            return 1;
+        case 0x29:
+            emit_rbx2(jit, 0x0F, 0xB6, RAX, C8_OFF_REG(x));     /* movzx eax, byte [Vx] */
+            emit8(jit, 0x8D); emit8(jit, 0x04); emit8(jit, 0x80); /* lea eax, [rax + rax * 4] */
+            emit_rbx(jit, 0x89, RAX, C8_OFF_INDEX);
+            return 1;
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+/* This function tells whether _opcode_ is a compiled skip (3xkk, 4xkk, 5xy0, 9xy0) */
+static int c8_jit_is_skip(UBIT16 opcode)
+{
+    UBIT8 first = opcode >> 12;
+
+    return first == 0x3 || first == 0x4 || (first == 0x5 && !c8_is_ext_5(opcode)) || first == 0x9;
+}
+
+/* This function emits a block terminator, returns 0 if _opcode_ is not one */
+static int c8_jit_emit_terminator(C8Jit* jit, UBIT16 pc, UBIT16 opcode, UBIT16 skip_len)
+{
+    UBIT8 x = (opcode & 0x0F00) >> 8;
+    UBIT8 y = (opcode & 0x00F0) >> 4;
+    UBIT8 kk = (opcode & 0x00FF);
+    UBIT16 nnn = (opcode & 0x0FFF);
+    size_t taken = 0;
+    size_t bail = 0;
+
+    /* A skip over F000 nnnn jumps 4 bytes further: leave it to the interpreter */
+    if(c8_jit_is_skip(opcode) && skip_len != 4)
+    {
+        return 0;
+    }
+
+    switch(opcode >> 12)
+    {
+    case 0x0:
+        if(opcode != 0x00EE)
+            return 0;
+        emit_rbx(jit, 0x8B, RCX, C8_OFF_SP);                    /* mov ecx, [sp] */
+        emit8(jit, 0x85); emit8(jit, 0xC9);                     /* test ecx, ecx */
+        bail = emit_jump(jit, 0x84, 0);                         /* jz bail */
+        emit8(jit, 0xFF); emit8(jit, 0xC9);                     /* dec ecx */
+        emit_rbx(jit, 0x89, RCX, C8_OFF_SP);                    /* mov [sp], ecx */
+        emit8(jit, 0x8B); emit8(jit, 0x84); emit8(jit, 0x8B);   /* mov eax, [rbx + rcx * 4 + stack] */
+        emit32(jit, C8_OFF_STACK);
+        emit8(jit, 0x83); emit8(jit, 0xC0); emit8(jit, 0x02);   /* add eax, 2 */
+        emit_jump(jit, 0, jit->dispatch_off);
+        patch_jump(jit, bail, jit->used);
+        emit_bail(jit, pc, 1);
+        return 1;
+    case 0x1:
+        emit_static_exit(jit, nnn);
+        return 1;
+    case 0x2:
+        emit_rbx(jit, 0x8B, RCX, C8_OFF_SP);                    /* mov ecx, [sp] */
+        emit8(jit, 0x81); emit8(jit, 0xF9); emit32(jit, 16);    /* cmp ecx, 16 */
+        bail = emit_jump(jit, 0x83, 0);                         /* jae bail */
+        emit8(jit, 0xC7); emit8(jit, 0x84); emit8(jit, 0x8B);   /* mov dword [rbx + rcx * 4 + stack], pc */
+        emit32(jit, C8_OFF_STACK); emit32(jit, pc);
+        emit_rbx(jit, 0xFF, 0, C8_OFF_SP);                      /* inc dword [sp] */
+        emit_static_exit(jit, nnn);
+        patch_jump(jit, bail, jit->used);
+        emit_bail(jit, pc, 1);
+        return 1;
+    case 0x3:
+    case 0x4:
+        emit_rbx(jit, 0x80, 7, C8_OFF_REG(x)); emit8(jit, kk);  /* cmp byte [Vx], kk */
+        taken = emit_jump(jit, ((opcode >> 12) == 0x3) ? 0x84 : 0x85, 0);
+        break;
+    case 0x5:
+        if(c8_is_ext_5(opcode))
+            return 0;
+        /* fall through */
+    case 0x9:
+        emit_load8(jit, RAX, x);
+        emit_rbx(jit, 0x3A, RAX, C8_OFF_REG(y));               /* cmp al, [Vy] */
+        taken = emit_jump(jit, ((opcode >> 12) == 0x5) ? 0x84 : 0x85, 0);
+        break;
+    case 0xB:
+        emit_rbx2(jit, 0x0F, 0xB6, RAX, C8_OFF_REG(0));         /* movzx eax, byte [V0] */
+        emit8(jit, 0x05); emit32(jit, nnn);                     /* add eax, nnn */
+        emit_jump(jit, 0, jit->dispatch_off);
+        return 1;
+    default:
+        return 0;
+    }
+
+    /* Skips: not taken falls through to pc + 2, taken goes to pc + 4 */
+    emit_static_exit(jit, pc + 2);
+    patch_jump(jit, taken, jit->used);
+    emit_static_exit(jit, pc + 4);
+
+    return 1;
+}
+
+/* This function compiles the block starting at _start_, returns its entry */
+static void* c8_jit_compile(Chip8* chip8, C8Jit* jit, UBIT16 start)
+{
+    size_t entry = 0;
+    size_t budget_site = 0;
+    size_t budget_check = 0;
+    UBIT32 count = 0;
+    UBIT16 pc = start;
+    UBIT16 end = 0;
+    int terminated = 0;
+
+    if(jit->used + C8_JIT_MAX_BLOCK * C8_JIT_MAX_INSN + 64 > C8_JIT_CACHE_SIZE)
+    {
+        c8_jit_flush(jit);
+    }
+
+    entry = jit->used;
+
+    /* Budget check, the count is patched once the block is known */
+    emit8(jit, 0x49); emit8(jit, 0x81); emit8(jit, 0xFC);       /* cmp r12, count */
+    budget_check = jit->used;
+    emit32(jit, 0);
+    budget_site = emit_jump(jit, 0x8C, 0);                      /* jl bail */
+    emit8(jit, 0x49); emit8(jit, 0x81); emit8(jit, 0xEC);       /* sub r12, count */
+    emit32(jit, 0);
+
+    while(count < C8_JIT_MAX_BLOCK && pc < C8_MEM_SIZE - 1)
+    {
+        UBIT16 opcode = (chip8->memory[pc] << 8) | chip8->memory[pc + 1];
+        size_t mark = jit->used;
+
+        if(c8_jit_emit_simple(jit, opcode, chip8->quirks))
+        {
+            count++;
+            pc += 2;
+            continue;
+        }
+
+        jit->used = mark;
+
+        if(c8_jit_emit_terminator(jit, pc, opcode, c8_skip_len(chip8, pc)))
+        {
+            /* A skip depends on the instruction after it (F000 nnnn or not) */
+            end = c8_jit_is_skip(opcode) ? pc + 4 : pc + 2;
+            count++;
+            pc += 2;
+            terminated = 1;
+        }
+        else
+        {
+            jit->used = mark;
+        }
+
+        break;
+    }
+
+    if(count == 0)
+    {
+        jit->used = entry;
+        jit->heat[start] = C8_JIT_COLD;
+        return NULL;
+    }
+
+    if(!terminated)
+    {
+        /* Next instruction is not supported (or block full): leave to it */
+        emit_static_exit(jit, pc);
+    }
+
+    memcpy(&jit->code[budget_check], &count, sizeof(count));
+    memcpy(&jit->code[budget_check + 4 + 6 + 3], &count, sizeof(count));
+    patch_jump(jit, budget_site, jit->used);
+    emit_mov_eax(jit, start);
+    emit_jump(jit, 0, jit->exit_off);
+
+    if(end < pc)
+    {
+        end = pc;
+    }
+
+    for(UBIT16 a = start; a < end && a < C8_MEM_SIZE; a++)
+    {
+        jit->covered[a >> 3] |= (1 << (a & 7));
+    }
+
+    jit->blocks[start] = &jit->code[entry];
+
+    /* Chain the blocks that were waiting for this one */
+    for(size_t i = 0; i < jit->nlinks; )
+    {
+        if(jit->links[i].target == start)
+        {
+            patch_jump(jit, jit->links[i].site, entry);
+            jit->links[i] = jit->links[--jit->nlinks];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return jit->blocks[start];
+}
+
+/* ---- Engine ---- */
+
+static C8Jit* c8_jit_create(void)
+{
+    C8Jit* jit = calloc(1, sizeof(C8Jit));
+    void* code = NULL;
+
+    if(jit == NULL)
+    {
+        return NULL;
+    }
+
+    code = mmap(NULL, C8_JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(code == MAP_FAILED)
+    {
+        free(jit);
+        return NULL;
+    }
+
+    jit->code = code;
+    c8_jit_emit_trampolines(jit);
+
+    return jit;
+}
+
+void c8_jit_free(Chip8* chip8)
+{
+    if(chip8->jit != NULL)
+    {
+        munmap(chip8->jit->code, C8_JIT_CACHE_SIZE);
+        free(chip8->jit);
+        chip8->jit = NULL;
+    }
+}
+
+void c8_jit_invalidate(Chip8* chip8, UBIT16 addr, UBIT16 len)
+{
+    C8Jit* jit = chip8->jit;
+
+    for(UBIT32 a = addr; a < (UBIT32)addr + len && a < C8_MEM_SIZE; a++)
+    {
+        if(jit->covered[a >> 3] & (1 << (a & 7)))
+        {
+            /* Chains cross blocks freely, so drop the whole cache */
+            c8_jit_flush(jit);
+            return;
+        }
+    }
+}
+
+void c8_jit_invalidate_all(Chip8* chip8)
+{
+    c8_jit_flush(chip8->jit);
+}
+
+unsigned long c8_jit_run(Chip8* chip8, unsigned long cycles)
+{
+    c8_jit_enter_fn enter = NULL;
+    unsigned long executed = 0;
+    C8Jit* jit = chip8->jit;
+
+    if(jit == NULL)
+    {
+        jit = chip8->jit = c8_jit_create();
+        if(jit == NULL)
+        {
+            /* No executable memory: stay on the interpreter */
+            return c8_predecoded_run(chip8, cycles);
+        }
+    }
+
+    enter = (c8_jit_enter_fn)(void*)jit->code;
+
+    while(executed < cycles && chip8->waiting_key == STD_FALSE)
+    {
+        UBIT16 pc = chip8->pc;
+        void* entry = NULL;
+
+        /* Compiled loops chain to themselves until the budget runs out, so */
+        /* idle loops are caught here, when a run starts or leaves a block  */
+        if(chip8->fast_idle == STD_TRUE && c8_idle_skip(chip8, cycles - executed) != 0)
+        {
+            return cycles;
+        }
+
+        if(pc < C8_MEM_SIZE - 1)
+        {
+            entry = jit->blocks[pc];
+
+            if(entry == NULL && jit->heat[pc] != C8_JIT_COLD && ++jit->heat[pc] >= C8_JIT_HOT)
+            {
+                entry = c8_jit_compile(chip8, jit, pc);
+            }
+        }
+
+        if(entry != NULL)
+        {
+            UBIT64 budget = cycles - executed;
+            UBIT64 left = enter(chip8, budget, jit->blocks, entry);
+
+            if(left != budget)
+            {
+                executed += budget - left;
+                continue;
+            }
+        }
+
+        /* Cold code, unsupported instruction or not enough budget for the block */
+        executed += c8_predecoded_run(chip8, 1);
+    }
+
+    return executed;
+}
+
+#else /* !__x86_64__ */
+
+void c8_jit_free(Chip8* chip8)
+{
+    (void)chip8;
+}
+
+void c8_jit_invalidate(Chip8* chip8, UBIT16 addr, UBIT16 len)
+{
+    (void)chip8; (void)addr; (void)len;
+}
+
+void c8_jit_invalidate_all(Chip8* chip8)
+{
+    (void)chip8;
+}
+
+unsigned long c8_jit_run(Chip8* chip8, unsigned long cycles)
+{
+    /* No recompiler for this host */
+    return c8_predecoded_run(chip8, cycles);
+}
+
+#endif /* __x86_64__ */
@@ -0,0 +1,983 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_engine.h"
+#include "chip8_lanes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define C8_LANES_X86
+#include <immintrin.h>
+#endif
+
+/* ---- Lockstep lanes ---- */
+
+/* Vx of a lane, the register file is strided by the lane count */
+#define LANE_V(l, x, lane) ((l)->registers[(size_t)(x) * (l)->count + (lane)])
+
+/* This function returns zeroed memory aligned for AVX2 loads, NULL when out of memory */
+static void* lanes_alloc(size_t bytes)
+{
+    size_t size = (bytes + 31) & ~(size_t)31;
+    void* p = aligned_alloc(32, size);
+
+    if(p != NULL)
+    {
+        memset(p, 0, size);
+    }
+
+    return p;
+}
+
+C8Lanes* c8_lanes_create(size_t count)
+{
+    C8Lanes* l = calloc(1, sizeof(C8Lanes));
+
+    if(l == NULL)
+    {
+        return NULL;
+    }
+
+    count = (count + C8_LANE_GROUP - 1) / C8_LANE_GROUP * C8_LANE_GROUP;
+    if(count == 0)
+    {
+        count = C8_LANE_GROUP;
+    }
+
+    l->count = count;
+    l->registers = lanes_alloc(16 * count);
+    l->pc = lanes_alloc(count * sizeof(uint16_t));
+    l->index = lanes_alloc(count * sizeof(uint16_t));
+    l->delay_timer = lanes_alloc(count);
+    l->sound_timer = lanes_alloc(count);
+    l->sp = lanes_alloc(count);
+    l->stack = lanes_alloc(16 * count * sizeof(uint16_t));
+    l->keys = lanes_alloc(count * sizeof(uint16_t));
+    l->waiting_key = lanes_alloc(count);
+    l->key_register = lanes_alloc(count);
+    l->display_dirty = lanes_alloc(count);
+    l->status = lanes_alloc(count);
+    l->rng = lanes_alloc(count * sizeof(UBIT64));
+    l->memory = lanes_alloc(count * C8_MEM_SIZE);
+    l->display = lanes_alloc(count * DISP_H * sizeof(UBIT64));
+    l->image = lanes_alloc(C8_MEM_SIZE);
+    l->written = lanes_alloc(count / C8_LANE_GROUP * (C8_MEM_SIZE / 64) * sizeof(UBIT64));
+
+    if(l->registers == NULL || l->pc == NULL || l->index == NULL || l->delay_timer == NULL
+        || l->sound_timer == NULL || l->sp == NULL || l->stack == NULL || l->keys == NULL
+        || l->waiting_key == NULL || l->key_register == NULL || l->display_dirty == NULL
+        || l->status == NULL || l->rng == NULL || l->memory == NULL || l->display == NULL
+        || l->image == NULL || l->written == NULL)
+    {
+        c8_lanes_free(l);
+        return NULL;
+    }
+
+#if defined(C8_LANES_X86)
+    l->simd = __builtin_cpu_supports("avx2");
+#endif
+
+    return l;
+}
+
+void c8_lanes_free(C8Lanes* l)
+{
+    if(l == NULL)
+    {
+        return;
+    }
+
+    free(l->registers);
+    free(l->pc);
+    free(l->index);
+    free(l->delay_timer);
+    free(l->sound_timer);
+    free(l->sp);
+    free(l->stack);
+    free(l->keys);
+    free(l->waiting_key);
+    free(l->key_register);
+    free(l->display_dirty);
+    free(l->status);
+    free(l->rng);
+    free(l->memory);
+    free(l->display);
+    free(l->image);
+    free(l->written);
+    free(l);
+}
+
+/* This function records that _len_ bytes at _addr_ of a lane may differ from the image */
+static inline void lanes_mark(C8Lanes* l, size_t lane, UBIT32 addr, UBIT32 len)
+{
+    UBIT64* written = &l->written[lane / C8_LANE_GROUP * (C8_MEM_SIZE / 64)];
+
+    for(UBIT32 a = addr; a < addr + len; a++)
+    {
+        written[a / 64] |= 1ULL << (a % 64);
+    }
+}
+
+int c8_lanes_set(C8Lanes* l, size_t lane, const Chip8* chip8)
+{
+    UBIT16 keys = 0;
+
+    if(chip8->hires != 0 || chip8->planes != 0x1 || chip8->sp > 16 || chip8->quirks != 0)
+    {
+        return 1;
+    }
+
+    for(int x = 0; x < 16; x++)
+    {
+        LANE_V(l, x, lane) = chip8->registers[x];
+        l->stack[lane * 16 + x] = chip8->stack[x];
+
+        if(chip8->keyboard[x] == 1)
+            keys |= 1 << x;
+    }
+
+    l->pc[lane] = chip8->pc;
+    l->index[lane] = chip8->index;
+    l->delay_timer[lane] = chip8->delay_timer;
+    l->sound_timer[lane] = chip8->sound_timer;
+    l->sp[lane] = chip8->sp;
+    l->keys[lane] = keys;
+    l->waiting_key[lane] = (chip8->waiting_key == STD_TRUE);
+    l->key_register[lane] = chip8->key_register;
+    l->display_dirty[lane] = (chip8->display_dirty == STD_TRUE);
+    l->status[lane] = C8_LANE_RUNNING;
+    l->rng[lane] = chip8->rng;
+    memcpy(&l->memory[lane * C8_MEM_SIZE], chip8->memory, C8_MEM_SIZE);
+    memcpy(&l->display[lane * DISP_H], chip8->display[0], DISP_H * sizeof(UBIT64));
+
+    for(UBIT32 a = 0; a < C8_MEM_SIZE; a++)
+    {
+        if(chip8->memory[a] != l->image[a])
+            lanes_mark(l, lane, a, 1);
+    }
+
+    return 0;
+}
+
+void c8_lanes_get(const C8Lanes* l, size_t lane, Chip8* chip8)
+{
+    for(int x = 0; x < 16; x++)
+    {
+        chip8->registers[x] = LANE_V(l, x, lane);
+        chip8->stack[x] = l->stack[lane * 16 + x];
+        chip8->keyboard[x] = (l->keys[lane] >> x) & 1;
+    }
+
+    chip8->pc = l->pc[lane];
+    chip8->index = l->index[lane];
+    chip8->delay_timer = l->delay_timer[lane];
+    chip8->sound_timer = l->sound_timer[lane];
+    chip8->sp = l->sp[lane];
+    chip8->waiting_key = l->waiting_key[lane] ? STD_TRUE : STD_FALSE;
+    chip8->key_register = l->key_register[lane];
+    chip8->display_dirty = l->display_dirty[lane] ? STD_TRUE : STD_FALSE;
+    chip8->rng = l->rng[lane];
+    chip8->frame = l->frame;
+    chip8->clock = 0;
+    chip8->hires = 0;
+    chip8->planes = 0x1;
+
+    memcpy(chip8->memory, &l->memory[lane * C8_MEM_SIZE], C8_MEM_SIZE);
+    memset(chip8->display, 0, sizeof(chip8->display));
+    memcpy(chip8->display[0], &l->display[lane * DISP_H], DISP_H * sizeof(UBIT64));
+    c8_invalidate_all(chip8);
+}
+
+int c8_lanes_load(C8Lanes* l, const UBIT8* program, size_t size, UBIT64 seed)
+{
+    Chip8* chip8 = NULL;
+
+    if(size > C8_MEM_SIZE - C8_PROGRAM_START)
+    {
+        return 1;
+    }
+
+    chip8 = malloc(sizeof(Chip8));
+    if(chip8 == NULL)
+    {
+        return 1;
+    }
+
+    c8_init(chip8);
+    c8_load_program(chip8, program, size);
+
+    memcpy(l->image, chip8->memory, C8_MEM_SIZE);
+    memset(l->written, 0, l->count / C8_LANE_GROUP * (C8_MEM_SIZE / 64) * sizeof(UBIT64));
+
+    for(size_t i = 0; i < l->count; i++)
+    {
+        c8_seed(chip8, seed + i);
+        c8_lanes_set(l, i, chip8);
+    }
+
+    l->frame = 0;
+
+    c8_deinit(chip8);
+    free(chip8);
+
+    return 0;
+}
+
+void c8_lanes_seed(C8Lanes* l, size_t lane, UBIT64 seed)
+{
+    /* Same splitmix64 expansion as c8_seed, so a lane replays a machine */
+    UBIT64 z = seed + 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+
+    l->rng[lane] = (z != 0) ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+void c8_lanes_key_event(C8Lanes* l, size_t lane, UBIT8 key, STD_BOOL pressed)
+{
+    key &= (KEYBOARD_SIZE * KEYBOARD_SIZE) - 1;
+
+    if(pressed == STD_TRUE)
+        l->keys[lane] |= 1 << key;
+    else
+        l->keys[lane] &= ~(1 << key);
+
+    if(pressed == STD_TRUE && l->waiting_key[lane])
+    {
+        /* Resume the FX0A that parked the lane */
+        LANE_V(l, l->key_register[lane], lane) = key;
+        l->waiting_key[lane] = 0;
+    }
+}
+
+/* This function reads a memory byte of a lane, there is nothing past 4 KB */
+static inline UBIT8 lanes_peek(const C8Lanes* l, size_t lane, UBIT32 addr)
+{
+    return (addr < C8_MEM_SIZE) ? l->memory[lane * C8_MEM_SIZE + addr] : 0;
+}
+
+/* This function returns the next PRNG byte of a lane, as c8_random does */
+static UBIT8 lanes_random(C8Lanes* l, size_t lane)
+{
+    UBIT64 rng = l->rng[lane];
+
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    l->rng[lane] = rng;
+
+    return (UBIT8)((rng * 0x2545F4914F6CDD1DULL) >> 56);
+}
+
+/* This function performs DRW Vx, Vy, nibble on a lane (see c8_draw_lores) */
+static void lanes_draw(C8Lanes* l, size_t lane, UBIT8 vx, UBIT8 vy, UBIT8 nibble)
+{
+    UBIT64* plane = &l->display[lane * DISP_H];
+    UBIT8 shift = LANE_V(l, vx, lane) % DISP_W;
+    UBIT8 top = LANE_V(l, vy, lane);
+    UBIT8 rows = (nibble == 0) ? 16 : nibble;
+    UBIT32 addr = l->index[lane];
+    UBIT64 collision = 0;
+    UBIT64 drawn = 0;
+
+    for(UBIT8 y = 0; y < rows; y++)
+    {
+        UBIT64 sprite = 0;
+        UBIT64 line = 0;
+        UBIT64* row = &plane[(top + y) % DISP_H];
+
+        if(nibble == 0)
+        {
+            sprite = ((UBIT64)lanes_peek(l, lane, (addr + 2 * y) & (C8_RAM_SIZE - 1)) << 56)
+                   | ((UBIT64)lanes_peek(l, lane, (addr + 2 * y + 1) & (C8_RAM_SIZE - 1)) << 48);
+        }
+        else
+        {
+            sprite = (UBIT64)lanes_peek(l, lane, (addr + y) & (C8_RAM_SIZE - 1)) << 56;
+        }
+
+        line = (sprite >> shift) | (sprite << ((DISP_W - shift) % DISP_W));
+        collision |= *row & line;
+        drawn |= line;
+        *row ^= line;
+    }
+
+    LANE_V(l, 0xF, lane) = (collision != 0) ? 1 : 0;
+
+    if(drawn != 0)
+    {
+        l->display_dirty[lane] = 1;
+    }
+}
+
+/* This function performs the 8xyN register instructions on a lane */
+static void lanes_alu(C8Lanes* l, size_t lane, UBIT8 vx, UBIT8 vy, UBIT8 n)
+{
+    UBIT16 sum = 0;
+
+    switch(n)
+    {
+    case 0x0:
+        LANE_V(l, vx, lane) = LANE_V(l, vy, lane);
+        break;
+    case 0x1:
+        LANE_V(l, vx, lane) |= LANE_V(l, vy, lane);
+        break;
+    case 0x2:
+        LANE_V(l, vx, lane) &= LANE_V(l, vy, lane);
+        break;
+    case 0x3:
+        LANE_V(l, vx, lane) ^= LANE_V(l, vy, lane);
+        break;
+    case 0x4:
+        sum = LANE_V(l, vx, lane) + LANE_V(l, vy, lane);
+        LANE_V(l, 0xF, lane) = (sum > 255) ? 1 : 0;
+        LANE_V(l, vx, lane) = sum & 0xFF;
+        break;
+    case 0x5:
+        LANE_V(l, 0xF, lane) = (LANE_V(l, vx, lane) > LANE_V(l, vy, lane)) ? 1 : 0;
+        LANE_V(l, vx, lane) -= LANE_V(l, vy, lane);
+        break;
+    case 0x6:
+        LANE_V(l, 0xF, lane) = LANE_V(l, vx, lane) & 0x01;
+        LANE_V(l, vx, lane) >>= 1;
+        break;
+    case 0x7:
+        LANE_V(l, 0xF, lane) = (LANE_V(l, vx, lane) > LANE_V(l, vy, lane)) ? 1 : 0;
+        LANE_V(l, vx, lane) = LANE_V(l, vy, lane) - LANE_V(l, vx, lane);
+        break;
+    case 0xE:
+        LANE_V(l, 0xF, lane) = (LANE_V(l, vx, lane) & 0x80) ? 1 : 0;
+        LANE_V(l, vx, lane) <<= 1;
+        break;
+    default:
+        break;
+    }
+}
+
+/* This function performs the FxNN instructions on a lane, returns the next pc */
+static UBIT16 lanes_misc(C8Lanes* l, size_t lane, UBIT8 vx, UBIT8 kk)
+{
+    UBIT16 pc = l->pc[lane];
+    UBIT32 index = l->index[lane];
+
+    switch(kk)
+    {
+    case 0x07:
+        LANE_V(l, vx, lane) = l->delay_timer[lane];
+        break;
+    case 0x0A:
+        /* A key already held completes the instruction right away */
+        if(l->keys[lane] != 0)
+        {
+            LANE_V(l, vx, lane) = 31 - __builtin_clz(l->keys[lane]);
+        }
+        else
+        {
+            l->waiting_key[lane] = 1;
+            l->key_register[lane] = vx;
+        }
+        break;
+    case 0x15:
+        l->delay_timer[lane] = LANE_V(l, vx, lane);
+        break;
+    case 0x18:
+        l->sound_timer[lane] = LANE_V(l, vx, lane);
+        break;
+    case 0x1E:
+        LANE_V(l, 0xF, lane) = (index + LANE_V(l, vx, lane) > 0xFFF) ? 1 : 0;
+        l->index[lane] = index + LANE_V(l, vx, lane);
+        break;
+    case 0x29:
+        l->index[lane] = LANE_V(l, vx, lane) * FONTSET_SPRITE;
+        break;
+    case 0x33:
+        if(index + 3 > C8_MEM_SIZE)
+        {
+            l->status[lane] = C8_LANE_FAULT;
+            return pc;
+        }
+        l->memory[lane * C8_MEM_SIZE + index] = (LANE_V(l, vx, lane) / 100) % 10;
+        l->memory[lane * C8_MEM_SIZE + index + 1] = (LANE_V(l, vx, lane) / 10) % 10;
+        l->memory[lane * C8_MEM_SIZE + index + 2] = LANE_V(l, vx, lane) % 10;
+        lanes_mark(l, lane, index, 3);
+        break;
+    case 0x55:
+        if(index + vx + 1 > C8_MEM_SIZE)
+        {
+            l->status[lane] = C8_LANE_FAULT;
+            return pc;
+        }
+        for(UBIT8 i = 0; i <= vx; i++)
+            l->memory[lane * C8_MEM_SIZE + index + i] = LANE_V(l, i, lane);
+        lanes_mark(l, lane, index, vx + 1);
+        break;
+    case 0x65:
+        for(UBIT8 i = 0; i <= vx; i++)
+            LANE_V(l, i, lane) = lanes_peek(l, lane, index + i);
+        break;
+    case 0x00:
+    case 0x02:
+        /* F000 and F002 are XO-CHIP, Fx00 and Fx02 stay on the instruction */
+        if(vx == 0)
+            l->status[lane] = C8_LANE_FAULT;
+        return pc;
+    case 0x01:
+    case 0x30:
+    case 0x3A:
+    case 0x75:
+    case 0x85:
+        l->status[lane] = C8_LANE_FAULT;
+        return pc;
+    default:
+        return pc;
+    }
+
+    return pc + 2;
+}
+
+/* This function executes one instruction (_word_ is the opcode and the word */
+/* after it) on a lane, following c8_process_instruction                     */
+static void lanes_scalar(C8Lanes* l, size_t lane, UBIT32 word)
+{
+    UBIT16 opcode = word >> 16;
+    UBIT8 vx = (opcode & 0x0F00) >> 8;
+    UBIT8 vy = (opcode & 0x00F0) >> 4;
+    UBIT8 kk = opcode & 0x00FF;
+    UBIT16 nnn = opcode & 0x0FFF;
+    UBIT16 pc = l->pc[lane];
+    UBIT16 next = pc + 2;
+    UBIT16 skip = pc + (((word & 0xFFFF) == 0xF000) ? 6 : 4);
+    UBIT8 key = 0;
+
+    switch(opcode >> 12)
+    {
+    case 0x0:
+        if(opcode == 0x00E0)
+        {
+            UBIT64* plane = &l->display[lane * DISP_H];
+
+            for(int i = 0; i < DISP_H; i++)
+            {
+                if(plane[i] != 0)
+                    l->display_dirty[lane] = 1;
+            }
+
+            memset(plane, 0, DISP_H * sizeof(UBIT64));
+        }
+        else if(opcode == 0x00EE)
+        {
+            if(l->sp[lane] == 0)
+            {
+                l->status[lane] = C8_LANE_FAULT;
+                return;
+            }
+
+            next = l->stack[lane * 16 + --l->sp[lane]] + 2;
+        }
+        else if(c8_is_ext_0(opcode))
+        {
+            l->status[lane] = C8_LANE_FAULT;
+            return;
+        }
+        break;
+    case 0x1:
+        next = nnn;
+        break;
+    case 0x2:
+        if(l->sp[lane] >= 16)
+        {
+            l->status[lane] = C8_LANE_FAULT;
+            return;
+        }
+
+        l->stack[lane * 16 + l->sp[lane]++] = pc;
+        next = nnn;
+        break;
+    case 0x3:
+        if(LANE_V(l, vx, lane) == kk)
+            next = skip;
+        break;
+    case 0x4:
+        if(LANE_V(l, vx, lane) != kk)
+            next = skip;
+        break;
+    case 0x5:
+        if(c8_is_ext_5(opcode))
+        {
+            l->status[lane] = C8_LANE_FAULT;
+            return;
+        }
+
+        if(LANE_V(l, vx, lane) == LANE_V(l, vy, lane))
+            next = skip;
+        break;
+    case 0x6:
+        LANE_V(l, vx, lane) = kk;
+        break;
+    case 0x7:
+        LANE_V(l, vx, lane) += kk;
+        break;
+    case 0x8:
+        lanes_alu(l, lane, vx, vy, opcode & 0xF);
+        break;
+    case 0x9:
+        if(LANE_V(l, vx, lane) != LANE_V(l, vy, lane))
+            next = skip;
+        break;
+    case 0xA:
+        l->index[lane] = nnn;
+        break;
+    case 0xB:
+        next = nnn + LANE_V(l, 0x0, lane);
+        break;
+    case 0xC:
+        LANE_V(l, vx, lane) = lanes_random(l, lane) & kk;
+        break;
+    case 0xD:
+        lanes_draw(l, lane, vx, vy, opcode & 0xF);
+        break;
+    case 0xE:
+        /* There are no keys above F, they read as released */
+        key = LANE_V(l, vx, lane);
+        if(kk == 0x9E && key < 16 && ((l->keys[lane] >> key) & 1))
+            next = skip;
+        if(kk == 0xA1 && (key >= 16 || ((l->keys[lane] >> key) & 1) == 0))
+            next = skip;
+        break;
+    default:
+        next = lanes_misc(l, lane, vx, kk);
+        break;
+    }
+
+    l->pc[lane] = next;
+}
+
+#if defined(C8_LANES_X86)
+
+/* This function widens a mask of 32 lanes to one byte per lane, 0xFF when set */
+__attribute__((target("avx2,popcnt")))
+static inline __m256i lanes_mask8(UBIT32 mask)
+{
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(0x8040201008040201LL);
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int)mask), spread);
+
+    return _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+}
+
+/* This function stores the lanes of _v_ selected by the byte mask _m_ */
+__attribute__((target("avx2,popcnt")))
+static inline void lanes_store8(UBIT8* p, __m256i m, __m256i v)
+{
+    __m256i old = _mm256_load_si256((const __m256i*)p);
+
+    _mm256_store_si256((__m256i*)p, _mm256_blendv_epi8(old, v, m));
+}
+
+/* This function stores 32 16-bit lanes, _lo_ and _hi_ hold lanes 0-15 and 16-31 */
+__attribute__((target("avx2,popcnt")))
+static inline void lanes_store16(uint16_t* p, __m256i m, __m256i lo, __m256i hi)
+{
+    __m256i mlo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(m));
+    __m256i mhi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(m, 1));
+    __m256i old_lo = _mm256_load_si256((const __m256i*)p);
+    __m256i old_hi = _mm256_load_si256((const __m256i*)(p + 16));
+
+    _mm256_store_si256((__m256i*)p, _mm256_blendv_epi8(old_lo, lo, mlo));
+    _mm256_store_si256((__m256i*)(p + 16), _mm256_blendv_epi8(old_hi, hi, mhi));
+}
+
+/* This function returns 1 in the lanes where a > b (unsigned), 0 elsewhere */
+__attribute__((target("avx2,popcnt")))
+static inline __m256i lanes_gt8(__m256i a, __m256i b)
+{
+    return _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a), _mm256_set1_epi8(1));
+}
+
+/* This function performs the 8xyN register instructions on the lanes of _m_.   */
+/* As in the switch interpreter, VF is written first and Vx reads it back when */
+/* x or y is F.                                                                 */
+__attribute__((target("avx2,popcnt")))
+static void lanes_alu_avx2(UBIT8* vx, UBIT8* vy, UBIT8* vf, __m256i m, UBIT8 n)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i a = _mm256_load_si256((const __m256i*)vx);
+    __m256i b = _mm256_load_si256((const __m256i*)vy);
+    __m256i r = _mm256_setzero_si256();
+
+    switch(n)
+    {
+    case 0x0:
+        lanes_store8(vx, m, b);
+        break;
+    case 0x1:
+        lanes_store8(vx, m, _mm256_or_si256(a, b));
+        break;
+    case 0x2:
+        lanes_store8(vx, m, _mm256_and_si256(a, b));
+        break;
+    case 0x3:
+        lanes_store8(vx, m, _mm256_xor_si256(a, b));
+        break;
+    case 0x4:
+        /* The saturated sum differs from the wrapped one on a carry */
+        r = _mm256_add_epi8(a, b);
+        lanes_store8(vf, m, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(a, b), r), one));
+        lanes_store8(vx, m, r);
+        break;
+    case 0x5:
+        lanes_store8(vf, m, lanes_gt8(a, b));
+        a = _mm256_load_si256((const __m256i*)vx);
+        b = _mm256_load_si256((const __m256i*)vy);
+        lanes_store8(vx, m, _mm256_sub_epi8(a, b));
+        break;
+    case 0x6:
+        lanes_store8(vf, m, _mm256_and_si256(a, one));
+        a = _mm256_load_si256((const __m256i*)vx);
+        lanes_store8(vx, m, _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)));
+        break;
+    case 0x7:
+        lanes_store8(vf, m, lanes_gt8(a, b));
+        a = _mm256_load_si256((const __m256i*)vx);
+        b = _mm256_load_si256((const __m256i*)vy);
+        lanes_store8(vx, m, _mm256_sub_epi8(b, a));
+        break;
+    case 0xE:
+        lanes_store8(vf, m, _mm256_and_si256(_mm256_srli_epi16(a, 7), one));
+        a = _mm256_load_si256((const __m256i*)vx);
+        lanes_store8(vx, m, _mm256_add_epi8(a, a));
+        break;
+    default:
+        break;
+    }
+}
+
+/* This function executes one instruction on the lanes of _mask_ in the group */
+/* starting at lane _g_, which all sit at _pc_ with the same _word_. Returns 0  */
+/* for the instructions left to lanes_scalar.                                   */
+__attribute__((target("avx2,popcnt")))
+static int lanes_avx2(C8Lanes* l, size_t g, UBIT32 mask, UBIT32 word, UBIT16 pc)
+{
+    UBIT16 opcode = word >> 16;
+    UBIT8 kk = opcode & 0x00FF;
+    UBIT8* vx = &l->registers[((opcode & 0x0F00) >> 8) * l->count + g];
+    UBIT8* vy = &l->registers[((opcode & 0x00F0) >> 4) * l->count + g];
+    UBIT8* vf = &l->registers[0xF * l->count + g];
+    UBIT16 next = pc + 2;
+    UBIT16 skip = pc + (((word & 0xFFFF) == 0xF000) ? 6 : 4);
+    __m256i m = lanes_mask8(mask);
+    __m256i a = _mm256_load_si256((const __m256i*)vx);
+    __m256i b = _mm256_load_si256((const __m256i*)vy);
+    __m256i taken = _mm256_setzero_si256(); /* Lanes taking the skip */
+    __m256i lo = _mm256_setzero_si256();
+    __m256i hi = _mm256_setzero_si256();
+    __m256i flag = _mm256_setzero_si256();
+
+    switch(opcode >> 12)
+    {
+    case 0x1:
+        next = opcode & 0x0FFF;
+        break;
+    case 0x3:
+        taken = _mm256_cmpeq_epi8(a, _mm256_set1_epi8(kk));
+        break;
+    case 0x4:
+        taken = _mm256_xor_si256(_mm256_cmpeq_epi8(a, _mm256_set1_epi8(kk)), _mm256_set1_epi8(-1));
+        break;
+    case 0x5:
+        if(c8_is_ext_5(opcode))
+            return 0;
+        taken = _mm256_cmpeq_epi8(a, b);
+        break;
+    case 0x6:
+        lanes_store8(vx, m, _mm256_set1_epi8(kk));
+        break;
+    case 0x7:
+        lanes_store8(vx, m, _mm256_add_epi8(a, _mm256_set1_epi8(kk)));
+        break;
+    case 0x8:
+        lanes_alu_avx2(vx, vy, vf, m, opcode & 0xF);
+        break;
+    case 0x9:
+        taken = _mm256_xor_si256(_mm256_cmpeq_epi8(a, b), _mm256_set1_epi8(-1));
+        break;
+    case 0xA:
+        lo = _mm256_set1_epi16(opcode & 0x0FFF);
+        lanes_store16(&l->index[g], m, lo, lo);
+        break;
+    case 0xF:
+        switch(kk)
+        {
+        case 0x07:
+            lanes_store8(vx, m, _mm256_load_si256((const __m256i*)&l->delay_timer[g]));
+            break;
+        case 0x15:
+            lanes_store8(&l->delay_timer[g], m, a);
+            break;
+        case 0x18:
+            lanes_store8(&l->sound_timer[g], m, a);
+            break;
+        case 0x1E:
+            /* VF = I + Vx > 0xFFF, the 16-bit sum may also wrap */
+            lo = _mm256_load_si256((const __m256i*)&l->index[g]);
+            hi = _mm256_load_si256((const __m256i*)&l->index[g + 16]);
+            {
+                __m256i slo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)));
+                __m256i shi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)));
+                __m256i limit = _mm256_set1_epi16(0xFFF);
+                __m256i flo = _mm256_or_si256(_mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_min_epu16(slo, limit), slo), _mm256_set1_epi16(-1)),
+                                              _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(slo, lo), slo), _mm256_set1_epi16(-1)));
+                __m256i fhi = _mm256_or_si256(_mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_min_epu16(shi, limit), shi), _mm256_set1_epi16(-1)),
+                                              _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(shi, hi), shi), _mm256_set1_epi16(-1)));
+
+                /* packs works per 128-bit half, the permute puts lanes 0-31 back in order */
+                flag = _mm256_permute4x64_epi64(_mm256_packs_epi16(flo, fhi), 0xD8);
+                lanes_store8(vf, m, _mm256_and_si256(flag, _mm256_set1_epi8(1)));
+            }
+            a = _mm256_load_si256((const __m256i*)vx);
+            lanes_store16(&l->index[g], m,
+                          _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(a))),
+                          _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1))));
+            break;
+        case 0x29:
+            lanes_store16(&l->index[g], m,
+                          _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)), _mm256_set1_epi16(FONTSET_SPRITE)),
+                          _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)), _mm256_set1_epi16(FONTSET_SPRITE)));
+            break;
+        default:
+            return 0;
+        }
+        break;
+    default:
+        return 0;
+    }
+
+    lo = _mm256_set1_epi16(next);
+    lanes_store16(&l->pc[g], m, lo, lo);
+
+    taken = _mm256_and_si256(taken, m);
+    if(_mm256_testz_si256(taken, taken) == 0)
+    {
+        lo = _mm256_set1_epi16(skip);
+        lanes_store16(&l->pc[g], taken, lo, lo);
+    }
+
+    return 1;
+}
+
+#endif /* C8_LANES_X86 */
+
+/* This function steps the group of lanes starting at lane _g_ one lane at a */
+/* time, returns the instructions executed                                  */
+static unsigned lanes_step(C8Lanes* l, size_t g)
+{
+    unsigned executed = 0;
+
+    for(size_t lane = g; lane < g + C8_LANE_GROUP; lane++)
+    {
+        UBIT16 pc = l->pc[lane];
+
+        if(l->status[lane] != C8_LANE_RUNNING || l->waiting_key[lane])
+        {
+            continue;
+        }
+
+        if(pc > C8_MEM_SIZE - 2)
+        {
+            l->status[lane] = C8_LANE_FAULT;
+            continue;
+        }
+
+        lanes_scalar(l, lane, ((UBIT32)lanes_peek(l, lane, pc) << 24) | ((UBIT32)lanes_peek(l, lane, pc + 1) << 16)
+                              | ((UBIT32)lanes_peek(l, lane, pc + 2) << 8) | lanes_peek(l, lane, pc + 3));
+        executed++;
+    }
+
+    return executed;
+}
+
+#if defined(C8_LANES_X86)
+
+/* This function tells whether no lane of a group stored to the word at _addr_ */
+/* or the one after it                                                          */
+static inline int lanes_clean(const UBIT64* written, UBIT32 addr)
+{
+    UBIT64 bits = written[addr / 64] >> (addr % 64);
+
+    if(addr % 64 > 60)
+    {
+        bits |= written[addr / 64 + 1] << (64 - addr % 64);
+    }
+
+    return (bits & 0xF) == 0;
+}
+
+/* This function packs the 16-bit lane masks _lo_ and _hi_ into one bit per lane */
+__attribute__((target("avx2,popcnt")))
+static inline UBIT32 lanes_bits16(__m256i lo, __m256i hi)
+{
+    /* packs works per 128-bit half, the permute puts lanes 0-31 back in order */
+    return (UBIT32)_mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8));
+}
+
+/* This function returns the lanes of a group whose pc is above _limit_ */
+__attribute__((target("avx2,popcnt")))
+static inline UBIT32 lanes_above(__m256i pc_lo, __m256i pc_hi, UBIT16 limit)
+{
+    __m256i m = _mm256_set1_epi16(limit);
+
+    return ~lanes_bits16(_mm256_cmpeq_epi16(_mm256_min_epu16(pc_lo, m), pc_lo),
+                         _mm256_cmpeq_epi16(_mm256_min_epu16(pc_hi, m), pc_hi));
+}
+
+/* This function returns the lanes of a group whose pc is _pc_ */
+__attribute__((target("avx2,popcnt")))
+static inline UBIT32 lanes_at(__m256i pc_lo, __m256i pc_hi, UBIT16 pc)
+{
+    __m256i p = _mm256_set1_epi16(pc);
+
+    return lanes_bits16(_mm256_cmpeq_epi16(pc_lo, p), _mm256_cmpeq_epi16(pc_hi, p));
+}
+
+/* This function steps the group of lanes starting at lane _g_ in lockstep,  */
+/* returns the instructions executed. When every lane sits at one pc that no */
+/* lane stored to, the word comes from the image. Otherwise the words at pc  */
+/* are gathered for all 32 lanes; lanes at the same pc with the same word    */
+/* (the instruction and the one after it, for the skips) run together and   */
+/* the rest wait their turn.                                                 */
+__attribute__((target("avx2,popcnt")))
+static unsigned lanes_step_avx2(C8Lanes* l, size_t g)
+{
+    const __m256i offsets = _mm256_setr_epi32(0, C8_MEM_SIZE, 2 * C8_MEM_SIZE, 3 * C8_MEM_SIZE,
+                                              4 * C8_MEM_SIZE, 5 * C8_MEM_SIZE, 6 * C8_MEM_SIZE, 7 * C8_MEM_SIZE);
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const UBIT8* memory = &l->memory[g * C8_MEM_SIZE];
+    const UBIT64* written = &l->written[g / C8_LANE_GROUP * (C8_MEM_SIZE / 64)];
+    __m256i idle = _mm256_or_si256(_mm256_load_si256((const __m256i*)&l->status[g]),
+                                   _mm256_load_si256((const __m256i*)&l->waiting_key[g]));
+    __m256i pc_lo = _mm256_load_si256((const __m256i*)&l->pc[g]);
+    __m256i pc_hi = _mm256_load_si256((const __m256i*)&l->pc[g + 16]);
+    __m256i words[C8_LANE_GROUP / 8];
+    UBIT32 pending = (UBIT32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(idle, _mm256_setzero_si256()));
+    UBIT32 mask = 0;
+    UBIT32 word = 0;
+    UBIT16 pc = 0;
+    unsigned executed = __builtin_popcount(pending);
+
+    if(pending == 0)
+    {
+        return 0;
+    }
+
+    /* Near the end of memory the gathers would read past the lane */
+    if((lanes_above(pc_lo, pc_hi, C8_MEM_SIZE - 4) & pending) != 0)
+    {
+        return lanes_step(l, g);
+    }
+
+    pc = l->pc[g + __builtin_ctz(pending)];
+
+    if((lanes_at(pc_lo, pc_hi, pc) & pending) == pending && lanes_clean(written, pc))
+    {
+        word = ((UBIT32)l->image[pc] << 24) | ((UBIT32)l->image[pc + 1] << 16)
+             | ((UBIT32)l->image[pc + 2] << 8) | l->image[pc + 3];
+
+        if(lanes_avx2(l, g, pending, word, pc) == 0)
+        {
+            for(; pending != 0; pending &= pending - 1)
+            {
+                lanes_scalar(l, g + __builtin_ctz(pending), word);
+            }
+        }
+
+        return executed;
+    }
+
+    for(int i = 0; i < C8_LANE_GROUP / 8; i++)
+    {
+        __m128i half = (i & 1) ? _mm256_extracti128_si256((i < 2) ? pc_lo : pc_hi, 1)
+                               : _mm256_castsi256_si128((i < 2) ? pc_lo : pc_hi);
+        __m256i at = _mm256_add_epi32(_mm256_cvtepu16_epi32(half), offsets);
+
+        words[i] = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int*)(memory + 8 * i * C8_MEM_SIZE), at, 1), bswap);
+    }
+
+    while(pending != 0)
+    {
+        int lead = __builtin_ctz(pending);
+        __m256i w = _mm256_setzero_si256();
+
+        word = ((const UBIT32*)words)[lead];
+        pc = l->pc[g + lead];
+        w = _mm256_set1_epi32((int)word);
+        mask = 0;
+
+        for(int i = 0; i < C8_LANE_GROUP / 8; i++)
+        {
+            mask |= (UBIT32)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(words[i], w))) << (8 * i);
+        }
+
+        mask &= lanes_at(pc_lo, pc_hi, pc) & pending;
+        pending &= ~mask;
+
+        if(lanes_avx2(l, g, mask, word, pc))
+            continue;
+
+        for(; mask != 0; mask &= mask - 1)
+        {
+            lanes_scalar(l, g + __builtin_ctz(mask), word);
+        }
+    }
+
+    return executed;
+}
+
+#endif /* C8_LANES_X86 */
+
+unsigned long c8_lanes_run(C8Lanes* l, unsigned long cycles)
+{
+    unsigned long executed = 0;
+
+    /* Lanes are independent between timer ticks, so each group runs all */
+    /* of its cycles while its registers and memory are in cache         */
+    for(size_t g = 0; g < l->count; g += C8_LANE_GROUP)
+    {
+        for(unsigned long c = 0; c < cycles; c++)
+        {
+#if defined(C8_LANES_X86)
+            if(l->simd)
+            {
+                executed += lanes_step_avx2(l, g);
+                continue;
+            }
+#endif
+            executed += lanes_step(l, g);
+        }
+    }
+
+    return executed;
+}
+
+void c8_lanes_tick_timers(C8Lanes* l)
+{
+    l->frame++;
+
+    for(size_t i = 0; i < l->count; i++)
+    {
+        l->delay_timer[i] -= (l->delay_timer[i] != 0);
+        l->sound_timer[i] -= (l->sound_timer[i] != 0);
+    }
+}
+
+unsigned long c8_lanes_run_frame(C8Lanes* l, unsigned long ipf)
+{
+    unsigned long executed = c8_lanes_run(l, ipf);
+
+    c8_lanes_tick_timers(l);
+
+    return executed;
+}
@@ -0,0 +1,106 @@
+#ifndef CHIP8_LANES_H
+#define CHIP8_LANES_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* Lockstep lanes                                                       */
+/*                                                                      */
+/* Runs many CHIP-8 machines side by side, for sweeps and training runs */
+/* where thousands of copies of one ROM only differ by their inputs and */
+/* seeds. The hot state is stored as structure of arrays: V0...VF, PC,  */
+/* I and the timers of lane i sit at index i of one array per register, */
+/* so 32 lanes fill one AVX2 register of 8-bit registers.               */
+/*                                                                      */
+/* A step runs one instruction on every lane. Each group of 32 lanes is */
+/* split by (pc, opcode): the lanes agreeing with the first pending one */
+/* execute together under a mask, then the next set, until the whole    */
+/* group stepped. Lanes running the same code rarely diverge, so most   */
+/* steps are a single masked instruction per group, fetched once from   */
+/* the shared program image unless a lane of the group stored over it   */
+/* (then every lane fetches its own copy). Register, skip,              */
+/* jump, I and timer instructions are vector blends; CLS, DRW, RND, the */
+/* stack, the keys and the memory transfers run per lane.               */
+/*                                                                      */
+/* Lanes model the CHIP-8 machine: 4 KB of memory and the 64x32         */
+/* display. A lane halts with C8_LANE_FAULT on SUPER-CHIP and XO-CHIP   */
+/* instructions, stack overflow or underflow, code past 4 KB and stores */
+/* past 4 KB. Reads past 4 KB return 0 and keys above F read as         */
+/* released. Everything else matches the switch interpreter without   */
+/* quirks (c8_set_quirks) instruction for instruction.                  */
+
+#define C8_LANE_GROUP 32 /* Lanes per AVX2 register of 8-bit registers */
+
+/* Lane status */
+enum {
+    C8_LANE_RUNNING = 0,
+    C8_LANE_FAULT   = 1  /* Halted on something lanes do not model */
+};
+
+typedef struct
+{
+    size_t    count;         /* Lanes, a multiple of C8_LANE_GROUP */
+    UBIT8*    registers;     /* V0...VF, Vx of lane i is registers[x * count + i] */
+    uint16_t* pc;
+    uint16_t* index;
+    UBIT8*    delay_timer;
+    UBIT8*    sound_timer;
+    UBIT8*    sp;
+    uint16_t* stack;         /* 16 levels per lane, stack[i * 16 + level] */
+    uint16_t* keys;          /* Keys held, bit k is key k */
+    UBIT8*    waiting_key;   /* Parked by FX0A until a key is pressed */
+    UBIT8*    key_register;
+    UBIT8*    display_dirty; /* Display changed since cleared by the caller */
+    UBIT8*    status;        /* C8_LANE_* */
+    UBIT64*   rng;           /* Cxkk PRNG states */
+    UBIT8*    memory;        /* C8_MEM_SIZE bytes per lane */
+    UBIT8*    image;         /* Memory every lane started from (c8_lanes_load) */
+    UBIT64*   written;       /* Per group, bit a is set when a lane may differ from _image_ at address a */
+    UBIT64*   display;       /* DISP_H rows per lane, MSB is x = 0 */
+    UBIT64    frame;         /* Timer ticks, shared by every lane */
+    int       simd;          /* The AVX2 kernels are in use, clear to run every lane in scalar code */
+} C8Lanes;
+
+/* This function allocates _count_ lanes (rounded up to C8_LANE_GROUP), all */
+/* running a blank machine. Returns NULL when out of memory.               */
+C8Lanes* c8_lanes_create(size_t count);
+
+/* This function releases the lanes */
+void c8_lanes_free(C8Lanes* lanes);
+
+/* This function resets every lane to a fresh machine running _program_,  */
+/* lane i seeded with _seed_ + i. Returns 0 on success, 1 if it does not  */
+/* fit in 4 KB.                                                           */
+int c8_lanes_load(C8Lanes* lanes, const UBIT8* program, size_t size, UBIT64 seed);
+
+/* This function copies a machine into lane _lane_. Returns 0 on success, */
+/* 1 if it uses a high resolution or second plane display, or quirks.     */
+int c8_lanes_set(C8Lanes* lanes, size_t lane, const Chip8* chip8);
+
+/* This function copies lane _lane_ into an initialised machine */
+void c8_lanes_get(const C8Lanes* lanes, size_t lane, Chip8* chip8);
+
+/* This function seeds the Cxkk PRNG of one lane, like c8_seed */
+void c8_lanes_seed(C8Lanes* lanes, size_t lane, UBIT64 seed);
+
+/* This function updates a key of one lane, a press resumes a pending FX0A */
+void c8_lanes_key_event(C8Lanes* lanes, size_t lane, UBIT8 key, STD_BOOL pressed);
+
+/* This function runs _cycles_ steps, each one instruction on every running */
+/* lane. Returns the instructions executed over all lanes.                  */
+unsigned long c8_lanes_run(C8Lanes* lanes, unsigned long cycles);
+
+/* This function decrements the timers of every lane (60Hz) */
+void c8_lanes_tick_timers(C8Lanes* lanes);
+
+/* This function runs _ipf_ steps followed by a timer tick */
+unsigned long c8_lanes_run_frame(C8Lanes* lanes, unsigned long ipf);
+
+/* This function returns the rows of the display of one lane */
+static inline const UBIT64* c8_lanes_display(const C8Lanes* lanes, size_t lane)
+{
+    return &lanes->display[lane * DISP_H];
+}
+
+#endif /* CHIP8_LANES_H */
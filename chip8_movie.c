@@ -0,0 +1,208 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_movie.h"
+
+/* ---- Movies ---- */
+
+UBIT32 c8_program_hash(const Chip8* chip8)
+{
+    UBIT32 hash = 2166136261u; /* FNV offset basis */
+    int used = 0;
+
+    for(int i = 0x200; i < C8_MEM_SIZE; i++)
+    {
+        hash ^= chip8->memory[i];
+        hash *= 16777619u; /* FNV prime */
+    }
+
+    /* XO-CHIP memory only counts when used, CHIP-8 hashes are unchanged */
+    for(int i = C8_MEM_SIZE; i < C8_RAM_SIZE && !used; i++)
+    {
+        used = (chip8->memory[i] != 0);
+    }
+
+    for(int i = C8_MEM_SIZE; i < C8_RAM_SIZE && used; i++)
+    {
+        hash ^= chip8->memory[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void c8_movie_start(C8Movie* movie, Chip8* chip8, UBIT64 seed, unsigned long ipf)
+{
+    memset(movie, 0, sizeof(C8Movie));
+
+    movie->rom_hash = c8_program_hash(chip8);
+    movie->seed = seed;
+    movie->ipf = ipf;
+
+    c8_seed(chip8, seed);
+}
+
+static int movie_append(C8Movie* movie, UBIT64 frame, UBIT8 key, UBIT8 pressed)
+{
+    if(movie->count == movie->capacity)
+    {
+        size_t capacity = (movie->capacity == 0) ? 256 : movie->capacity * 2;
+        C8MovieEvent* events = realloc(movie->events, capacity * sizeof(C8MovieEvent));
+
+        if(events == NULL)
+        {
+            return 1;
+        }
+
+        movie->events = events;
+        movie->capacity = capacity;
+    }
+
+    movie->events[movie->count].frame = frame;
+    movie->events[movie->count].key = key & 0xF;
+    movie->events[movie->count].pressed = pressed ? 1 : 0;
+    movie->count++;
+
+    return 0;
+}
+
+int c8_movie_record(C8Movie* movie, const Chip8* chip8, UBIT8 key, STD_BOOL pressed)
+{
+    return movie_append(movie, chip8->frame, key, (pressed == STD_TRUE) ? 1 : 0);
+}
+
+void c8_movie_stop(C8Movie* movie, const Chip8* chip8)
+{
+    movie->frames = chip8->frame;
+    movie->display_hash = c8_display_hash(chip8);
+}
+
+void c8_movie_free(C8Movie* movie)
+{
+    free(movie->events);
+    memset(movie, 0, sizeof(C8Movie));
+}
+
+int c8_movie_write(const C8Movie* movie, const char* filename)
+{
+    FILE* f = NULL;
+    int ret = 0;
+
+    if(!(f = fopen(filename, "w")))
+    {
+        return 1;
+    }
+
+    fprintf(f, "C8MOVIE %d\n", C8_MOVIE_VERSION);
+    fprintf(f, "rom %08" PRIx32 " seed %" PRIx64 " ipf %lu\n", movie->rom_hash, movie->seed, movie->ipf);
+
+    for(size_t i = 0; i < movie->count; i++)
+    {
+        fprintf(f, "%" PRIu64 " %X %u\n", movie->events[i].frame, movie->events[i].key, movie->events[i].pressed);
+    }
+
+    fprintf(f, "end %" PRIu64 " %08" PRIx32 "\n", movie->frames, movie->display_hash);
+
+    if(ferror(f))
+    {
+        ret = 1;
+    }
+
+    if(fclose(f) != 0)
+    {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+int c8_movie_read(C8Movie* movie, const char* filename)
+{
+    FILE* f = NULL;
+    char line[128];
+    int version = 0;
+    int done = 0;
+
+    memset(movie, 0, sizeof(C8Movie));
+
+    if(!(f = fopen(filename, "r")))
+    {
+        return 1;
+    }
+
+    if(fgets(line, sizeof(line), f) == NULL || sscanf(line, "C8MOVIE %d", &version) != 1 ||
+       version != C8_MOVIE_VERSION ||
+       fgets(line, sizeof(line), f) == NULL ||
+       sscanf(line, "rom %" SCNx32 " seed %" SCNx64 " ipf %lu", &movie->rom_hash, &movie->seed, &movie->ipf) != 3)
+    {
+        fclose(f);
+        return 1;
+    }
+
+    while(done == 0 && fgets(line, sizeof(line), f) != NULL)
+    {
+        UBIT64 frame = 0;
+        unsigned key = 0;
+        unsigned pressed = 0;
+
+        if(sscanf(line, "end %" SCNu64 " %" SCNx32, &movie->frames, &movie->display_hash) == 2)
+        {
+            done = 1;
+        }
+        else if(sscanf(line, "%" SCNu64 " %x %u", &frame, &key, &pressed) != 3 ||
+                (movie->count > 0 && frame < movie->events[movie->count - 1].frame) ||
+                movie_append(movie, frame, key, pressed) != 0)
+        {
+            break;
+        }
+    }
+
+    fclose(f);
+
+    if(done == 0)
+    {
+        c8_movie_free(movie);
+        return 1;
+    }
+
+    return 0;
+}
+
+unsigned long c8_movie_step(const C8Movie* movie, Chip8* chip8, size_t* next)
+{
+    /* Events were polled after the previous frame, apply them before this one */
+    while(*next < movie->count && movie->events[*next].frame <= chip8->frame)
+    {
+        c8_key_event(chip8, movie->events[*next].key, movie->events[*next].pressed ? STD_TRUE : STD_FALSE);
+        (*next)++;
+    }
+
+    return c8_run_frame(chip8, movie->ipf);
+}
+
+C8_MOVIE_STATUS c8_movie_play(const C8Movie* movie, Chip8* chip8, unsigned long* executed)
+{
+    unsigned long cycles = 0;
+    size_t next = 0;
+
+    if(c8_program_hash(chip8) != movie->rom_hash)
+    {
+        return C8_MOVIE_ROM;
+    }
+
+    c8_seed(chip8, movie->seed);
+
+    while(chip8->frame < movie->frames)
+    {
+        cycles += c8_movie_step(movie, chip8, &next);
+    }
+
+    if(executed != NULL)
+    {
+        *executed += cycles;
+    }
+
+    return (c8_display_hash(chip8) == movie->display_hash) ? C8_MOVIE_OK : C8_MOVIE_DESYNC;
+}
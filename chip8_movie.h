@@ -0,0 +1,80 @@
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* Movies                                                               */
+/*                                                                      */
+/* A movie replays a session from a fresh machine: ROM, PRNG seed and   */
+/* instructions per frame, then every key event stamped with the frame */
+/* (chip8->frame) before which it was applied. The text file is:        */
+/*                                                                      */
+/*   C8MOVIE 1                                                          */
+/*   rom <program hash> seed <seed> ipf <ipf>                           */
+/*   <frame> <key> <1 = down, 0 = up>           one line per event      */
+/*   end <frames> <display hash>                                        */
+
+#define C8_MOVIE_VERSION 1
+
+typedef struct
+{
+    UBIT64 frame;   /* Frame before which the event applies */
+    UBIT8  key;     /* Keypad key 0x0...0xF */
+    UBIT8  pressed; /* 1 = down, 0 = up */
+} C8MovieEvent;
+
+typedef struct
+{
+    UBIT32        rom_hash;     /* c8_program_hash right after loading */
+    UBIT64        seed;         /* c8_seed value */
+    unsigned long ipf;          /* Instructions per frame */
+    UBIT64        frames;       /* Length of the movie */
+    UBIT32        display_hash; /* Display when the movie ends */
+    C8MovieEvent* events;
+    size_t        count;
+    size_t        capacity;
+} C8Movie;
+
+typedef enum {
+    C8_MOVIE_OK      = 0, /* Replay reached the recorded display */
+    C8_MOVIE_ROM     = 1, /* The loaded ROM is not the recorded one */
+    C8_MOVIE_DESYNC  = 2  /* Replay ended on a different display */
+} C8_MOVIE_STATUS;
+
+/* This function returns a FNV-1a hash of the program memory (0x200...0xFFF, */
+/* then the XO-CHIP memory above it when any of it is set)                   */
+UBIT32 c8_program_hash(const Chip8* chip8);
+
+/* This function starts recording on a machine that just loaded its ROM: it */
+/* seeds the PRNG and stores the settings needed to replay the session      */
+void c8_movie_start(C8Movie* movie, Chip8* chip8, UBIT64 seed, unsigned long ipf);
+
+/* This function records a key event at the current frame of the machine, */
+/* returns 0 on success, 1 if out of memory                               */
+int c8_movie_record(C8Movie* movie, const Chip8* chip8, UBIT8 key, STD_BOOL pressed);
+
+/* This function closes the recording with the final frame and display */
+void c8_movie_stop(C8Movie* movie, const Chip8* chip8);
+
+/* This function releases the events of a movie */
+void c8_movie_free(C8Movie* movie);
+
+/* This function writes a movie file, returns 0 on success */
+int c8_movie_write(const C8Movie* movie, const char* filename);
+
+/* This function reads a movie file, returns 0 on success */
+int c8_movie_read(C8Movie* movie, const char* filename);
+
+/* This function applies the events due before the next frame and runs it, */
+/* returns the executed cycles. _next_ is the index of the next event, 0   */
+/* on the first frame; the replay ends once chip8->frame reaches _frames_. */
+unsigned long c8_movie_step(const C8Movie* movie, Chip8* chip8, size_t* next);
+
+/* This function replays a movie, unthrottled, on a machine that just loaded */
+/* its ROM, and checks that it ends on the recorded display. The executed   */
+/* cycles are added to _executed_ when it is not NULL.                       */
+C8_MOVIE_STATUS c8_movie_play(const C8Movie* movie, Chip8* chip8, unsigned long* executed);
+
+#endif /* CHIP8_MOVIE_H */
@@ -0,0 +1,451 @@
+#include <string.h>
+
+#include "chip8_engine.h"
+
+/* The predecoded engine keeps one decoded entry per memory address, so  */
+/* the fetch, the opcode rebuild and both switch levels are paid only    */
+/* once per address. Entries are decoded lazily on first execution and  */
+/* dropped again by c8_invalidate whenever the memory below them changes. */
+/* The quirks are resolved when decoding: the ALU instructions they     */
+/* change have a handler per variant, DRW and the FX codes run on the   */
+/* switch handlers compiled for the machine's quirk set.                */
+
+/* Threaded dispatch: with GCC/Clang every handler jumps straight to the */
+/* next one through a label table, otherwise a switch is used.           */
+#if defined(__GNUC__)
+#define C8_THREADED 1
+#endif
+
+void c8_predecode(Chip8* chip8, UBIT16 addr)
+{
+    C8Decoded* e = &chip8->decoded[addr];
+    UBIT16 opcode = (chip8->memory[addr] << 8) | chip8->memory[addr + 1];
+    UBIT8 op = C8_OP_SYS;
+    STD_BOOL vf_reset = (chip8->quirks & C8_QUIRK_VF_RESET) ? STD_TRUE : STD_FALSE;
+    STD_BOOL shift_vy = (chip8->quirks & C8_QUIRK_SHIFT_VY) ? STD_TRUE : STD_FALSE;
+
+    e->opcode = opcode;
+    e->x = (opcode & 0x0F00) >> 8;
+    e->y = (opcode & 0x00F0) >> 4;
+    e->kk = (opcode & 0x00FF);
+    e->nnn = (opcode & 0x0FFF);
+
+    switch(opcode >> 12)
+    {
+    case 0x0:
+        if(opcode == 0x00E0)
+            op = C8_OP_CLS;
+        else if(opcode == 0x00EE)
+            op = C8_OP_RET;
+        else if(c8_is_ext_0(opcode))
+            op = C8_OP_EXT;
+        break;
+    case 0x1:
+        op = C8_OP_JP;
+        break;
+    case 0x2:
+        op = C8_OP_CALL;
+        break;
+    case 0x3:
+        op = C8_OP_SE_KK;
+        break;
+    case 0x4:
+        op = C8_OP_SNE_KK;
+        break;
+    case 0x5:
+        op = c8_is_ext_5(opcode) ? C8_OP_EXT : C8_OP_SE_REG;
+        break;
+    case 0x6:
+        op = C8_OP_LD_KK;
+        break;
+    case 0x7:
+        op = C8_OP_ADD_KK;
+        break;
+    case 0x8:
+        switch(opcode & 0x000F)
+        {
+        case 0x0: op = C8_OP_LD_REG; break;
+        case 0x1: op = vf_reset ? C8_OP_OR_VF : C8_OP_OR; break;
+        case 0x2: op = vf_reset ? C8_OP_AND_VF : C8_OP_AND; break;
+        case 0x3: op = vf_reset ? C8_OP_XOR_VF : C8_OP_XOR; break;
+        case 0x4: op = C8_OP_ADD_REG; break;
+        case 0x5: op = C8_OP_SUB; break;
+        case 0x6: op = shift_vy ? C8_OP_SHR_VY : C8_OP_SHR; break;
+        case 0x7: op = C8_OP_SUBN; break;
+        case 0xE: op = shift_vy ? C8_OP_SHL_VY : C8_OP_SHL; break;
+        default: break;
+        }
+        break;
+    case 0x9:
+        op = C8_OP_SNE_REG;
+        break;
+    case 0xA:
+        op = C8_OP_LD_I;
+        break;
+    case 0xB:
+        op = C8_OP_JP_V0;
+        break;
+    case 0xC:
+        op = C8_OP_RND;
+        break;
+    case 0xD:
+        op = C8_OP_DRW;
+        break;
+    case 0xE:
+        op = C8_OP_SKEY;
+        break;
+    case 0xF:
+        switch(opcode & 0x00FF)
+        {
+        case 0x07: op = C8_OP_LD_VX_DT; break;
+        case 0x15: op = C8_OP_LD_DT; break;
+        case 0x18: op = C8_OP_LD_ST; break;
+        case 0x1E: op = C8_OP_ADD_I; break;
+        case 0x29: op = C8_OP_LD_F; break;
+        default: op = C8_OP_MISC; break;
+        }
+        break;
+    default:
+        break;
+    }
+
+    e->op = op;
+}
+
+void c8_invalidate(Chip8* chip8, UBIT16 addr, UBIT16 len)
+{
+    /* The instruction starting one byte before also reads addr */
+    UBIT16 first = (addr > 0) ? addr - 1 : 0;
+    UBIT16 last = addr + len;
+
+    if(last > C8_MEM_SIZE)
+    {
+        last = C8_MEM_SIZE;
+    }
+
+    for(UBIT16 i = first; i < last; i++)
+    {
+        chip8->decoded[i].op = C8_OP_DECODE;
+    }
+
+    if(chip8->jit != NULL)
+    {
+        c8_jit_invalidate(chip8, addr, len);
+    }
+}
+
+void c8_invalidate_all(Chip8* chip8)
+{
+    memset(chip8->decoded, 0, sizeof(chip8->decoded));
+
+    if(chip8->jit != NULL)
+    {
+        c8_jit_invalidate_all(chip8);
+    }
+}
+
+#ifdef C8_THREADED
+#define C8_OP_LABEL(name) case C8_OP_##name: op_##name
+#define C8_DISPATCH() goto *labels[e->op]
+#else
+#define C8_OP_LABEL(name) case C8_OP_##name
+#define C8_DISPATCH() goto dispatch
+#endif
+
+/* Fetch the next entry, the last address has no room for a full opcode */
+#define C8_NEXT()                               \
+    do {                                        \
+        if(++executed == cycles)                \
+            goto out;                           \
+        if(pc >= C8_MEM_SIZE - 1)               \
+            goto slow;                          \
+        e = &chip8->decoded[pc];                \
+        C8_DISPATCH();                          \
+    } while(0)
+
+/* Run a handler shared with the switch interpreter */
+#define C8_SHARED(handler)                      \
+    do {                                        \
+        chip8->pc = pc;                         \
+        chip8->opcode = e->opcode;              \
+        handler(chip8);                         \
+        pc = chip8->pc;                         \
+    } while(0)
+
+unsigned long c8_predecoded_run(Chip8* chip8, unsigned long cycles)
+{
+#ifdef C8_THREADED
+    static void* const labels[C8_OP_COUNT] = {
+        [C8_OP_DECODE]   = &&op_DECODE,   [C8_OP_SYS]       = &&op_SYS,
+        [C8_OP_CLS]      = &&op_CLS,      [C8_OP_RET]       = &&op_RET,
+        [C8_OP_JP]       = &&op_JP,       [C8_OP_CALL]      = &&op_CALL,
+        [C8_OP_SE_KK]    = &&op_SE_KK,    [C8_OP_SNE_KK]    = &&op_SNE_KK,
+        [C8_OP_SE_REG]   = &&op_SE_REG,   [C8_OP_LD_KK]     = &&op_LD_KK,
+        [C8_OP_ADD_KK]   = &&op_ADD_KK,   [C8_OP_LD_REG]    = &&op_LD_REG,
+        [C8_OP_OR]       = &&op_OR,       [C8_OP_AND]       = &&op_AND,
+        [C8_OP_XOR]      = &&op_XOR,      [C8_OP_ADD_REG]   = &&op_ADD_REG,
+        [C8_OP_SUB]      = &&op_SUB,      [C8_OP_SHR]       = &&op_SHR,
+        [C8_OP_SUBN]     = &&op_SUBN,     [C8_OP_SHL]       = &&op_SHL,
+        [C8_OP_SNE_REG]  = &&op_SNE_REG,  [C8_OP_LD_I]      = &&op_LD_I,
+        [C8_OP_JP_V0]    = &&op_JP_V0,    [C8_OP_RND]       = &&op_RND,
+        [C8_OP_DRW]      = &&op_DRW,      [C8_OP_SKEY]      = &&op_SKEY,
+        [C8_OP_LD_VX_DT] = &&op_LD_VX_DT, [C8_OP_LD_DT]     = &&op_LD_DT,
+        [C8_OP_LD_ST]    = &&op_LD_ST,    [C8_OP_ADD_I]     = &&op_ADD_I,
+        [C8_OP_LD_F]     = &&op_LD_F,     [C8_OP_MISC]      = &&op_MISC,
+        [C8_OP_EXT]      = &&op_EXT,      [C8_OP_OR_VF]     = &&op_OR_VF,
+        [C8_OP_AND_VF]   = &&op_AND_VF,   [C8_OP_XOR_VF]    = &&op_XOR_VF,
+        [C8_OP_SHR_VY]   = &&op_SHR_VY,   [C8_OP_SHL_VY]    = &&op_SHL_VY,
+    };
+#endif
+    const C8QuirkHandlers* handlers = &c8_quirk_handlers[chip8->quirks];
+    UBIT8* v = chip8->registers;
+    UBIT16 pc = chip8->pc;
+    unsigned long executed = 0;
+    const C8Decoded* e = NULL;
+    UBIT16 sum = 0;
+
+    if(cycles == 0 || chip8->waiting_key == STD_TRUE)
+    {
+        return 0;
+    }
+
+    if(pc >= C8_MEM_SIZE - 1)
+    {
+        goto slow;
+    }
+
+    e = &chip8->decoded[pc];
+
+#ifndef C8_THREADED
+dispatch:
+#endif
+    switch(e->op)
+    {
+    C8_OP_LABEL(DECODE):
+        c8_predecode(chip8, pc);
+        C8_DISPATCH();
+
+    C8_OP_LABEL(SYS):
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(CLS):
+        c8_process_instruction_cls(chip8);
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(RET):
+        pc = chip8->stack[--chip8->sp] + 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(JP):
+        /* A jump to itself or back over FX07 and a skip may close an idle loop */
+        if(pc - e->nnn <= 4 && chip8->fast_idle == STD_TRUE && executed + 1 < cycles)
+        {
+            chip8->pc = e->nnn;
+            if(c8_idle_skip(chip8, cycles - executed - 1) != 0)
+            {
+                executed = cycles;
+                pc = chip8->pc;
+                goto out;
+            }
+        }
+        pc = e->nnn;
+        C8_NEXT();
+
+    C8_OP_LABEL(CALL):
+        chip8->stack[chip8->sp++] = pc;
+        pc = e->nnn;
+        C8_NEXT();
+
+    C8_OP_LABEL(SE_KK):
+        pc += (v[e->x] == e->kk) ? c8_skip_len(chip8, pc) : 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SNE_KK):
+        pc += (v[e->x] != e->kk) ? c8_skip_len(chip8, pc) : 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SE_REG):
+        pc += (v[e->x] == v[e->y]) ? c8_skip_len(chip8, pc) : 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_KK):
+        v[e->x] = e->kk;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(ADD_KK):
+        v[e->x] += e->kk;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_REG):
+        v[e->x] = v[e->y];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(OR):
+        v[e->x] |= v[e->y];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(AND):
+        v[e->x] &= v[e->y];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(XOR):
+        v[e->x] ^= v[e->y];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(OR_VF):
+        v[e->x] |= v[e->y];
+        v[0xF] = 0;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(AND_VF):
+        v[e->x] &= v[e->y];
+        v[0xF] = 0;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(XOR_VF):
+        v[e->x] ^= v[e->y];
+        v[0xF] = 0;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(ADD_REG):
+        sum = v[e->x] + v[e->y];
+        v[0xF] = (sum > 255) ? 1 : 0;
+        v[e->x] = (sum & 0xFF);
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SUB):
+        v[0xF] = (v[e->x] > v[e->y]) ? 1 : 0;
+        v[e->x] -= v[e->y];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SHR):
+        v[0xF] = v[e->x] & 0x01;
+        v[e->x] >>= 1;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SUBN):
+        v[0xF] = (v[e->x] > v[e->y]) ? 1 : 0;
+        v[e->x] = v[e->y] - v[e->x];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SHL):
+        v[0xF] = (v[e->x] & 0x80) ? 1 : 0;
+        v[e->x] <<= 1;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SHR_VY):
+        v[0xF] = v[e->y] & 0x01;
+        v[e->x] = v[e->y] >> 1;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SHL_VY):
+        v[0xF] = (v[e->y] & 0x80) ? 1 : 0;
+        v[e->x] = v[e->y] << 1;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(SNE_REG):
+        pc += (v[e->x] != v[e->y]) ? c8_skip_len(chip8, pc) : 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_I):
+        chip8->index = e->nnn;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(JP_V0):
+        pc = e->nnn + v[0x0];
+        C8_NEXT();
+
+    C8_OP_LABEL(RND):
+        C8_SHARED(c8_process_instruction_C);
+        C8_NEXT();
+
+    C8_OP_LABEL(DRW):
+        C8_SHARED(handlers->draw);
+        C8_NEXT();
+
+    C8_OP_LABEL(SKEY):
+        C8_SHARED(c8_process_instruction_E);
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_VX_DT):
+        v[e->x] = chip8->delay_timer;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_DT):
+        chip8->delay_timer = v[e->x];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_ST):
+        chip8->sound_timer = v[e->x];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(ADD_I):
+        v[0xF] = (chip8->index + v[e->x] > 0xFFF) ? 1 : 0;
+        chip8->index += v[e->x];
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(LD_F):
+        chip8->index = v[e->x] * FONTSET_SPRITE;
+        pc += 2;
+        C8_NEXT();
+
+    C8_OP_LABEL(EXT):
+        /* Scrolls, resolution switches and register ranges: stores invalidate the cache */
+        C8_SHARED(handlers->execute);
+        C8_NEXT();
+
+    C8_OP_LABEL(MISC):
+        /* Stores invalidate the cache, so _e_ is not used afterwards */
+        C8_SHARED(handlers->misc);
+        if(chip8->waiting_key == STD_TRUE)
+        {
+            /* FX0A parked the machine */
+            executed++;
+            goto out;
+        }
+        C8_NEXT();
+
+    default:
+        break;
+    }
+
+slow:
+    /* Out of the cache range: let the switch interpreter run it */
+    chip8->pc = pc;
+    handlers->loop(chip8);
+    pc = chip8->pc;
+    if(chip8->waiting_key == STD_TRUE)
+    {
+        executed++;
+        goto out;
+    }
+    C8_NEXT();
+
+out:
+    chip8->pc = pc;
+
+    return executed;
+}
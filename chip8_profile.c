@@ -0,0 +1,231 @@
+#include "chip8_profile.h"
+
+#ifdef C8_PROFILE
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Instrumentation ---- */
+
+static const char* c8_profile_class_names[16] = {
+    "0nnn SYS/CLS/RET", "1nnn JP", "2nnn CALL", "3xkk SE",
+    "4xkk SNE", "5xy0 SE", "6xkk LD", "7xkk ADD",
+    "8xyN ALU", "9xy0 SNE", "Annn LD I", "Bnnn JP V0",
+    "Cxkk RND", "Dxyn DRW", "ExNN SKP", "FxNN MISC"
+};
+
+C8Profile* c8_profile_attach(Chip8* chip8)
+{
+    C8Profile* profile = malloc(sizeof(C8Profile));
+
+    if(profile == NULL)
+    {
+        return NULL;
+    }
+
+    c8_profile_reset(profile);
+    c8_profile_detach(chip8);
+    chip8->profile = profile;
+
+    return profile;
+}
+
+void c8_profile_detach(Chip8* chip8)
+{
+    free(chip8->profile);
+    chip8->profile = NULL;
+}
+
+void c8_profile_reset(C8Profile* profile)
+{
+    memset(profile, 0, sizeof(C8Profile));
+
+    /* Node 0 is the root: the code outside of any subroutine */
+    profile->nodes[0].addr = 0x200;
+    profile->node_count = 1;
+    atomic_init(&profile->trace_head, 0);
+}
+
+void c8_profile_frame(C8Profile* profile, UBIT64 frame)
+{
+    C8FrameCount* fc = &profile->frames[profile->frame_count++ & (C8_PROFILE_FRAMES - 1)];
+
+    fc->frame = frame;
+    fc->drw = profile->drw;
+    fc->cls = profile->cls;
+
+    profile->drw = 0;
+    profile->cls = 0;
+}
+
+size_t c8_profile_trace(const C8Profile* profile, C8TraceEntry* out, size_t max)
+{
+#if C8_PROFILE_TRACE == 0
+    (void)profile;
+    (void)out;
+    (void)max;
+
+    return 0;
+#else
+    UBIT64 head = atomic_load_explicit(&profile->trace_head, memory_order_acquire);
+    UBIT64 first = 0;
+    UBIT64 valid = 0;
+    size_t count = 0;
+
+    if(max > C8_PROFILE_TRACE)
+    {
+        max = C8_PROFILE_TRACE;
+    }
+
+    first = (head > max) ? head - max : 0;
+    count = (size_t)(head - first);
+
+    for(UBIT64 seq = first; seq < head; seq++)
+    {
+        out[seq - first] = profile->trace[seq & (C8_PROFILE_TRACE - 1)];
+    }
+
+    /* The writer may have lapped the copy: the slot it is filling now and */
+    /* every slot it already reused hold newer entries, drop them          */
+    atomic_thread_fence(memory_order_acquire);
+    head = atomic_load_explicit(&profile->trace_head, memory_order_relaxed);
+    valid = (head + 1 > C8_PROFILE_TRACE) ? head + 1 - C8_PROFILE_TRACE : 0;
+
+    if(valid > first)
+    {
+        size_t lost = (valid - first < count) ? (size_t)(valid - first) : count;
+
+        memmove(out, out + lost, (count - lost) * sizeof(C8TraceEntry));
+        count -= lost;
+    }
+
+    return count;
+#endif
+}
+
+/* This function returns the oldest frame kept in the DRW/CLS history */
+static UBIT64 profile_first_frame(const C8Profile* profile)
+{
+    return (profile->frame_count > C8_PROFILE_FRAMES) ? profile->frame_count - C8_PROFILE_FRAMES : 0;
+}
+
+void c8_profile_write_csv(const C8Profile* profile, FILE* f)
+{
+    fprintf(f, "metric,key,count\n");
+
+    for(int i = 0; i < 16; i++)
+    {
+        if(profile->class_count[i] != 0)
+            fprintf(f, "class,%X,%llu\n", i, (unsigned long long)profile->class_count[i]);
+    }
+
+    for(int i = 0; i < C8_MEM_SIZE; i++)
+    {
+        if(profile->pc_hits[i] != 0)
+            fprintf(f, "pc,0x%03X,%llu\n", i, (unsigned long long)profile->pc_hits[i]);
+    }
+
+    for(UBIT64 i = profile_first_frame(profile); i < profile->frame_count; i++)
+    {
+        const C8FrameCount* fc = &profile->frames[i & (C8_PROFILE_FRAMES - 1)];
+
+        if(fc->drw == 0 && fc->cls == 0)
+            continue;
+
+        fprintf(f, "drw,%llu,%u\n", (unsigned long long)fc->frame, fc->drw);
+        fprintf(f, "cls,%llu,%u\n", (unsigned long long)fc->frame, fc->cls);
+    }
+}
+
+void c8_profile_write_json(const C8Profile* profile, FILE* f)
+{
+    C8TraceEntry trace[C8_PROFILE_TRACE > 0 ? C8_PROFILE_TRACE : 1];
+    size_t count = c8_profile_trace(profile, trace, C8_PROFILE_TRACE);
+    const char* sep = "";
+
+    fprintf(f, "{\n  \"classes\": [");
+    for(int i = 0; i < 16; i++)
+    {
+        fprintf(f, "%s\n    {\"class\": \"%X\", \"name\": \"%s\", \"count\": %llu}", (i == 0) ? "" : ",",
+                i, c8_profile_class_names[i], (unsigned long long)profile->class_count[i]);
+    }
+
+    fprintf(f, "\n  ],\n  \"pc\": {");
+    for(int i = 0; i < C8_MEM_SIZE; i++)
+    {
+        if(profile->pc_hits[i] == 0)
+            continue;
+
+        fprintf(f, "%s\"0x%03X\": %llu", sep, i, (unsigned long long)profile->pc_hits[i]);
+        sep = ", ";
+    }
+
+    sep = "";
+    fprintf(f, "},\n  \"frames\": [");
+    for(UBIT64 i = profile_first_frame(profile); i < profile->frame_count; i++)
+    {
+        const C8FrameCount* fc = &profile->frames[i & (C8_PROFILE_FRAMES - 1)];
+
+        if(fc->drw == 0 && fc->cls == 0)
+            continue;
+
+        fprintf(f, "%s\n    {\"frame\": %llu, \"drw\": %u, \"cls\": %u}", sep,
+                (unsigned long long)fc->frame, fc->drw, fc->cls);
+        sep = ",";
+    }
+
+    fprintf(f, "\n  ],\n  \"trace\": [");
+    for(size_t i = 0; i < count; i++)
+    {
+        fprintf(f, "%s\n    {\"pc\": \"0x%03X\", \"opcode\": \"%04X\", \"i\": \"0x%03X\", \"sp\": %u, \"v\": [",
+                (i == 0) ? "" : ",", trace[i].pc, trace[i].opcode, trace[i].index, trace[i].sp);
+
+        for(int r = 0; r < 16; r++)
+            fprintf(f, "%s%u", (r == 0) ? "" : ", ", trace[i].registers[r]);
+
+        fprintf(f, "]}");
+    }
+
+    fprintf(f, "\n  ]\n}\n");
+}
+
+/* This function prints the call path of _node_ as "0x200;0x2A0;..." */
+static void profile_print_path(const C8Profile* profile, UBIT16 node, FILE* f)
+{
+    if(node != 0)
+    {
+        profile_print_path(profile, profile->nodes[node].parent, f);
+        fprintf(f, ";");
+    }
+
+    fprintf(f, "0x%03X", profile->nodes[node].addr);
+}
+
+UBIT64 c8_profile_node_self(const C8Profile* profile, UBIT16 n)
+{
+    UBIT64 self = profile->nodes[n].self;
+
+    /* The running node has not been charged since it was entered */
+    if(n == profile->node)
+    {
+        self += atomic_load_explicit(&profile->trace_head, memory_order_relaxed) - profile->node_since;
+    }
+
+    return self;
+}
+
+void c8_profile_write_folded(const C8Profile* profile, FILE* f)
+{
+    for(UBIT16 n = 0; n < profile->node_count; n++)
+    {
+        UBIT64 self = c8_profile_node_self(profile, n);
+
+        if(self == 0)
+            continue;
+
+        profile_print_path(profile, n, f);
+        fprintf(f, " %llu\n", (unsigned long long)self);
+    }
+}
+
+#endif /* C8_PROFILE */
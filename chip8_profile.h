@@ -0,0 +1,193 @@
+#ifndef CHIP8_PROFILE_H
+#define CHIP8_PROFILE_H
+
+#include "chip8.h"
+
+/* Instrumentation of the switch interpreter, compiled in with -DC8_PROFILE.  */
+/* Without it the hooks expand to nothing and Chip8 has no profile pointer.   */
+/* With it, a machine that has a profile attached runs on the switch engine   */
+/* and every instruction updates the counters below.                          */
+
+#ifdef C8_PROFILE
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef C8_PROFILE_TRACE
+#define C8_PROFILE_TRACE   256  /* Trace ring entries, power of two (0 = no trace) */
+#endif
+#define C8_PROFILE_FRAMES  1024 /* Frames kept in the DRW/CLS history, power of two */
+#define C8_PROFILE_NODES   4096 /* Call tree nodes (2nnn/00EE) */
+
+/* One executed instruction, as seen before it ran. Entries are 32 bytes */
+/* so that one never straddles two cache lines.                          */
+typedef struct
+{
+    UBIT8  registers[16];
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t index;
+    UBIT8    sp;
+    UBIT8    reserved[9];
+} __attribute__((aligned(32))) C8TraceEntry;
+
+/* DRW/CLS executed during one frame */
+typedef struct
+{
+    UBIT64 frame;
+    UBIT32 drw;
+    UBIT32 cls;
+} C8FrameCount;
+
+/* Call tree node: a subroutine entered from the path of its parents */
+typedef struct
+{
+    UBIT16 addr;    /* Subroutine address, 0x200 for the root */
+    UBIT16 parent;  /* Parent node, the root is its own parent */
+    UBIT16 child;   /* First child, 0 if none */
+    UBIT16 sibling; /* Next child of the parent, 0 if none */
+    UBIT64 self;    /* Instructions executed in this node, see c8_profile_node_self */
+} C8CallNode;
+
+struct C8Profile
+{
+    UBIT64       class_count[16];        /* Executed instructions per first nibble */
+    UBIT64       pc_hits[C8_MEM_SIZE];   /* Executed instructions per address */
+
+    C8FrameCount frames[C8_PROFILE_FRAMES]; /* DRW/CLS history of the last frames */
+    UBIT64       frame_count;            /* Frames ever recorded in the history */
+    UBIT32       drw;                    /* DRW in the current frame */
+    UBIT32       cls;                    /* CLS in the current frame */
+
+    C8CallNode   nodes[C8_PROFILE_NODES];
+    UBIT16       node_count;
+    UBIT16       node;                   /* Node of the running subroutine */
+    UBIT64       node_since;             /* trace_head when _node_ was entered */
+
+    /* Written by the emulation thread only; readers copy the ring and */
+    /* drop the entries the writer overtook (see c8_profile_trace)     */
+#if C8_PROFILE_TRACE > 0
+    C8TraceEntry trace[C8_PROFILE_TRACE];
+#endif
+    _Atomic UBIT64 trace_head;           /* Instructions ever executed (and traced) */
+};
+
+/* This function allocates a profile and attaches it to the machine, returns NULL when out of memory */
+C8Profile* c8_profile_attach(Chip8* chip8);
+
+/* This function detaches and releases the profile of the machine */
+void c8_profile_detach(Chip8* chip8);
+
+/* This function clears every counter of the profile */
+void c8_profile_reset(C8Profile* profile);
+
+/* This function copies up to _max_ of the most recent trace entries, oldest */
+/* first, and returns how many were copied. It may run on any thread.        */
+size_t c8_profile_trace(const C8Profile* profile, C8TraceEntry* out, size_t max);
+
+/* This function writes the counters as CSV: metric,key,count rows for the */
+/* opcode classes, the hot addresses and the DRW/CLS counts per frame      */
+void c8_profile_write_csv(const C8Profile* profile, FILE* f);
+
+/* This function writes the counters and the trace as JSON */
+void c8_profile_write_json(const C8Profile* profile, FILE* f);
+
+/* This function returns the instructions executed in call tree node _n_ */
+UBIT64 c8_profile_node_self(const C8Profile* profile, UBIT16 n);
+
+/* This function writes the call tree as folded stacks (flamegraph.pl input) */
+void c8_profile_write_folded(const C8Profile* profile, FILE* f);
+
+/* Hooks, called by the switch interpreter */
+
+void c8_profile_frame(C8Profile* profile, UBIT64 frame);
+
+static inline void c8_profile_insn(C8Profile* profile, const Chip8* chip8)
+{
+    UBIT64 head = atomic_load_explicit(&profile->trace_head, memory_order_relaxed);
+    UBIT16 opcode = chip8->opcode;
+
+    profile->class_count[opcode >> 12]++;
+    profile->pc_hits[chip8->pc & (C8_MEM_SIZE - 1)]++;
+
+#if C8_PROFILE_TRACE > 0
+    /* The register copy is the costliest part of the hook: it reloads the */
+    /* bytes the previous instruction just stored                          */
+    {
+        C8TraceEntry* t = &profile->trace[head & (C8_PROFILE_TRACE - 1)];
+
+        memcpy(t->registers, chip8->registers, 16);
+        t->pc = chip8->pc;
+        t->opcode = opcode;
+        t->index = chip8->index;
+        t->sp = chip8->sp;
+    }
+#endif
+    atomic_store_explicit(&profile->trace_head, ++head, memory_order_release);
+
+    if((opcode >> 12) == 0xD)
+    {
+        profile->drw++;
+    }
+    else if((opcode >> 12) == 0x2)
+    {
+        /* Enter the callee: reuse the child node for this address or make one. */
+        /* Nodes are charged on call and return only: the trace head already   */
+        /* counts the instructions, so the hot path does not touch the tree    */
+        UBIT16 n = profile->nodes[profile->node].child;
+
+        while(n != 0 && profile->nodes[n].addr != (opcode & 0x0FFF))
+            n = profile->nodes[n].sibling;
+
+        if(n == 0 && profile->node_count < C8_PROFILE_NODES)
+        {
+            n = profile->node_count++;
+            profile->nodes[n].addr = opcode & 0x0FFF;
+            profile->nodes[n].parent = profile->node;
+            profile->nodes[n].child = 0;
+            profile->nodes[n].sibling = profile->nodes[profile->node].child;
+            profile->nodes[n].self = 0;
+            profile->nodes[profile->node].child = n;
+        }
+
+        /* Out of nodes: keep charging the caller */
+        if(n != 0)
+        {
+            profile->nodes[profile->node].self += head - profile->node_since;
+            profile->node_since = head;
+            profile->node = n;
+        }
+    }
+    else if(opcode == 0x00EE)
+    {
+        profile->nodes[profile->node].self += head - profile->node_since;
+        profile->node_since = head;
+        profile->node = profile->nodes[profile->node].parent;
+    }
+    else if(opcode == 0x00E0)
+    {
+        profile->cls++;
+    }
+}
+
+#define C8_PROFILE_INSN(chip8)                                  \
+    do {                                                        \
+        if((chip8)->profile != NULL)                            \
+            c8_profile_insn((chip8)->profile, (chip8));         \
+    } while(0)
+
+#define C8_PROFILE_FRAME(chip8)                                 \
+    do {                                                        \
+        if((chip8)->profile != NULL)                            \
+            c8_profile_frame((chip8)->profile, (chip8)->frame); \
+    } while(0)
+
+#else
+
+#define C8_PROFILE_INSN(chip8)  do { } while(0)
+#define C8_PROFILE_FRAME(chip8) do { } while(0)
+
+#endif /* C8_PROFILE */
+
+#endif /* CHIP8_PROFILE_H */
@@ -0,0 +1,382 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chip8_romlib.h"
+
+/* ---- ROM library ---- */
+
+#define C8_ROMLIB_MAX_SIZE C8_PROGRAM_SIZE /* XO-CHIP programs use 64 KB */
+
+static const UBIT8 c8_romlib_magic[4] = { 'C', '8', 'I', 'X' };
+
+static const char* c8_platform_names[] = {
+    [C8_PLATFORM_CHIP8]  = "chip8",
+    [C8_PLATFORM_SCHIP]  = "schip",
+    [C8_PLATFORM_XOCHIP] = "xochip"
+};
+
+/* Quirk profile of each platform */
+static const UBIT8 c8_platform_quirks[] = {
+    [C8_PLATFORM_CHIP8]  = C8_QUIRK_SHIFT_VY | C8_QUIRK_LOAD_I | C8_QUIRK_VF_RESET | C8_QUIRK_CLIP,
+    [C8_PLATFORM_SCHIP]  = C8_QUIRK_CLIP,
+    [C8_PLATFORM_XOCHIP] = C8_QUIRK_SHIFT_VY | C8_QUIRK_LOAD_I
+};
+
+const char* c8_platform_name(UBIT8 platform)
+{
+    return (platform <= C8_PLATFORM_XOCHIP) ? c8_platform_names[platform] : "unknown";
+}
+
+void c8_romlib_init(C8RomLib* lib)
+{
+    memset(lib, 0, sizeof(C8RomLib));
+}
+
+void c8_romlib_free(C8RomLib* lib)
+{
+    for(size_t i = 0; i < lib->count; i++)
+    {
+        if(lib->roms[i]->data != NULL)
+        {
+            munmap((void*)lib->roms[i]->data, lib->roms[i]->size);
+        }
+
+        free(lib->roms[i]->path);
+        free(lib->roms[i]);
+    }
+
+    free(lib->roms);
+    free(lib->slots);
+    c8_romlib_init(lib);
+}
+
+/* This function returns a FNV-1a 64 hash of _size_ bytes */
+static UBIT64 romlib_hash(const UBIT8* data, size_t size)
+{
+    UBIT64 hash = 14695981039346656037ull; /* FNV offset basis */
+
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull; /* FNV prime */
+    }
+
+    return hash;
+}
+
+/* This function guesses the platform from the instructions only later */
+/* interpreters have. Every aligned word is looked at, so data may     */
+/* trigger a false positive; the index keeps corrections.              */
+static UBIT8 romlib_detect(const UBIT8* data, size_t size)
+{
+    UBIT8 platform = C8_PLATFORM_CHIP8;
+
+    if(size > C8_MEM_SIZE - C8_PROGRAM_START)
+    {
+        return C8_PLATFORM_XOCHIP;
+    }
+
+    for(size_t i = 0; i + 1 < size; i += 2)
+    {
+        UBIT16 op = (data[i] << 8) | data[i + 1];
+
+        /* 5xy2/5xy3 register ranges, F000 long I, FN01 planes, F002 audio, Fx3A pitch */
+        if((op & 0xF00E) == 0x5002 || op == 0xF000 || (op & 0xF0FF) == 0xF001
+            || op == 0xF002 || (op & 0xF0FF) == 0xF03A)
+        {
+            return C8_PLATFORM_XOCHIP;
+        }
+
+        /* 00Cn/00FB...00FF scrolling and hires, Fx30 big font, Fx75/Fx85 flags */
+        if(((op & 0xFFF0) == 0x00C0 && op != 0x00C0) || (op >= 0x00FB && op <= 0x00FF)
+            || (op & 0xF0FF) == 0xF030 || (op & 0xF0FF) == 0xF075 || (op & 0xF0FF) == 0xF085)
+        {
+            platform = C8_PLATFORM_SCHIP;
+        }
+    }
+
+    return platform;
+}
+
+/* This function returns the slot of _hash_: its entry, or the free slot it would take */
+static size_t romlib_slot(const C8RomLib* lib, UBIT64 hash)
+{
+    size_t mask = lib->slot_count - 1;
+    size_t slot = (size_t)hash & mask;
+
+    while(lib->slots[slot] != 0 && lib->roms[lib->slots[slot] - 1]->hash != hash)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+const C8Rom* c8_romlib_find(const C8RomLib* lib, UBIT64 hash)
+{
+    size_t slot = 0;
+
+    if(lib->slot_count == 0)
+    {
+        return NULL;
+    }
+
+    slot = romlib_slot(lib, hash);
+
+    return (lib->slots[slot] != 0) ? lib->roms[lib->slots[slot] - 1] : NULL;
+}
+
+/* This function appends an entry, growing the arrays, returns NULL when out of memory */
+static C8Rom* romlib_append(C8RomLib* lib, UBIT64 hash)
+{
+    C8Rom* rom = NULL;
+
+    if(lib->count == lib->capacity)
+    {
+        size_t capacity = (lib->capacity == 0) ? 64 : lib->capacity * 2;
+        C8Rom** roms = realloc(lib->roms, capacity * sizeof(C8Rom*));
+
+        if(roms == NULL)
+        {
+            return NULL;
+        }
+
+        lib->roms = roms;
+        lib->capacity = capacity;
+    }
+
+    /* Keep the table at most half full */
+    if((lib->count + 1) * 2 > lib->slot_count)
+    {
+        size_t slot_count = (lib->slot_count == 0) ? 128 : lib->slot_count * 2;
+        size_t* slots = calloc(slot_count, sizeof(size_t));
+
+        if(slots == NULL)
+        {
+            return NULL;
+        }
+
+        free(lib->slots);
+        lib->slots = slots;
+        lib->slot_count = slot_count;
+
+        for(size_t i = 0; i < lib->count; i++)
+        {
+            lib->slots[romlib_slot(lib, lib->roms[i]->hash)] = i + 1;
+        }
+    }
+
+    /* Entries are allocated one by one so the pointers handed out stay valid */
+    rom = calloc(1, sizeof(C8Rom));
+    if(rom == NULL)
+    {
+        return NULL;
+    }
+
+    rom->hash = hash;
+    lib->slots[romlib_slot(lib, hash)] = lib->count + 1;
+    lib->roms[lib->count++] = rom;
+
+    return rom;
+}
+
+const C8Rom* c8_romlib_add(C8RomLib* lib, const char* path)
+{
+    struct stat st;
+    UBIT8* data = NULL;
+    C8Rom* rom = NULL;
+    UBIT64 hash = 0;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0)
+    {
+        return NULL;
+    }
+
+    if(fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > C8_ROMLIB_MAX_SIZE)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    hash = romlib_hash(data, (size_t)st.st_size);
+    rom = (C8Rom*)c8_romlib_find(lib, hash);
+
+    if(rom != NULL && rom->data != NULL)
+    {
+        /* Same contents under another name: keep the first mapping */
+        munmap(data, (size_t)st.st_size);
+        return rom;
+    }
+
+    if(rom == NULL)
+    {
+        rom = romlib_append(lib, hash);
+        if(rom == NULL)
+        {
+            munmap(data, (size_t)st.st_size);
+            return NULL;
+        }
+
+        rom->platform = romlib_detect(data, (size_t)st.st_size);
+        rom->quirks = c8_platform_quirks[rom->platform];
+    }
+
+    rom->path = strdup(path);
+    rom->size = (UBIT32)st.st_size;
+    rom->data = data;
+
+    return rom;
+}
+
+int c8_romlib_load(Chip8* chip8, const C8Rom* rom)
+{
+    if(rom->data == NULL)
+    {
+        return 1;
+    }
+
+    c8_set_quirks(chip8, rom->quirks);
+
+    return c8_load_program(chip8, rom->data, rom->size);
+}
+
+static UBIT32 romlib_get(const UBIT8* p, int bytes)
+{
+    UBIT32 v = 0;
+
+    for(int i = bytes - 1; i >= 0; i--)
+    {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static void romlib_put(UBIT8* p, UBIT32 v, int bytes)
+{
+    for(int i = 0; i < bytes; i++)
+    {
+        p[i] = (v >> (8 * i)) & 0xFF;
+    }
+}
+
+int c8_romlib_read_index(C8RomLib* lib, const char* path)
+{
+    UBIT8 header[12];
+    UBIT8 record[C8_ROMLIB_RECORD];
+    UBIT32 count = 0;
+    int status = 0;
+    FILE* f = fopen(path, "rb");
+
+    if(f == NULL)
+    {
+        return 1;
+    }
+
+    if(fread(header, 1, sizeof(header), f) != sizeof(header)
+        || memcmp(header, c8_romlib_magic, sizeof(c8_romlib_magic)) != 0
+        || romlib_get(header + 4, 2) != C8_ROMLIB_VERSION
+        || romlib_get(header + 6, 2) != C8_ROMLIB_RECORD)
+    {
+        fclose(f);
+        return 1;
+    }
+
+    count = romlib_get(header + 8, 4);
+
+    for(UBIT32 i = 0; i < count && status == 0; i++)
+    {
+        UBIT64 hash = 0;
+        C8Rom* rom = NULL;
+
+        if(fread(record, 1, sizeof(record), f) != sizeof(record) || record[12] > C8_PLATFORM_XOCHIP)
+        {
+            status = 1;
+            break;
+        }
+
+        hash = romlib_get(record, 4) | ((UBIT64)romlib_get(record + 4, 4) << 32);
+        rom = (C8Rom*)c8_romlib_find(lib, hash);
+
+        if(rom == NULL)
+        {
+            rom = romlib_append(lib, hash);
+            if(rom == NULL)
+            {
+                status = 1;
+                break;
+            }
+
+            rom->size = romlib_get(record + 8, 4);
+        }
+
+        /* The index wins over detection, it may hold corrections */
+        rom->platform = record[12];
+        rom->quirks = record[13];
+    }
+
+    fclose(f);
+
+    return status;
+}
+
+int c8_romlib_write_index(const C8RomLib* lib, const char* path)
+{
+    UBIT8 header[12];
+    UBIT8 record[C8_ROMLIB_RECORD];
+    int status = 0;
+    FILE* f = fopen(path, "wb");
+
+    if(f == NULL)
+    {
+        return 1;
+    }
+
+    memcpy(header, c8_romlib_magic, sizeof(c8_romlib_magic));
+    romlib_put(header + 4, C8_ROMLIB_VERSION, 2);
+    romlib_put(header + 6, C8_ROMLIB_RECORD, 2);
+    romlib_put(header + 8, (UBIT32)lib->count, 4);
+
+    if(fwrite(header, 1, sizeof(header), f) != sizeof(header))
+    {
+        status = 1;
+    }
+
+    for(size_t i = 0; i < lib->count && status == 0; i++)
+    {
+        const C8Rom* rom = lib->roms[i];
+
+        romlib_put(record, (UBIT32)rom->hash, 4);
+        romlib_put(record + 4, (UBIT32)(rom->hash >> 32), 4);
+        romlib_put(record + 8, rom->size, 4);
+        record[12] = rom->platform;
+        record[13] = rom->quirks;
+        romlib_put(record + 14, 0, 2);
+
+        if(fwrite(record, 1, sizeof(record), f) != sizeof(record))
+        {
+            status = 1;
+        }
+    }
+
+    if(fclose(f) != 0)
+    {
+        status = 1;
+    }
+
+    return status;
+}
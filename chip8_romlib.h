@@ -0,0 +1,78 @@
+#ifndef CHIP8_ROMLIB_H
+#define CHIP8_ROMLIB_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* ROM library                                                          */
+/*                                                                      */
+/* ROM files are mapped read-only and shared by every machine started   */
+/* from them: a machine only copies the program into its own RAM. ROMs  */
+/* are indexed by a 64-bit FNV-1a hash of their contents, so duplicates */
+/* in a corpus are mapped once. The metadata (size, platform, quirks)   */
+/* can be saved to, and restored from, a compact index file so it is    */
+/* detected once per ROM rather than once per run.                      */
+/*                                                                      */
+/* Index file, little-endian: "C8IX", u16 version, u16 record size,     */
+/* u32 record count, then per record u64 hash, u32 size, u8 platform,   */
+/* u8 quirks, u16 reserved.                                             */
+
+#define C8_ROMLIB_VERSION 1
+#define C8_ROMLIB_RECORD  16 /* Bytes per index record */
+
+typedef enum {
+    C8_PLATFORM_CHIP8  = 0, /* Original COSMAC VIP interpreter */
+    C8_PLATFORM_SCHIP  = 1, /* SUPER-CHIP 1.1 */
+    C8_PLATFORM_XOCHIP = 2  /* XO-CHIP */
+} C8_PLATFORM;
+
+typedef struct
+{
+    UBIT64       hash;     /* FNV-1a 64 of the contents */
+    UBIT32       size;     /* Bytes */
+    UBIT8        platform; /* C8_PLATFORM_* */
+    UBIT8        quirks;   /* C8_QUIRK_* the ROM expects (chip8.h) */
+    const UBIT8* data;     /* Shared read-only mapping, NULL for index-only entries */
+    char*        path;     /* First file the contents were found in */
+} C8Rom;
+
+typedef struct
+{
+    C8Rom** roms;       /* Entries, their addresses never change */
+    size_t  count;
+    size_t  capacity;
+    size_t* slots;      /* Open addressing table: rom index + 1, 0 when free */
+    size_t  slot_count; /* Power of two */
+} C8RomLib;
+
+/* This function initializes an empty library */
+void c8_romlib_init(C8RomLib* lib);
+
+/* This function unmaps the ROMs and releases the library */
+void c8_romlib_free(C8RomLib* lib);
+
+/* This function maps _path_ and returns its entry, the existing one when the */
+/* contents are already in the library. Metadata comes from the index when    */
+/* the hash is known, it is detected otherwise. Returns NULL on failure (not  */
+/* readable, empty or too large for XO-CHIP memory).                          */
+const C8Rom* c8_romlib_add(C8RomLib* lib, const char* path);
+
+/* This function returns the entry for a content hash, NULL when unknown */
+const C8Rom* c8_romlib_find(const C8RomLib* lib, UBIT64 hash);
+
+/* This function loads the metadata of _path_ into the library, returns 0 on success */
+int c8_romlib_read_index(C8RomLib* lib, const char* path);
+
+/* This function saves the metadata of every entry to _path_, returns 0 on success */
+int c8_romlib_write_index(const C8RomLib* lib, const char* path);
+
+/* This function starts a machine from a library entry: the program is copied */
+/* from the shared mapping into its RAM and the quirks of the entry are        */
+/* selected. Returns 0 on success.                                             */
+int c8_romlib_load(Chip8* chip8, const C8Rom* rom);
+
+/* This function returns the name of a platform ("chip8", "schip", "xochip") */
+const char* c8_platform_name(UBIT8 platform);
+
+#endif /* CHIP8_ROMLIB_H */
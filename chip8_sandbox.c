@@ -0,0 +1,91 @@
+#include "chip8_engine.h"
+
+/* ---- Sandbox ---- */
+
+static const char* c8_fault_names[] = {
+    [C8_FAULT_NONE]            = "none",
+    [C8_FAULT_PC]              = "pc",
+    [C8_FAULT_STACK_OVERFLOW]  = "stack_overflow",
+    [C8_FAULT_STACK_UNDERFLOW] = "stack_underflow",
+    [C8_FAULT_MEMORY]          = "memory",
+    [C8_FAULT_KEY]             = "key"
+};
+
+const char* c8_fault_name(C8_FAULT kind)
+{
+    return (kind <= C8_FAULT_KEY) ? c8_fault_names[kind] : "unknown";
+}
+
+C8_FAULT c8_sandbox_check(const Chip8* chip8, UBIT16 opcode)
+{
+    UBIT8 x = (opcode & 0x0F00) >> 8;
+
+    switch(opcode >> 12)
+    {
+    case 0x0:
+        if(opcode == 0x00EE && chip8->sp == 0)
+            return C8_FAULT_STACK_UNDERFLOW;
+        break;
+    case 0x2:
+        if(chip8->sp >= 16)
+            return C8_FAULT_STACK_OVERFLOW;
+        break;
+    case 0xE:
+        /* SKP/SKNP index the keyboard with Vx */
+        if(((opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1) && chip8->registers[x] >= KEYBOARD_SIZE * KEYBOARD_SIZE)
+            return C8_FAULT_KEY;
+        break;
+    case 0xF:
+        /* Stores and loads from I, which FX1E and F000 nnnn move anywhere */
+        if((opcode & 0x00FF) == 0x33 && chip8->index + 3 > C8_RAM_SIZE)
+            return C8_FAULT_MEMORY;
+        if(((opcode & 0x00FF) == 0x55 || (opcode & 0x00FF) == 0x65) && chip8->index + x + 1 > C8_RAM_SIZE)
+            return C8_FAULT_MEMORY;
+        break;
+    default:
+        break;
+    }
+
+    return C8_FAULT_NONE;
+}
+
+void c8_sandbox_fault(Chip8* chip8, C8_FAULT kind)
+{
+    chip8->fault.kind = kind;
+    chip8->fault.pc = chip8->pc;
+    chip8->fault.opcode = (kind == C8_FAULT_PC) ? 0 : chip8->opcode;
+}
+
+unsigned long c8_sandbox_run(Chip8* chip8, unsigned long cycles)
+{
+    const C8QuirkHandlers* handlers = &c8_quirk_handlers[chip8->quirks];
+    unsigned long executed = 0;
+    STD_BOOL idle = chip8->fast_idle;
+
+    /* A faulted machine executes nothing more, the loop only stops on new faults */
+    if(chip8->fault.kind != C8_FAULT_NONE)
+    {
+        return 0;
+    }
+
+    while(executed < cycles && chip8->waiting_key == STD_FALSE)
+    {
+        C8_FAULT kind = handlers->sandbox(chip8);
+
+        if(kind != C8_FAULT_NONE)
+        {
+            c8_sandbox_fault(chip8, kind);
+            break;
+        }
+
+        executed++;
+
+        /* Idle loops are only entered through a jump */
+        if(idle == STD_TRUE && (chip8->opcode & 0xF000) == 0x1000)
+        {
+            executed += c8_idle_skip(chip8, cycles - executed);
+        }
+    }
+
+    return executed;
+}
@@ -0,0 +1,711 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_engine.h"
+#include "chip8_state.h"
+
+/* ---- Save states ---- */
+
+static const UBIT8 c8_state_magic[4] = { 'C', '8', 'S', 'T' };
+
+static UBIT8* put16(UBIT8* p, UBIT32 v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+
+    return p + 2;
+}
+
+static UBIT8* put32(UBIT8* p, UBIT32 v)
+{
+    p = put16(p, v & 0xFFFF);
+
+    return put16(p, v >> 16);
+}
+
+static UBIT8* put64(UBIT8* p, UBIT64 v)
+{
+    p = put32(p, (UBIT32)v);
+
+    return put32(p, (UBIT32)(v >> 32));
+}
+
+static UBIT32 get16(const UBIT8** p)
+{
+    UBIT32 v = (*p)[0] | ((*p)[1] << 8);
+
+    *p += 2;
+
+    return v;
+}
+
+static UBIT32 get32(const UBIT8** p)
+{
+    UBIT32 lo = get16(p);
+
+    return lo | (get16(p) << 16);
+}
+
+static UBIT64 get64(const UBIT8** p)
+{
+    UBIT64 lo = get32(p);
+
+    return lo | ((UBIT64)get32(p) << 32);
+}
+
+void c8_state_save(const Chip8* chip8, UBIT8* buf)
+{
+    UBIT8* p = buf;
+
+    memcpy(p, c8_state_magic, sizeof(c8_state_magic));
+    p += sizeof(c8_state_magic);
+    p = put16(p, C8_STATE_VERSION);
+    p = put16(p, chip8->quirks);
+    p = put32(p, C8_STATE_PAYLOAD);
+
+    p = put32(p, chip8->pc);
+    p = put32(p, chip8->sp);
+    p = put32(p, chip8->opcode);
+    p = put32(p, chip8->index);
+    p = put32(p, chip8->delay_timer);
+    p = put32(p, chip8->sound_timer);
+
+    memcpy(p, chip8->memory, C8_RAM_SIZE);
+    p += C8_RAM_SIZE;
+    memcpy(p, chip8->registers, 16);
+    p += 16;
+
+    for(int i = 0; i < 16; i++)
+    {
+        p = put32(p, chip8->stack[i]);
+    }
+
+    for(int pl = 0; pl < C8_PLANES; pl++)
+    {
+        for(int i = 0; i < C8_PLANE_WORDS; i++)
+        {
+            p = put64(p, chip8->display[pl][i]);
+        }
+    }
+
+    memcpy(p, chip8->keyboard, 16);
+    p += 16;
+    *p++ = (chip8->waiting_key == STD_TRUE) ? 1 : 0;
+    *p++ = chip8->key_register;
+
+    p = put64(p, chip8->rng);
+    p = put64(p, chip8->frame);
+    p = put32(p, chip8->clock);
+
+    *p++ = chip8->hires;
+    *p++ = chip8->planes;
+    *p++ = chip8->pitch;
+    *p++ = (chip8->xo_audio == STD_TRUE) ? 1 : 0;
+    memcpy(p, chip8->flags, 16);
+    p += 16;
+    memcpy(p, chip8->pattern, 16);
+}
+
+/* Registers of a state being loaded, checked before any reaches the machine */
+typedef struct
+{
+    UBIT32       pc;
+    UBIT32       sp;
+    UBIT32       opcode;
+    UBIT32       index;
+    UBIT32       delay_timer;
+    UBIT32       sound_timer;
+    const UBIT8* memory;  /* _mem_size_ bytes in the buffer */
+    size_t       mem_size;
+    const UBIT8* registers;
+    UBIT32       stack[16];
+    const UBIT8* display; /* _disp_words_ words per plane in the buffer, _disp_planes_ planes */
+    int          disp_words;
+    int          disp_planes;
+    const UBIT8* keyboard;
+    UBIT8        waiting_key;
+    UBIT8        key_register;
+    UBIT64       rng;
+    UBIT64       frame;
+    UBIT32       clock;
+    UBIT8        hires;
+    UBIT8        planes;
+    UBIT8        pitch;
+    UBIT8        xo_audio;
+    const UBIT8* flags;
+    const UBIT8* pattern;
+} c8_state_fields;
+
+/* This function decodes the payload of a _version_ state, returns 0 when every */
+/* field is in range                                                            */
+static int state_decode(c8_state_fields* s, const UBIT8* p, UBIT32 version)
+{
+    /* Before version 3 the machine had 4 KB and a single 64x32 plane */
+    s->mem_size = (version >= 3) ? C8_RAM_SIZE : C8_MEM_SIZE;
+    s->disp_words = (version >= 3) ? C8_PLANE_WORDS : DISP_H;
+    s->disp_planes = (version >= 3) ? C8_PLANES : 1;
+
+    s->pc = get32(&p);
+    s->sp = get32(&p);
+    s->opcode = get32(&p);
+    s->index = get32(&p);
+    s->delay_timer = get32(&p);
+    s->sound_timer = get32(&p);
+
+    s->memory = p;
+    p += s->mem_size;
+    s->registers = p;
+    p += 16;
+
+    for(int i = 0; i < 16; i++)
+    {
+        s->stack[i] = get32(&p);
+    }
+
+    s->display = p;
+    p += (size_t)s->disp_planes * s->disp_words * 8;
+
+    s->keyboard = p;
+    p += 16;
+    s->waiting_key = *p++;
+    s->key_register = *p++;
+
+    if(version >= 2)
+    {
+        s->rng = get64(&p);
+        s->frame = get64(&p);
+        s->clock = get32(&p);
+    }
+
+    if(version >= 3)
+    {
+        s->hires = *p++;
+        s->planes = *p++;
+        s->pitch = *p++;
+        s->xo_audio = *p++;
+        s->flags = p;
+        p += 16;
+        s->pattern = p;
+    }
+
+    if(s->pc >= C8_RAM_SIZE || s->index >= C8_RAM_SIZE || s->sp > 16 || s->opcode > 0xFFFF
+        || s->delay_timer > 0xFFFF || s->sound_timer > 0xFFFF)
+    {
+        return 1;
+    }
+
+    for(int i = 0; i < 16; i++)
+    {
+        if(s->stack[i] >= C8_RAM_SIZE)
+        {
+            return 1;
+        }
+    }
+
+    if(version >= 3 && (s->hires > 1 || s->planes > 0x3))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+int c8_state_load(Chip8* chip8, const UBIT8* buf, size_t len)
+{
+    const UBIT8* p = buf;
+    c8_state_fields s;
+    UBIT32 version = 0;
+    UBIT32 flags = 0;
+    UBIT32 payload = 0;
+
+    if(len < C8_STATE_HEADER || memcmp(p, c8_state_magic, sizeof(c8_state_magic)) != 0)
+    {
+        return 1;
+    }
+
+    p += sizeof(c8_state_magic);
+    version = get16(&p);
+    flags = get16(&p);
+    payload = get32(&p);
+
+    /* Version 4 only added the quirks to the flags, the payload is the same as version 3 */
+    if(!(version == 1 && payload == C8_STATE_PAYLOAD_V1) &&
+       !(version == 2 && payload == C8_STATE_PAYLOAD_V2) &&
+       !(version >= 3 && version <= C8_STATE_VERSION && payload == C8_STATE_PAYLOAD))
+    {
+        return 1;
+    }
+
+    /* The flags were always 0 before version 4 */
+    if(flags >= C8_QUIRK_SETS)
+    {
+        return 1;
+    }
+
+    if(len < C8_STATE_HEADER + payload)
+    {
+        return 1;
+    }
+
+    /* A state out of range leaves the machine as it was */
+    memset(&s, 0, sizeof(s));
+    if(state_decode(&s, p, version) != 0)
+    {
+        return 1;
+    }
+
+    chip8->pc = s.pc;
+    chip8->sp = s.sp;
+    chip8->opcode = s.opcode;
+    chip8->index = s.index;
+    chip8->delay_timer = s.delay_timer;
+    chip8->sound_timer = s.sound_timer;
+
+    memset(chip8->memory, 0, sizeof(chip8->memory));
+    memcpy(chip8->memory, s.memory, s.mem_size);
+    memcpy(chip8->registers, s.registers, 16);
+
+    for(int i = 0; i < 16; i++)
+    {
+        chip8->stack[i] = s.stack[i];
+    }
+
+    p = s.display;
+    memset(chip8->display, 0, sizeof(chip8->display));
+    for(int pl = 0; pl < s.disp_planes; pl++)
+    {
+        for(int i = 0; i < s.disp_words; i++)
+        {
+            chip8->display[pl][i] = get64(&p);
+        }
+    }
+
+    memcpy(chip8->keyboard, s.keyboard, 16);
+    chip8->waiting_key = (s.waiting_key != 0) ? STD_TRUE : STD_FALSE;
+    chip8->key_register = s.key_register & 0xF;
+
+    if(version >= 2)
+    {
+        chip8->rng = s.rng;
+        if(chip8->rng == 0)
+        {
+            c8_seed(chip8, C8_DEFAULT_SEED); /* xorshift never leaves zero */
+        }
+        chip8->frame = s.frame;
+        chip8->clock = s.clock;
+    }
+    else
+    {
+        c8_seed(chip8, C8_DEFAULT_SEED);
+        chip8->frame = 0;
+        chip8->clock = 0;
+    }
+
+    if(version >= 3)
+    {
+        chip8->hires = s.hires;
+        chip8->planes = s.planes;
+        chip8->pitch = s.pitch;
+        chip8->xo_audio = (s.xo_audio != 0) ? STD_TRUE : STD_FALSE;
+        memcpy(chip8->flags, s.flags, 16);
+        memcpy(chip8->pattern, s.pattern, 16);
+    }
+    else
+    {
+        /* Older states lost the fonts above the small one */
+        memcpy(&chip8->memory[BIGFONT_ADDR], c8_bigfont, sizeof(c8_bigfont));
+        chip8->hires = 0;
+        chip8->planes = 0x1;
+        chip8->pitch = 64;
+        chip8->xo_audio = STD_FALSE;
+        memset(chip8->flags, 0, sizeof(chip8->flags));
+        memset(chip8->pattern, 0, sizeof(chip8->pattern));
+    }
+
+    /* A restored machine has not faulted yet */
+    chip8->fault.kind = C8_FAULT_NONE;
+    chip8->fault.pc = 0;
+    chip8->fault.opcode = 0;
+
+    /* Memory was replaced wholesale: drop every decoded or compiled block */
+    if(version >= 4)
+        c8_set_quirks(chip8, (UBIT8)flags);
+    else
+        c8_invalidate_all(chip8);
+    chip8->display_dirty = STD_TRUE;
+
+    return 0;
+}
+
+int c8_state_write(const Chip8* chip8, const char* filename)
+{
+    UBIT8 buf[C8_STATE_SIZE];
+    FILE* f = NULL;
+    int ret = 0;
+
+    if(!(f = fopen(filename, "wb")))
+    {
+        return 1;
+    }
+
+    c8_state_save(chip8, buf);
+
+    if(fwrite(buf, 1, sizeof(buf), f) != sizeof(buf))
+    {
+        ret = 1;
+    }
+
+    if(fclose(f) != 0)
+    {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+int c8_state_read(Chip8* chip8, const char* filename)
+{
+    UBIT8 buf[C8_STATE_SIZE];
+    FILE* f = NULL;
+    size_t len = 0;
+
+    if(!(f = fopen(filename, "rb")))
+    {
+        return 1;
+    }
+
+    len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    return c8_state_load(chip8, buf, len);
+}
+
+/* ---- Rewind buffer ---- */
+
+/* Worst case size of an encoded delta: every byte literal, plus the run headers */
+#define C8_DELTA_MAX    (C8_STATE_SIZE + C8_STATE_SIZE / 64 + 16)
+
+typedef struct
+{
+    size_t offset;   /* Start of the record in the arena */
+    size_t length;   /* Record length in bytes */
+    size_t keyframe; /* Sequence number of the keyframe the delta applies to */
+    STD_BOOL key;    /* Raw state instead of a delta */
+} C8RewindFrame;
+
+struct C8Rewind
+{
+    UBIT8*         arena;       /* Circular byte storage for the records */
+    size_t         arena_size;
+    size_t         head;        /* Next write offset in the arena */
+    C8RewindFrame* frames;      /* Circular record index */
+    size_t         frame_cap;
+    size_t         first;       /* Sequence number of the oldest record */
+    size_t         next;        /* Sequence number of the next record */
+    unsigned       interval;    /* Frames between keyframes */
+    unsigned       since_key;   /* Deltas pushed since the current keyframe */
+    size_t         keyframe;    /* Sequence number of the current keyframe */
+    UBIT8          key[C8_STATE_SIZE];     /* Copy of the current keyframe */
+    UBIT8          scratch[C8_DELTA_MAX];  /* Encoding / decoding buffer */
+};
+
+/* Keyframes are deltas against this blank state */
+static const UBIT8 c8_blank_state[C8_STATE_SIZE];
+
+/* Deltas are a sequence of (skip, literal count, literal bytes) runs where  */
+/* the counts are LEB128 varints and the literals are XORed with the key    */
+
+static UBIT8* put_varint(UBIT8* p, size_t v)
+{
+    while(v >= 0x80)
+    {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+
+    *p++ = (UBIT8)v;
+
+    return p;
+}
+
+static size_t get_varint(const UBIT8** p)
+{
+    size_t v = 0;
+    int shift = 0;
+
+    while(**p & 0x80)
+    {
+        v |= (size_t)(*(*p)++ & 0x7F) << shift;
+        shift += 7;
+    }
+
+    v |= (size_t)(*(*p)++) << shift;
+
+    return v;
+}
+
+static size_t delta_encode(const UBIT8* key, const UBIT8* state, UBIT8* out)
+{
+    UBIT8* p = out;
+    size_t i = 0;
+
+    while(i < C8_STATE_SIZE)
+    {
+        size_t skip = i;
+        size_t lit = 0;
+
+        while(i < C8_STATE_SIZE && key[i] == state[i])
+            i++;
+
+        skip = i - skip;
+        lit = i;
+
+        /* Literal runs absorb short equal gaps: a new run header costs two bytes */
+        while(i < C8_STATE_SIZE &&
+              (key[i] != state[i] ||
+               (i + 2 < C8_STATE_SIZE && (key[i + 1] != state[i + 1] || key[i + 2] != state[i + 2]))))
+            i++;
+
+        lit = i - lit;
+
+        if(lit == 0)
+            break;
+
+        p = put_varint(p, skip);
+        p = put_varint(p, lit);
+
+        for(size_t j = i - lit; j < i; j++)
+            *p++ = key[j] ^ state[j];
+    }
+
+    return p - out;
+}
+
+static void delta_apply(const UBIT8* delta, size_t len, UBIT8* state)
+{
+    const UBIT8* p = delta;
+    const UBIT8* end = delta + len;
+    size_t i = 0;
+
+    while(p < end)
+    {
+        size_t lit = 0;
+
+        i += get_varint(&p);
+        lit = get_varint(&p);
+
+        while(lit--)
+            state[i++] ^= *p++;
+    }
+}
+
+static C8RewindFrame* rewind_frame(const C8Rewind* rw, size_t seq)
+{
+    return &rw->frames[seq % rw->frame_cap];
+}
+
+static STD_BOOL ranges_overlap(size_t a, size_t alen, size_t b, size_t blen)
+{
+    return (a < b + blen && b < a + alen) ? STD_TRUE : STD_FALSE;
+}
+
+/* This function drops the oldest record, and the deltas that depended on it */
+static void rewind_drop_oldest(C8Rewind* rw)
+{
+    rw->first++;
+
+    while(rw->first < rw->next && rewind_frame(rw, rw->first)->key == STD_FALSE)
+    {
+        rw->first++;
+    }
+}
+
+/* This function reserves _len_ bytes in the arena, evicting what overlaps */
+static size_t rewind_reserve(C8Rewind* rw, size_t len)
+{
+    size_t at = rw->head;
+    size_t tail = rw->arena_size;
+
+    /* Wrapping around also gives up the unused end of the arena */
+    if(at + len > rw->arena_size)
+    {
+        tail = at;
+        at = 0;
+    }
+
+    while(rw->first < rw->next)
+    {
+        C8RewindFrame* old = rewind_frame(rw, rw->first);
+
+        if(ranges_overlap(at, len, old->offset, old->length) == STD_FALSE &&
+           ranges_overlap(tail, rw->arena_size - tail, old->offset, old->length) == STD_FALSE &&
+           rw->next - rw->first < rw->frame_cap)
+        {
+            break;
+        }
+
+        rewind_drop_oldest(rw);
+    }
+
+    rw->head = at + len;
+
+    return at;
+}
+
+static void rewind_store(C8Rewind* rw, const UBIT8* data, size_t len, STD_BOOL key)
+{
+    C8RewindFrame* fr = NULL;
+    size_t at = 0;
+
+    at = rewind_reserve(rw, len);
+    memcpy(&rw->arena[at], data, len);
+
+    fr = rewind_frame(rw, rw->next);
+    fr->offset = at;
+    fr->length = len;
+    fr->key = key;
+    fr->keyframe = (key == STD_TRUE) ? rw->next : rw->keyframe;
+
+    if(key == STD_TRUE)
+    {
+        rw->keyframe = rw->next;
+    }
+
+    rw->next++;
+}
+
+C8Rewind* c8_rewind_create(size_t bytes, size_t frames, unsigned keyframe_interval)
+{
+    C8Rewind* rw = NULL;
+
+    /* The arena must at least hold one keyframe and its worst case delta */
+    if(bytes < 2 * C8_DELTA_MAX || frames < 2)
+    {
+        return NULL;
+    }
+
+    rw = calloc(1, sizeof(C8Rewind));
+    if(rw == NULL)
+    {
+        return NULL;
+    }
+
+    rw->arena = malloc(bytes);
+    rw->frames = calloc(frames, sizeof(C8RewindFrame));
+    if(rw->arena == NULL || rw->frames == NULL)
+    {
+        c8_rewind_free(rw);
+        return NULL;
+    }
+
+    rw->arena_size = bytes;
+    rw->frame_cap = frames;
+    rw->interval = (keyframe_interval == 0) ? 1 : keyframe_interval;
+
+    return rw;
+}
+
+void c8_rewind_free(C8Rewind* rw)
+{
+    if(rw == NULL)
+    {
+        return;
+    }
+
+    free(rw->arena);
+    free(rw->frames);
+    free(rw);
+}
+
+/* This function records _state_ as a keyframe */
+static void rewind_push_key(C8Rewind* rw, const UBIT8* state)
+{
+    memcpy(rw->key, state, C8_STATE_SIZE);
+    rewind_store(rw, rw->scratch, delta_encode(c8_blank_state, state, rw->scratch), STD_TRUE);
+    rw->since_key = 0;
+}
+
+void c8_rewind_push(C8Rewind* rw, const Chip8* chip8)
+{
+    UBIT8 state[C8_STATE_SIZE];
+
+    c8_state_save(chip8, state);
+
+    /* A new keyframe is due, or the current one was evicted */
+    if(rw->first == rw->next || rw->keyframe < rw->first || rw->since_key + 1 >= rw->interval)
+    {
+        rewind_push_key(rw, state);
+        return;
+    }
+
+    rewind_store(rw, rw->scratch, delta_encode(rw->key, state, rw->scratch), STD_FALSE);
+
+    /* The delta may have evicted its own keyframe: promote to a keyframe instead */
+    if(rw->keyframe < rw->first)
+    {
+        rw->next--;
+        rw->head = rewind_frame(rw, rw->next)->offset;
+        rewind_push_key(rw, state);
+        return;
+    }
+
+    rw->since_key++;
+}
+
+int c8_rewind_step_back(C8Rewind* rw, Chip8* chip8, size_t frames)
+{
+    C8RewindFrame* fr = NULL;
+    C8RewindFrame* key = NULL;
+    UBIT8 state[C8_STATE_SIZE];
+    size_t seq = 0;
+
+    if(frames >= rw->next - rw->first)
+    {
+        return 1;
+    }
+
+    seq = rw->next - 1 - frames;
+    fr = rewind_frame(rw, seq);
+    key = rewind_frame(rw, fr->keyframe);
+
+    memset(state, 0, C8_STATE_SIZE);
+    delta_apply(&rw->arena[key->offset], key->length, state);
+    memcpy(rw->scratch, state, C8_STATE_SIZE);
+
+    if(fr->key == STD_FALSE)
+    {
+        delta_apply(&rw->arena[fr->offset], fr->length, state);
+    }
+
+    if(c8_state_load(chip8, state, C8_STATE_SIZE) != 0)
+    {
+        return 1;
+    }
+
+    /* Forget the newer frames and continue recording from the restored one */
+    rw->next = seq + 1;
+    rw->head = fr->offset + fr->length;
+    rw->keyframe = fr->keyframe;
+    rw->since_key = (unsigned)(seq - fr->keyframe);
+    memcpy(rw->key, rw->scratch, C8_STATE_SIZE);
+
+    return 0;
+}
+
+size_t c8_rewind_frames(const C8Rewind* rw)
+{
+    return rw->next - rw->first;
+}
+
+size_t c8_rewind_bytes(const C8Rewind* rw)
+{
+    size_t total = 0;
+
+    for(size_t seq = rw->first; seq < rw->next; seq++)
+    {
+        total += rewind_frame(rw, seq)->length;
+    }
+
+    return total;
+}
@@ -0,0 +1,79 @@
+#ifndef CHIP8_STATE_H
+#define CHIP8_STATE_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* Save states                                                          */
+/*                                                                      */
+/* Layout (little endian, version 4):                                   */
+/*   "C8ST", u16 version, u16 flags (C8_QUIRK_* set), u32 payload length */
+/*   u32 pc, sp, opcode, index, delay_timer, sound_timer                */
+/*   u8  memory[65536], registers[16]                                   */
+/*   u32 stack[16]                                                      */
+/*   u64 display[2][128] (per plane, rows packed from word 0, MSB x=0)  */
+/*   u8  keyboard[16], waiting_key, key_register                        */
+/*   u64 rng, frame; u32 clock                                          */
+/*   u8  hires, planes, pitch, xo_audio, flags[16], pattern[16]         */
+/*                                                                      */
+/* Version 1 to 3 states (4096 bytes of memory, one 64x32 plane, no    */
+/* PRNG and clock before version 2, no quirks before version 4) still   */
+/* load and keep the quirks the machine has.                            */
+
+#define C8_STATE_VERSION  4
+#define C8_STATE_HEADER   12
+#define C8_STATE_PAYLOAD_V1 (6 * 4 + C8_MEM_SIZE + 16 + 16 * 4 + DISP_H * 8 + 16 + 2)
+#define C8_STATE_PAYLOAD_V2 (C8_STATE_PAYLOAD_V1 + 8 + 8 + 4)
+#define C8_STATE_PAYLOAD  (6 * 4 + C8_RAM_SIZE + 16 + 16 * 4 + C8_PLANES * C8_PLANE_WORDS * 8 + 16 + 2 \
+                           + 8 + 8 + 4 + 4 + 16 + 16)
+#define C8_STATE_SIZE     (C8_STATE_HEADER + C8_STATE_PAYLOAD)
+
+/* This function serializes the machine into _buf_ (C8_STATE_SIZE bytes) */
+void c8_state_save(const Chip8* chip8, UBIT8* buf);
+
+/* This function restores the machine from _buf_, returns 0 on success. A state */
+/* that is truncated or holds a field out of range (sp above 16, pc, I or a     */
+/* return address past the memory, hires, planes or quirks unknown) returns 1  */
+/* and leaves the machine untouched. Version 4 states select their quirks with  */
+/* c8_set_quirks.                                                               */
+int c8_state_load(Chip8* chip8, const UBIT8* buf, size_t len);
+
+/* This function writes a save state file, returns 0 on success */
+int c8_state_write(const Chip8* chip8, const char* filename);
+
+/* This function reads a save state file, returns 0 on success */
+int c8_state_read(Chip8* chip8, const char* filename);
+
+/* Rewind buffer                                                        */
+/*                                                                      */
+/* Every pushed frame is stored as a save state XORed against the last  */
+/* keyframe and run-length encoded, so restoring any frame costs one    */
+/* keyframe decode plus one delta decode. Keyframes are encoded against */
+/* a blank state, which keeps the mostly unused XO-CHIP memory small.   */
+/* The oldest frames are dropped when the byte arena or the frame ring  */
+/* is full.                                                             */
+
+typedef struct C8Rewind C8Rewind;
+
+/* This function creates a rewind buffer of _bytes_ bytes holding up to _frames_ */
+/* frames, with a keyframe every _keyframe_interval_ frames                     */
+C8Rewind* c8_rewind_create(size_t bytes, size_t frames, unsigned keyframe_interval);
+
+/* This function releases a rewind buffer */
+void c8_rewind_free(C8Rewind* rw);
+
+/* This function records the current state of the machine as a new frame */
+void c8_rewind_push(C8Rewind* rw, const Chip8* chip8);
+
+/* This function restores the frame recorded _frames_ pushes ago (0 = the last one) */
+/* and forgets every newer frame. Returns 0 on success, 1 if there is no such frame */
+int c8_rewind_step_back(C8Rewind* rw, Chip8* chip8, size_t frames);
+
+/* This function returns the number of recorded frames */
+size_t c8_rewind_frames(const C8Rewind* rw);
+
+/* This function returns the bytes used by the recorded frames */
+size_t c8_rewind_bytes(const C8Rewind* rw);
+
+#endif /* CHIP8_STATE_H */
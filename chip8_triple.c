@@ -0,0 +1,37 @@
+#include <string.h>
+
+#include "chip8_triple.h"
+
+/* ---- Triple buffered frames ---- */
+
+void c8_triple_init(C8TripleBuffer* tb)
+{
+    memset(tb->buffers, 0, sizeof(tb->buffers));
+
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+}
+
+void c8_triple_publish(C8TripleBuffer* tb)
+{
+    /* Release: the frame contents are visible before the index is */
+    UBIT8 old = atomic_exchange_explicit(&tb->middle, tb->back | C8_TRIPLE_FRESH, memory_order_acq_rel);
+
+    tb->back = old & ~C8_TRIPLE_FRESH;
+}
+
+const C8Frame* c8_triple_acquire(C8TripleBuffer* tb)
+{
+    UBIT8 old = 0;
+
+    if((atomic_load_explicit(&tb->middle, memory_order_relaxed) & C8_TRIPLE_FRESH) == 0)
+    {
+        return NULL;
+    }
+
+    old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+    tb->front = old & ~C8_TRIPLE_FRESH;
+
+    return &tb->buffers[tb->front];
+}
@@ -0,0 +1,51 @@
+#ifndef CHIP8_TRIPLE_H
+#define CHIP8_TRIPLE_H
+
+#include <stdatomic.h>
+
+#include "chip8.h"
+#include "chip8_input.h"
+
+/* Triple buffered frames                                               */
+/*                                                                      */
+/* The emulation thread fills the back buffer and publishes it by       */
+/* swapping it with the middle one; the render thread takes the middle  */
+/* buffer in exchange for its front one when a new frame is there.      */
+/* Both sides only exchange an index, neither ever waits, and the       */
+/* renderer always sees the latest complete frame.                      */
+
+typedef struct
+{
+    UBIT64 display[C8_PLANES][C8_PLANE_WORDS]; /* Same layout as Chip8.display */
+    UBIT8  hires;                              /* Same as Chip8.hires */
+    UBIT64 frame;                              /* chip8->frame when it was published */
+    C8InputSample input;                       /* Last key change the frame answers (c8_input_sample) */
+} C8Frame;
+
+typedef struct
+{
+    C8Frame       buffers[3];
+    _Atomic UBIT8 middle; /* Index of the middle buffer, C8_TRIPLE_FRESH when unread */
+    UBIT8         back;   /* Owned by the producer */
+    UBIT8         front;  /* Owned by the consumer */
+} C8TripleBuffer;
+
+#define C8_TRIPLE_FRESH 0x4
+
+/* This function initializes the three buffers to a blank display */
+void c8_triple_init(C8TripleBuffer* tb);
+
+/* This function returns the buffer the producer may fill */
+static inline C8Frame* c8_triple_back(C8TripleBuffer* tb)
+{
+    return &tb->buffers[tb->back];
+}
+
+/* This function publishes the back buffer, a frame the consumer did not take is dropped */
+void c8_triple_publish(C8TripleBuffer* tb);
+
+/* This function returns the latest published frame, or NULL when nothing */
+/* new was published since the previous call                              */
+const C8Frame* c8_triple_acquire(C8TripleBuffer* tb);
+
+#endif /* CHIP8_TRIPLE_H */
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_debug.h"
+
+/* ---- Defines ----*/
+
+#define LINE_SIZE      256
+#define DEFAULT_FRAMES 3600 /* Frames a run command may take, one minute */
+#define DEFAULT_LIST   8    /* Instructions listed by dis */
+
+/* ---- Debugger frontend (no SDL) ---- */
+
+static const char* stop_names[] = {
+    [C8_DEBUG_RUNNING]    = "running",
+    [C8_DEBUG_BREAKPOINT] = "breakpoint",
+    [C8_DEBUG_WATCHPOINT] = "watchpoint",
+    [C8_DEBUG_CONDITION]  = "condition",
+    [C8_DEBUG_STEP]       = "step",
+    [C8_DEBUG_FAULT]      = "fault"
+};
+
+static const char* cmp_names[] = {
+    [C8_DEBUG_EQ] = "==",
+    [C8_DEBUG_NE] = "!=",
+    [C8_DEBUG_LT] = "<",
+    [C8_DEBUG_LE] = "<=",
+    [C8_DEBUG_GT] = ">",
+    [C8_DEBUG_GE] = ">="
+};
+
+static const char* reg_names[] = {
+    "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7",
+    "v8", "v9", "va", "vb", "vc", "vd", "ve", "vf",
+    [C8_DEBUG_REG_I] = "i", [C8_DEBUG_REG_DT] = "dt", [C8_DEBUG_REG_ST] = "st", [C8_DEBUG_REG_SP] = "sp"
+};
+
+/* This function looks up a condition register by name, returns 0 on success */
+static int debugger_register(const char* name, UBIT8* reg)
+{
+    for(UBIT8 r = 0; r <= C8_DEBUG_REG_SP; r++)
+    {
+        if(strcasecmp(name, reg_names[r]) == 0)
+        {
+            *reg = r;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* This function looks up a comparison by its operator, returns 0 on success */
+static int debugger_cmp(const char* name, C8_DEBUG_CMP* cmp)
+{
+    for(int c = C8_DEBUG_EQ; c <= C8_DEBUG_GE; c++)
+    {
+        if(strcmp(name, cmp_names[c]) == 0)
+        {
+            *cmp = (C8_DEBUG_CMP)c;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* This function prints the instruction at _addr_, returns its size */
+static int debugger_list_one(const Chip8* chip8, UBIT16 addr)
+{
+    char text[32];
+    UBIT16 a = addr & (C8_RAM_SIZE - 1);
+    UBIT16 opcode = (chip8->memory[a] << 8) | chip8->memory[(a + 1) & (C8_RAM_SIZE - 1)];
+    UBIT16 next = (chip8->memory[(a + 2) & (C8_RAM_SIZE - 1)] << 8) | chip8->memory[(a + 3) & (C8_RAM_SIZE - 1)];
+    int length = c8_disassemble(opcode, next, text, sizeof(text));
+
+    printf("%c%c %03X: %04X  %s\n",
+           (a == chip8->pc) ? '>' : ' ',
+           (c8_debug_has_break(chip8->debug, a) == STD_TRUE && a < C8_MEM_SIZE) ? '*' : ' ',
+           a, opcode, text);
+
+    return length;
+}
+
+static void debugger_regs(const Chip8* chip8)
+{
+    for(int r = 0; r < 16; r++)
+    {
+        printf("V%X=%02X%c", r, chip8->registers[r], (r % 8 == 7) ? '\n' : ' ');
+    }
+
+    printf("PC=%03X I=%04X SP=%X DT=%02X ST=%02X frame=%llu%s\n",
+           chip8->pc, chip8->index, chip8->sp, chip8->delay_timer, chip8->sound_timer,
+           (unsigned long long)chip8->frame, (chip8->waiting_key == STD_TRUE) ? " waiting_key" : "");
+
+    for(int s = 0; s < chip8->sp && s < 16; s++)
+    {
+        printf("stack[%d]=%03X\n", s, chip8->stack[s]);
+    }
+}
+
+/* This function runs frames until the debugger stops the machine or _frames_ */
+/* frames went by, then reports where it is                                  */
+static void debugger_run(Chip8* chip8, unsigned long ipf, unsigned long frames)
+{
+    const C8Debug* debug = chip8->debug;
+    unsigned long executed = 0;
+
+    for(unsigned long f = 0; f < frames; f++)
+    {
+        executed += c8_run_frame(chip8, ipf);
+
+        if(c8_debug_stopped(chip8) == STD_TRUE)
+        {
+            break;
+        }
+    }
+
+    printf("%s after %lu cycles", stop_names[debug->stop], executed);
+    if(debug->stop == C8_DEBUG_WATCHPOINT)
+        printf(" at %04X", debug->stop_addr);
+    else if(debug->stop == C8_DEBUG_CONDITION)
+        printf(" %zu", debug->stop_condition);
+    else if(debug->stop == C8_DEBUG_FAULT)
+        printf(" %s at %03X", c8_fault_name(chip8->fault.kind), chip8->fault.pc);
+    printf("\n");
+
+    debugger_list_one(chip8, chip8->pc);
+}
+
+/* This function runs the command loop: one command per line on stdin */
+static void debugger_serve(Chip8* chip8, unsigned long ipf)
+{
+    char line[LINE_SIZE];
+    C8Debug* debug = chip8->debug;
+
+    while(fgets(line, sizeof(line), stdin) != NULL)
+    {
+        char* cmd = strtok(line, " \t\r\n");
+        char* arg1 = (cmd != NULL) ? strtok(NULL, " \t\r\n") : NULL;
+        char* arg2 = (arg1 != NULL) ? strtok(NULL, " \t\r\n") : NULL;
+        char* arg3 = (arg2 != NULL) ? strtok(NULL, " \t\r\n") : NULL;
+        unsigned long frames = DEFAULT_FRAMES;
+
+        if(cmd == NULL)
+        {
+            continue;
+        }
+
+        if(strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0)
+        {
+            break;
+        }
+
+        if((strcmp(cmd, "break") == 0 || strcmp(cmd, "delete") == 0) && arg1 != NULL)
+        {
+            c8_debug_break(debug, (UBIT16)strtoul(arg1, NULL, 16), (cmd[0] == 'b') ? STD_TRUE : STD_FALSE);
+        }
+        else if((strcmp(cmd, "watch") == 0 || strcmp(cmd, "unwatch") == 0) && arg1 != NULL)
+        {
+            UBIT32 len = (arg2 != NULL) ? strtoul(arg2, NULL, 0) : 1;
+
+            c8_debug_watch(debug, strtoul(arg1, NULL, 16), len, (cmd[0] == 'w') ? STD_TRUE : STD_FALSE);
+        }
+        else if(strcmp(cmd, "cond") == 0 && arg3 != NULL)
+        {
+            UBIT8 reg = 0;
+            C8_DEBUG_CMP cmp = C8_DEBUG_EQ;
+            int i = -1;
+
+            if(debugger_register(arg1, &reg) == 0 && debugger_cmp(arg2, &cmp) == 0)
+            {
+                i = c8_debug_condition(debug, reg, cmp, (UBIT16)strtoul(arg3, NULL, 0));
+            }
+
+            if(i < 0)
+                printf("error bad condition\n");
+            else
+                printf("condition %d: %s %s %s\n", i, reg_names[reg], cmp_names[cmp], arg3);
+        }
+        else if(strcmp(cmd, "uncond") == 0 && arg1 != NULL)
+        {
+            c8_debug_uncondition(debug, strtoul(arg1, NULL, 0));
+        }
+        else if(strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0 ||
+                strcmp(cmd, "next") == 0 || strcmp(cmd, "n") == 0 ||
+                strcmp(cmd, "finish") == 0)
+        {
+            c8_debug_step(chip8, (cmd[0] == 's') ? C8_DEBUG_INTO : (cmd[0] == 'n') ? C8_DEBUG_OVER : C8_DEBUG_OUT);
+            debugger_run(chip8, ipf, frames);
+        }
+        else if(strcmp(cmd, "continue") == 0 || strcmp(cmd, "c") == 0)
+        {
+            if(arg1 != NULL)
+            {
+                frames = strtoul(arg1, NULL, 0);
+            }
+
+            c8_debug_step(chip8, C8_DEBUG_CONTINUE);
+            debugger_run(chip8, ipf, frames);
+        }
+        else if(strcmp(cmd, "regs") == 0)
+        {
+            debugger_regs(chip8);
+        }
+        else if(strcmp(cmd, "dis") == 0)
+        {
+            UBIT16 addr = (arg1 != NULL) ? (UBIT16)strtoul(arg1, NULL, 16) : chip8->pc;
+            unsigned long count = (arg2 != NULL) ? strtoul(arg2, NULL, 0) : DEFAULT_LIST;
+
+            for(unsigned long i = 0; i < count; i++)
+            {
+                addr += debugger_list_one(chip8, addr);
+            }
+        }
+        else if(strcmp(cmd, "mem") == 0 && arg1 != NULL)
+        {
+            UBIT32 addr = strtoul(arg1, NULL, 16) & (C8_RAM_SIZE - 1);
+            UBIT32 len = (arg2 != NULL) ? strtoul(arg2, NULL, 0) : 16;
+
+            for(UBIT32 i = 0; i < len; i++)
+            {
+                if(i % 16 == 0)
+                    printf("%s%04X:", (i > 0) ? "\n" : "", (addr + i) & (C8_RAM_SIZE - 1));
+                printf(" %02X", chip8->memory[(addr + i) & (C8_RAM_SIZE - 1)]);
+            }
+            printf("\n");
+        }
+        else if(strcmp(cmd, "key") == 0 && arg2 != NULL)
+        {
+            c8_key_event(chip8, (UBIT8)strtoul(arg1, NULL, 16), (strtoul(arg2, NULL, 0) != 0) ? STD_TRUE : STD_FALSE);
+        }
+        else
+        {
+            printf("error unknown command %s\n", cmd);
+        }
+
+        fflush(stdout);
+    }
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-i ipf] [-q quirks] [-e engine] [-b addr]... rom\n", name);
+    fprintf(stderr, "Commands on stdin: break/delete addr, watch/unwatch addr [len], cond reg op value,\n");
+    fprintf(stderr, "uncond n, step, next, finish, continue [frames], regs, dis [addr] [count],\n");
+    fprintf(stderr, "mem addr [len], key k 0|1, quit. Addresses are hexadecimal.\n");
+}
+
+int main(int argc, char* argv[])
+{
+    Chip8* chip8 = NULL;
+    unsigned long ipf = C8_DEFAULT_IPF;
+    UBIT8 quirks = 0;
+    const char* engine = NULL;
+    UBIT16 breakpoints[16];
+    int breakpoint_count = 0;
+    int opt = 0;
+
+    while((opt = getopt(argc, argv, "i:q:e:b:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'i':
+            ipf = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            quirks = (UBIT8)strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            engine = optarg;
+            break;
+        case 'b':
+            if(breakpoint_count < 16)
+                breakpoints[breakpoint_count++] = (UBIT16)strtoul(optarg, NULL, 16);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    chip8 = malloc(sizeof(Chip8));
+    if(chip8 == NULL)
+    {
+        return 1;
+    }
+
+    c8_init(chip8);
+    c8_set_quirks(chip8, quirks);
+
+    if(engine != NULL && c8_set_engine(chip8, engine) != 0)
+    {
+        fprintf(stderr, "Unknown engine %s\n", engine);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+    if(chip8->load_rom(chip8, argv[optind]) != 0 || c8_debug_attach(chip8) == NULL)
+    {
+        fprintf(stderr, "Failed to load %s\n", argv[optind]);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+    for(int b = 0; b < breakpoint_count; b++)
+    {
+        c8_debug_break(chip8->debug, breakpoints[b], STD_TRUE);
+    }
+
+    debugger_list_one(chip8, chip8->pc);
+    fflush(stdout);
+
+    debugger_serve(chip8, ipf);
+
+    c8_deinit(chip8);
+    free(chip8);
+
+    return 0;
+}
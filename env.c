@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chip8_env.h"
+
+/* ---- Defines ----*/
+
+#define DEFAULT_ENVS  1
+#define LINE_SIZE     8192
+#define SHM_DIR       "/dev/shm"
+
+/* ---- Environment server (no SDL) ---- */
+
+/* Reward from a score byte in memory: its increase since the last frame */
+typedef struct
+{
+    long   score_addr; /* -1 = no reward */
+    long   lives_addr; /* -1 = no lives, the episode ends when the byte reaches 0 */
+    UBIT8* score;      /* Last score of every environment */
+} env_rules;
+
+static void env_rules_reset(size_t env, const Chip8* chip8, void* user)
+{
+    env_rules* rules = user;
+
+    if(rules->score_addr >= 0)
+    {
+        rules->score[env] = chip8->memory[rules->score_addr];
+    }
+}
+
+static float env_rules_reward(size_t env, const Chip8* chip8, void* user, STD_BOOL* done)
+{
+    env_rules* rules = user;
+    float reward = 0;
+
+    if(rules->score_addr >= 0)
+    {
+        UBIT8 score = chip8->memory[rules->score_addr];
+
+        reward = (float)score - rules->score[env];
+        rules->score[env] = score;
+    }
+
+    if(rules->lives_addr >= 0 && chip8->memory[rules->lives_addr] == 0)
+    {
+        *done = STD_TRUE;
+    }
+
+    return reward;
+}
+
+/* This function reads a whole ROM file, returns NULL on failure */
+static UBIT8* env_read_rom(const char* filename, size_t* size)
+{
+    UBIT8* rom = malloc(C8_PROGRAM_SIZE + 1);
+    FILE* f = fopen(filename, "rb");
+
+    if(rom == NULL || f == NULL)
+    {
+        free(rom);
+        if(f != NULL)
+            fclose(f);
+        return NULL;
+    }
+
+    *size = fread(rom, 1, C8_PROGRAM_SIZE + 1, f);
+    fclose(f);
+
+    if(*size == 0 || *size > C8_PROGRAM_SIZE)
+    {
+        free(rom);
+        return NULL;
+    }
+
+    return rom;
+}
+
+/* This function runs the command loop: one command per line on stdin, one */
+/* reply per line on stdout                                                 */
+static void env_serve(C8Env* env, UBIT16* actions)
+{
+    char line[LINE_SIZE];
+    const C8EnvHeader* h = c8_env_header(env);
+
+    while(fgets(line, sizeof(line), stdin) != NULL)
+    {
+        char* cmd = strtok(line, " \t\r\n");
+        char* arg = NULL;
+
+        if(cmd == NULL)
+        {
+            continue;
+        }
+
+        if(strcmp(cmd, "quit") == 0)
+        {
+            break;
+        }
+
+        if(strcmp(cmd, "reset") == 0)
+        {
+            arg = strtok(NULL, " \t\r\n");
+            c8_env_reset_all(env, (arg != NULL) ? strtoull(arg, NULL, 0) : 0);
+            memset(actions, 0, h->envs * sizeof(UBIT16));
+        }
+        else if(strcmp(cmd, "step") == 0)
+        {
+            unsigned frameskip = 1;
+
+            arg = strtok(NULL, " \t\r\n");
+            if(arg != NULL)
+            {
+                frameskip = strtoul(arg, NULL, 0);
+            }
+
+            /* Environments without an action keep their keys */
+            for(UBIT32 i = 0; i < h->envs && (arg = strtok(NULL, " \t\r\n")) != NULL; i++)
+            {
+                actions[i] = (UBIT16)strtoul(arg, NULL, 16);
+            }
+
+            c8_env_step_all(env, actions, frameskip);
+        }
+        else
+        {
+            printf("error unknown command %s\n", cmd);
+            fflush(stdout);
+            continue;
+        }
+
+        printf("ok %llu\n", (unsigned long long)atomic_load(&h->steps));
+        fflush(stdout);
+    }
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n envs] [-e engine] [-i ipf] [-q quirks] [-m max_frames] [-a] [-s shm_name] [-r score_addr] [-l lives_addr] rom\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+    C8EnvOptions options = { C8_ENGINE_PREDECODED, C8_DEFAULT_IPF, 0, STD_FALSE, 0 };
+    env_rules rules = { -1, -1, NULL };
+    C8EnvHooks hooks = { env_rules_reward, env_rules_reset, &rules };
+    const char* shm_name = NULL;
+    size_t envs = DEFAULT_ENVS;
+    UBIT16* actions = NULL;
+    UBIT8* rom = NULL;
+    size_t size = 0;
+    C8Env* env = NULL;
+    int opt = 0;
+
+    while((opt = getopt(argc, argv, "n:e:i:q:m:as:r:l:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            envs = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            if(c8_engine_by_name(optarg, &options.engine) != 0)
+            {
+                fprintf(stderr, "Unknown engine %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'i':
+            options.ipf = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            options.quirks = (UBIT8)strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            options.max_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            options.autoreset = STD_TRUE;
+            break;
+        case 's':
+            shm_name = optarg;
+            break;
+        case 'r':
+            rules.score_addr = strtol(optarg, NULL, 0) & (C8_RAM_SIZE - 1);
+            break;
+        case 'l':
+            rules.lives_addr = strtol(optarg, NULL, 0) & (C8_RAM_SIZE - 1);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind + 1 != argc || envs == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    rom = env_read_rom(argv[optind], &size);
+    if(rom == NULL)
+    {
+        fprintf(stderr, "Failed to read %s\n", argv[optind]);
+        return 1;
+    }
+
+    actions = calloc(envs, sizeof(UBIT16));
+    rules.score = calloc(envs, sizeof(UBIT8));
+    env = (actions != NULL && rules.score != NULL) ? c8_env_create(rom, size, envs, shm_name, &options) : NULL;
+    free(rom);
+
+    if(env == NULL)
+    {
+        fprintf(stderr, "Failed to create the environments\n");
+        free(actions);
+        free(rules.score);
+        return 1;
+    }
+
+    c8_env_set_hooks(env, &hooks);
+
+    /* The consumer maps this path to read the observations in place */
+    if(shm_name != NULL)
+        printf("segment %s%s %zu\n", SHM_DIR, shm_name, c8_env_size(env));
+    else
+        printf("segment /proc/%d/fd/%d %zu\n", (int)getpid(), c8_env_fd(env), c8_env_size(env));
+    fflush(stdout);
+
+    env_serve(env, actions);
+
+    c8_env_free(env);
+    free(actions);
+    free(rules.score);
+
+    return 0;
+}
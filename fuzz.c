@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8_fuzz.h"
+
+/* ---- Defines ----*/
+
+#define SECOND_TO_NS    1000000000ULL
+#define DEFAULT_CASES   100000
+#define DEFAULT_PREFIX  "fuzz-fail"
+
+/* ---- Differential fuzzer ---- */
+
+static const char* engine_names[] = {
+    [C8_ENGINE_SWITCH]     = "switch",
+    [C8_ENGINE_PREDECODED] = "predecoded",
+    [C8_ENGINE_JIT]        = "jit",
+    [C8_ENGINE_SANDBOX]    = "sandbox"
+};
+
+static UBIT64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UBIT64)ts.tv_sec * SECOND_TO_NS + ts.tv_nsec;
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-r reference] [-e engine] [-n cases | -t seconds] [-c cycles] [-S seed] [-j threads] [-o prefix] [-d]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+    C8Fuzz* fuzz = calloc(1, sizeof(C8Fuzz));
+    const char* prefix = DEFAULT_PREFIX;
+    const C8FuzzFailure* f = NULL;
+    UBIT64 start = 0;
+    UBIT64 elapsed = 0;
+    int opt = 0;
+
+    if(fuzz == NULL)
+    {
+        return 1;
+    }
+
+    fuzz->reference = C8_ENGINE_SWITCH;
+    fuzz->candidate = C8_ENGINE_JIT;
+    fuzz->cases = DEFAULT_CASES;
+    fuzz->cycles = C8_FUZZ_CYCLES;
+    fuzz->seed = (UBIT64)time(NULL);
+
+    while((opt = getopt(argc, argv, "r:e:n:t:c:S:j:o:d")) != -1)
+    {
+        switch(opt)
+        {
+        case 'r':
+        case 'e':
+            if(c8_engine_by_name(optarg, (opt == 'r') ? &fuzz->reference : &fuzz->candidate) != 0)
+            {
+                fprintf(stderr, "Unknown engine %s\n", optarg);
+                free(fuzz);
+                return 1;
+            }
+            break;
+        case 'n':
+            fuzz->cases = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            /* A time limit runs as many cases as fit */
+            fuzz->seconds = strtoul(optarg, NULL, 0);
+            fuzz->cases = 0;
+            break;
+        case 'c':
+            fuzz->cycles = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            fuzz->seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            fuzz->threads = atoi(optarg);
+            break;
+        case 'o':
+            prefix = optarg;
+            break;
+        case 'd':
+            fuzz->debug = STD_TRUE;
+            break;
+        default:
+            usage(argv[0]);
+            free(fuzz);
+            return 1;
+        }
+    }
+
+    if(optind != argc || (fuzz->cases == 0 && fuzz->seconds == 0) || fuzz->cycles == 0)
+    {
+        usage(argv[0]);
+        free(fuzz);
+        return 1;
+    }
+
+    start = now_ns();
+
+    if(c8_fuzz_run(fuzz) != 0)
+    {
+        fprintf(stderr, "Failed to start the fuzzing threads\n");
+        free(fuzz);
+        return 1;
+    }
+
+    elapsed = now_ns() - start;
+    if(elapsed == 0)
+    {
+        elapsed = 1;
+    }
+
+    printf("engines:        %s/%s%s\n", engine_names[fuzz->reference], engine_names[fuzz->candidate],
+           (fuzz->debug == STD_TRUE) ? " (debugger)" : "");
+    printf("seed:           0x%llx\n", (unsigned long long)fuzz->seed);
+    printf("cases:          %lu\n", fuzz->ran);
+    printf("instructions:   %lu\n", fuzz->executed);
+    printf("elapsed_ns:     %llu\n", (unsigned long long)elapsed);
+    printf("cases_per_min:  %llu\n", (unsigned long long)(fuzz->ran * 60ULL * SECOND_TO_NS / elapsed));
+
+    if(fuzz->failed == 0)
+    {
+        printf("divergence:     none\n");
+        free(fuzz);
+        return 0;
+    }
+
+    f = &fuzz->failure;
+    printf("divergence:     case seed 0x%llx, instruction %lu, pc 0x%03x, opcode 0x%04x\n",
+           (unsigned long long)f->input.seed, f->step, f->pc, f->opcode);
+    printf("differs:        %s\n", f->diff);
+
+    if(c8_fuzz_write(f, prefix) != 0)
+    {
+        fprintf(stderr, "Failed to write the reproducer %s\n", prefix);
+    }
+    else
+    {
+        printf("reproducer:     ./headless -e %s -i %lu -q %u -c %lu -l %s.c8s -s out.c8s %s.ch8 (compare with -e %s)\n",
+               engine_names[fuzz->candidate], f->input.ipf, f->input.quirks, f->step, prefix, prefix, engine_names[fuzz->reference]);
+    }
+
+    free(fuzz);
+
+    return 2;
+}
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "chip8_capture.h"
+#include "chip8_movie.h"
+#include "chip8_profile.h"
+#include "chip8_state.h"
+
+/* ---- Defines ----*/
+
+#define SECOND_TO_NS    1000000000ULL
+
+/* ---- Headless runner (no SDL) ---- */
+
+static const char* movie_status_names[] = {
+    [C8_MOVIE_OK]     = "ok",
+    [C8_MOVIE_ROM]    = "rom_mismatch",
+    [C8_MOVIE_DESYNC] = "desync"
+};
+
+static UBIT64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UBIT64)ts.tv_sec * SECOND_TO_NS + ts.tv_nsec;
+}
+
+void debug_display(Chip8* chip8)
+{
+    for(int i = 0; i < c8_disp_h(chip8); i++)
+    {
+        for(int j = 0; j < c8_disp_w(chip8); j++)
+            (c8_pixel(chip8, j, i) != 0)? printf("X"): printf(" ");
+        printf("\n");
+    }
+}
+
+#ifdef C8_PROFILE
+
+/* This function writes the profile as <prefix>.csv, .json and .folded */
+static int write_profile(const C8Profile* profile, const char* prefix)
+{
+    static const char* ext[] = { "csv", "json", "folded" };
+    char name[4096];
+    int ret = 0;
+
+    for(int i = 0; i < 3; i++)
+    {
+        FILE* f = NULL;
+
+        snprintf(name, sizeof(name), "%s.%s", prefix, ext[i]);
+        if(!(f = fopen(name, "w")))
+        {
+            ret = 1;
+            continue;
+        }
+
+        if(i == 0)
+            c8_profile_write_csv(profile, f);
+        else if(i == 1)
+            c8_profile_write_json(profile, f);
+        else
+            c8_profile_write_folded(profile, f);
+
+        if(fclose(f) != 0)
+            ret = 1;
+    }
+
+    return ret;
+}
+
+#endif
+
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-c cycles | -f frames | -m movie] [-i ipf] [-q quirks] [-e engine] [-S seed] [-l state] [-s state] [-C capture] [-I] [-d] rom\n", name);
+    fprintf(stderr, "       -q selects the C8_QUIRK_* bits: 1 shift Vy, 2 FX55/FX65 increment I, 4 VF reset, 8 clip\n");
+    fprintf(stderr, "       -C capture records every frame of a -f or -m run (decode it with ./capture)\n");
+    fprintf(stderr, "       -I runs idle loops cycle by cycle instead of fast-forwarding them\n");
+#ifdef C8_PROFILE
+    fprintf(stderr, "       -p prefix writes the profile to prefix.csv, prefix.json and prefix.folded\n");
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    Chip8* chip8 = NULL;
+    unsigned long cycles = 0;
+    unsigned long frames = 0;
+    unsigned long ipf = C8_DEFAULT_IPF;
+    UBIT8 quirks = 0;
+    unsigned long executed = 0;
+    STD_BOOL dump = STD_FALSE;
+    STD_BOOL fast_idle = STD_TRUE;
+    const char* engine = NULL;
+    const char* load_state = NULL;
+    const char* save_state = NULL;
+    const char* movie_file = NULL;
+    const char* capture_file = NULL;
+    C8Capture* capture = NULL;
+    C8Movie movie;
+    C8_MOVIE_STATUS movie_status = C8_MOVIE_OK;
+    UBIT64 seed = C8_DEFAULT_SEED;
+#ifdef C8_PROFILE
+    const char* profile_prefix = NULL;
+#endif
+    UBIT64 start = 0;
+    UBIT64 elapsed = 0;
+    int opt = 0;
+
+    while((opt = getopt(argc, argv, "c:f:m:i:q:e:S:l:s:p:C:Id")) != -1)
+    {
+        switch(opt)
+        {
+        case 'c':
+            cycles = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            movie_file = optarg;
+            break;
+        case 'C':
+            capture_file = optarg;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            ipf = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            quirks = (UBIT8)strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            engine = optarg;
+            break;
+        case 'l':
+            load_state = optarg;
+            break;
+        case 's':
+            save_state = optarg;
+            break;
+#ifdef C8_PROFILE
+        case 'p':
+            profile_prefix = optarg;
+            break;
+#endif
+        case 'I':
+            fast_idle = STD_FALSE;
+            break;
+        case 'd':
+            dump = STD_TRUE;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind != argc - 1 || (cycles == 0 && frames == 0 && movie_file == NULL) ||
+       (capture_file != NULL && frames == 0 && movie_file == NULL))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    chip8 = malloc(sizeof(Chip8));
+    if(chip8 == NULL)
+    {
+        return 1;
+    }
+
+    c8_init(chip8);
+    chip8->fast_idle = fast_idle;
+    c8_set_quirks(chip8, quirks);
+
+    if(engine != NULL && c8_set_engine(chip8, engine) != 0)
+    {
+        fprintf(stderr, "Unknown engine %s\n", engine);
+        free(chip8);
+        return 1;
+    }
+
+    if(chip8->load_rom(chip8, argv[optind]) != 0)
+    {
+        fprintf(stderr, "Failed to load %s\n", argv[optind]);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+    c8_seed(chip8, seed);
+
+    if(movie_file != NULL && c8_movie_read(&movie, movie_file) != 0)
+    {
+        fprintf(stderr, "Failed to read movie %s\n", movie_file);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+    if(load_state != NULL && c8_state_read(chip8, load_state) != 0)
+    {
+        fprintf(stderr, "Failed to load state %s\n", load_state);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+#ifdef C8_PROFILE
+    if(profile_prefix != NULL && c8_profile_attach(chip8) == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the profile\n");
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+#endif
+
+    if(capture_file != NULL && (capture = c8_capture_open(capture_file, STD_TRUE)) == NULL)
+    {
+        fprintf(stderr, "Failed to create capture %s\n", capture_file);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+    start = now_ns();
+
+    if(movie_file != NULL && capture != NULL)
+    {
+        /* Same replay as c8_movie_play, captured frame by frame */
+        size_t next = 0;
+
+        if(c8_program_hash(chip8) != movie.rom_hash)
+        {
+            movie_status = C8_MOVIE_ROM;
+        }
+        else
+        {
+            c8_seed(chip8, movie.seed);
+
+            while(chip8->frame < movie.frames)
+            {
+                executed += c8_movie_step(&movie, chip8, &next);
+                c8_capture_frame(capture, chip8);
+            }
+
+            movie_status = (c8_display_hash(chip8) == movie.display_hash) ? C8_MOVIE_OK : C8_MOVIE_DESYNC;
+        }
+
+        frames = chip8->frame;
+    }
+    else if(movie_file != NULL)
+    {
+        /* Replays run unthrottled: the movie carries its own clock */
+        movie_status = c8_movie_play(&movie, chip8, &executed);
+        frames = chip8->frame;
+    }
+    else if(frames > 0)
+    {
+        for(unsigned long f = 0; f < frames; f++)
+        {
+            executed += c8_run_frame(chip8, ipf);
+
+            if(capture != NULL)
+            {
+                c8_capture_frame(capture, chip8);
+            }
+        }
+    }
+    else
+    {
+        executed = c8_run_clocked(chip8, cycles, ipf);
+        frames = chip8->frame;
+    }
+
+    elapsed = now_ns() - start;
+    if(elapsed == 0)
+    {
+        elapsed = 1;
+    }
+
+    printf("cycles:       %lu\n", executed);
+    printf("frames:       %lu\n", frames);
+    printf("elapsed_ns:   %llu\n", (unsigned long long)elapsed);
+    printf("ips:          %.0f\n", (double)executed * SECOND_TO_NS / elapsed);
+    printf("display_hash: %08x\n", c8_display_hash(chip8));
+    printf("waiting_key:  %s\n", (chip8->waiting_key == STD_TRUE) ? "yes" : "no");
+
+    if(capture != NULL)
+    {
+        printf("capture:      %llu frames, %llu bytes, %llu dropped\n", (unsigned long long)capture->frames,
+               (unsigned long long)capture->bytes, (unsigned long long)capture->dropped);
+
+        if(c8_capture_close(capture) != 0)
+        {
+            fprintf(stderr, "Failed to write capture %s\n", capture_file);
+        }
+    }
+
+    if(movie_file != NULL)
+    {
+        printf("movie:        %s\n", movie_status_names[movie_status]);
+        c8_movie_free(&movie);
+    }
+
+    if(dump == STD_TRUE)
+    {
+        debug_display(chip8);
+    }
+
+#ifdef C8_PROFILE
+    if(profile_prefix != NULL && write_profile(chip8->profile, profile_prefix) != 0)
+    {
+        fprintf(stderr, "Failed to write the profile %s\n", profile_prefix);
+    }
+#endif
+
+    if(save_state != NULL && c8_state_write(chip8, save_state) != 0)
+    {
+        fprintf(stderr, "Failed to save state %s\n", save_state);
+        c8_deinit(chip8);
+        free(chip8);
+        return 1;
+    }
+
+    c8_deinit(chip8);
+    free(chip8);
+
+    return (movie_status == C8_MOVIE_OK) ? 0 : 3;
+}
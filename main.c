@@ -1,149 +1,583 @@
 #include "chip8.h"
-
+#include "chip8_audio.h"
+#include "chip8_blit.h"
+#include "chip8_capture.h"
+#include "chip8_input.h"
+#include "chip8_movie.h"
+#include "chip8_state.h"
+#include "chip8_triple.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#include <math.h>
+#include <unistd.h>
 
 #include <SDL3/SDL.h>
 
+#define PALETTE_SIZE (1 << C8_PLANES) /* Colours the bitplanes combine into */
+
 typedef struct {
     SDL_Window* w;
     SDL_Renderer* r;
-    SDL_Texture* t;
+    SDL_Texture* t[PALETTE_SIZE - 1]; /* One mask per colour, t[c - 1] draws colour c */
+    SDL_AudioStream* a;
+    C8BlitFunc blit; /* Display expansion kernel picked for this CPU */
+    UBIT32 palette[PALETTE_SIZE]; /* 0xRRGGBB per colour index (bit p = plane p), 0 is the background */
+    int width;       /* Native resolution being presented */
+    int height;
+    int layers;      /* Masks presented: 1 while plane 1 is blank, all of them otherwise */
+    UBIT64 masks[PALETTE_SIZE - 1][C8_PLANE_WORDS]; /* Pixels of each colour */
 } window_context;
 
 /* ---- Defines ----*/
 
-#define SECOND_TO_US    1000000
+#define SECOND_TO_NS    1000000000ULL
+#define MAX_LATE_FRAMES 4 /* Frames behind schedule before resynchronising */
+#define REWIND_BYTES    (8 * 1024 * 1024)
+#define REWIND_FRAMES   (10 * 60 * C8_FRAME_HZ) /* Ten minutes of history */
+#define REWIND_KEYFRAME C8_FRAME_HZ
+#define QUICK_STATE     "quick.c8s"
+#define AUDIO_CHUNK     256 /* Samples rendered per call to c8_audio_render */
+#define PALETTE_FG      0xFFFFFF
+#define PALETTE_BG      0x000000
+#define PALETTE_2       0xFF6600 /* XO-CHIP plane 1 only */
+#define PALETTE_3       0x662200 /* XO-CHIP both planes */
+#define WINDOW_SCALE    16
+#define FRAME_SLICES    4 /* Keypad polls per frame */
 
 /* ---- Functions to handle Main Window ---- */
 
+/* This function picks the widest display expansion kernel the CPU runs */
+static C8BlitFunc window_blit(void)
+{
+#if defined(C8_BLIT_X86)
+    if(SDL_HasAVX2())
+        return c8_blit_avx2;
+    if(SDL_HasSSE2())
+        return c8_blit_sse2;
+#endif
+
+    return c8_blit_scalar;
+}
+
 int window_init(window_context* ctx)
 {
     /* Init SDL Subsystems */
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0)
     {
         fprintf(stderr, "SDL failed to initialise: %s\n", SDL_GetError());
         return 1;
     }
 
     /* Create SDL Window */
-    ctx->w = SDL_CreateWindow("Chip8 Emulator", 1024, 512, 0);
+    ctx->w = SDL_CreateWindow("Chip8 Emulator", DISP_W * WINDOW_SCALE, DISP_H * WINDOW_SCALE, SDL_WINDOW_RESIZABLE);
     if(ctx->w == NULL)
     {
         return 1;
     }
 
-    /* Create renderer */
+    /* Create renderer, scaling the native display by whole multiples */
     ctx->r = SDL_CreateRenderer(ctx->w, NULL, 0);
+    ctx->width = DISP_W;
+    ctx->height = DISP_H;
+    ctx->layers = 1;
+    SDL_SetRenderLogicalPresentation(ctx->r, ctx->width, ctx->height, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE, SDL_SCALEMODE_NEAREST);
+
+    /* Create textures: native resolution masks the GPU colours and scales. */
+    /* They fit the high resolution, only the top-left corner is used in   */
+    /* low resolution.                                                     */
+    for(int i = 0; i < PALETTE_SIZE - 1; i++)
+    {
+        UBIT32 colour = ctx->palette[i + 1];
 
-    /* Create texture */
-    ctx->t = SDL_CreateTexture(ctx->r, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, DISP_W, DISP_H);
+        ctx->t[i] = SDL_CreateTexture(ctx->r, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, C8_HIRES_W, C8_HIRES_H);
+        if(ctx->t[i] == NULL)
+        {
+            return 1;
+        }
+
+        SDL_SetTextureScaleMode(ctx->t[i], SDL_SCALEMODE_NEAREST);
+        SDL_SetTextureBlendMode(ctx->t[i], SDL_BLENDMODE_BLEND);
+        SDL_SetTextureColorMod(ctx->t[i], (colour >> 16) & 0xFF, (colour >> 8) & 0xFF, colour & 0xFF);
+    }
+
+    ctx->blit = window_blit();
 
     return 0;
 }
 
-void window_draw(window_context* ctx, Chip8* chip8)
+/* This function presents the textures as they are, e.g. after the window was resized */
+void window_present(window_context* ctx)
 {
-    SDL_FRect rect;
-    void* pixels;
-    int pitch;
+    UBIT32 bg = ctx->palette[0];
+    SDL_FRect src = { 0.0f, 0.0f, (float)ctx->width, (float)ctx->height };
 
+    /* Dark pixels are transparent: the background is the clear colour */
+    SDL_SetRenderDrawColor(ctx->r, (bg >> 16) & 0xFF, (bg >> 8) & 0xFF, bg & 0xFF, 0xFF);
     SDL_RenderClear(ctx->r);
 
-    if(SDL_LockTexture(ctx->t, NULL, &pixels, &pitch))
+    /* The masks do not overlap, each one adds its colour */
+    for(int i = 0; i < ctx->layers; i++)
+    {
+        SDL_RenderTexture(ctx->r, ctx->t[i], &src, NULL);
+    }
+
+    SDL_RenderPresent(ctx->r);
+}
+
+/* This function splits the two planes into one mask per colour, returns 0 when */
+/* plane 1 is blank: plane 0 alone is then the only colour (CHIP-8, SUPER-CHIP)  */
+static int window_masks(window_context* ctx, const C8Frame* f, int words)
+{
+    const UBIT64* p0 = f->display[0];
+    const UBIT64* p1 = f->display[1];
+    UBIT64 used = 0;
+
+    for(int i = 0; i < words; i++)
+    {
+        used |= p1[i];
+    }
+
+    if(used == 0)
+    {
+        return 0;
+    }
+
+    for(int i = 0; i < words; i++)
+    {
+        ctx->masks[0][i] = p0[i] & ~p1[i];
+        ctx->masks[1][i] = p1[i] & ~p0[i];
+        ctx->masks[2][i] = p0[i] & p1[i];
+    }
+
+    return 1;
+}
+
+void window_draw(window_context* ctx, const C8Frame* f)
+{
+    int width = f->hires ? C8_HIRES_W : DISP_W;
+    int height = f->hires ? C8_HIRES_H : DISP_H;
+    SDL_Rect rect = { 0, 0, width, height };
+    void* pixels;
+    int pitch;
+
+    /* Resolution switch (00FE/00FF): scale the new size to the window */
+    if(width != ctx->width)
     {
-        /* Ignore error */
-        return;
+        ctx->width = width;
+        ctx->height = height;
+        SDL_SetRenderLogicalPresentation(ctx->r, width, height, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE, SDL_SCALEMODE_NEAREST);
     }
 
-    for(int i = 0; i < DISP_H;  i++)
+    ctx->layers = window_masks(ctx, f, width * height / 64) ? PALETTE_SIZE - 1 : 1;
+
+    /* Only the native region is uploaded */
+    for(int i = 0; i < ctx->layers; i++)
     {
-        for(int j = 0; j < DISP_W; j++)
+        if(SDL_LockTexture(ctx->t[i], &rect, &pixels, &pitch))
         {
-            ((uint32_t*)pixels)[i * DISP_W + j] = (chip8->display[i][j] == 1) ? 0xFFFFFFFF : 0x00000000;
+            /* Ignore error */
+            return;
         }
+
+        ctx->blit((ctx->layers == 1) ? f->display[0] : ctx->masks[i], width, height, pixels, pitch);
+
+        SDL_UnlockTexture(ctx->t[i]);
     }
 
-    SDL_UnlockTexture(ctx->t);
+    window_present(ctx);
+}
+
+/* ---- Audio ---- */
 
-    rect.x = 0;
-    rect.y = 0;
-    rect.w = 1024;
-    rect.h = 512;
+/* This function feeds the SDL audio stream from the buzzer, on the audio thread */
+static void SDLCALL audio_callback(void* userdata, SDL_AudioStream* stream, int additional_amount, int total_amount)
+{
+    C8Audio* audio = userdata;
+    int16_t samples[AUDIO_CHUNK];
+    int left = additional_amount / (int)sizeof(int16_t);
 
-    SDL_RenderTexture(ctx->r, ctx->t, NULL, &rect);
+    (void)total_amount;
 
-    SDL_RenderPresent(ctx->r);
+    while(left > 0)
+    {
+        int n = (left < AUDIO_CHUNK) ? left : AUDIO_CHUNK;
+
+        c8_audio_render(audio, samples, n);
+        SDL_PutAudioStreamData(stream, samples, n * (int)sizeof(int16_t));
+        left -= n;
+    }
 }
 
-int main_loop(window_context* ctx, Chip8* chip8)
+/* This function opens the default output, the emulator stays silent on failure */
+int audio_init(window_context* ctx, C8Audio* audio)
 {
-    STD_BOOL quit = STD_FALSE;
-    SDL_Event e;
+    SDL_AudioSpec spec;
+
+    spec.format = SDL_AUDIO_S16;
+    spec.channels = 1;
+    spec.freq = C8_AUDIO_RATE;
 
-    struct timespec last_time;
-    struct timespec curr_time;
-    uint64_t timedelta_us = 0;
-    int intructions_per_60_hz = 0;
+    c8_audio_init(audio, C8_AUDIO_RATE);
 
-    if(clock_gettime(CLOCK_MONOTONIC_RAW, &last_time))
+    /* Small device buffers: a buzzer edge must be heard within a frame */
+    SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, "512");
+
+    ctx->a = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_OUTPUT, &spec, audio_callback, audio);
+    if(ctx->a == NULL)
     {
-        // TODO Log
+        fprintf(stderr, "Audio disabled: %s\n", SDL_GetError());
         return 1;
     }
 
-    while(quit == STD_FALSE)
-    { 
-        /* Calculate timedelta */
-        if(clock_gettime(CLOCK_MONOTONIC_RAW, &curr_time))
+    SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(ctx->a));
+
+    return 0;
+}
+
+/* ---- Keyboard ---- */
+
+/* Chip8 keypad on the left side of a QWERTY keyboard:  */
+/*   1 2 3 C        1 2 3 4                             */
+/*   4 5 6 D   <-   Q W E R                             */
+/*   7 8 9 E        A S D F                             */
+/*   A 0 B F        Z X C V                             */
+/* Scancodes are key positions, so other layouts get    */
+/* the same keys; -k maps the keypad elsewhere.          */
+static SDL_Scancode keymap[KEYBOARD_SIZE * KEYBOARD_SIZE] = {
+    SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+    SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+    SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+};
+
+/* This function parses a keypad layout, keys 0 to F: either 16 characters */
+/* ("x123qweasdzc4rfv") or 16 comma separated SDL scancode names           */
+/* ("Keypad 0,Keypad 7,...")                                               */
+int parse_keymap(const char* arg)
+{
+    SDL_Scancode map[KEYBOARD_SIZE * KEYBOARD_SIZE];
+    char name[64];
+    int comma = (strchr(arg, ',') != NULL);
+
+    for(int i = 0; i < KEYBOARD_SIZE * KEYBOARD_SIZE; i++)
+    {
+        size_t len = comma ? strcspn(arg, ",") : (*arg != '\0');
+
+        if(len == 0 || len >= sizeof(name))
         {
-            // TODO Log
             return 1;
         }
 
-        timedelta_us += (curr_time.tv_sec - last_time.tv_sec) * 1000000 +
-                        (curr_time.tv_nsec - last_time.tv_nsec) / 1000;
+        memcpy(name, arg, len);
+        name[len] = '\0';
+        arg += len;
 
-        /* Update timers with a 60Hz frequency */
-        if(timedelta_us > (1.0 / 60.0) * SECOND_TO_US)
+        map[i] = SDL_GetScancodeFromName(name);
+        if(map[i] == SDL_SCANCODE_UNKNOWN)
         {
-            /* Update the timers */
-            if(chip8->delay_timer > 0)
-            {
-                chip8->delay_timer--;
-            }
+            return 1;
+        }
+
+        if(comma && *arg == ',' && i < KEYBOARD_SIZE * KEYBOARD_SIZE - 1)
+        {
+            arg++;
+        }
+    }
+
+    if(*arg != '\0')
+    {
+        return 1;
+    }
+
+    memcpy(keymap, map, sizeof(keymap));
+
+    return 0;
+}
+
+static UBIT64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UBIT64)ts.tv_sec * SECOND_TO_NS + ts.tv_nsec;
+}
+
+/* ---- Emulation thread ---- */
+
+/* State shared by the render (main) thread and the emulation thread. The  */
+/* Chip8, the rewind buffer and the movie belong to the emulation thread;  */
+/* the render thread only talks to it through the atomics and the frames. */
+typedef struct
+{
+    Chip8*         chip8;
+    C8Audio*       audio;
+    C8Rewind*      rw;
+    C8Movie*       movie; /* NULL when not recording */
+    C8Capture*     capture; /* NULL when not capturing */
+    unsigned long  ipf;
+    unsigned       slices;        /* Keypad polls per frame, the instructions are spread over them */
+
+    C8TripleBuffer frames;
+    Uint32         frame_event;   /* SDL user event announcing a published frame */
+    _Atomic int    frame_pending; /* A frame_event is queued and not handled yet */
+
+    C8Input        input;         /* Keypad, published by the render thread */
+    C8InputStats   latency;       /* Input to photon latency, owned by the render thread */
+    _Atomic int    rewinding;
+    _Atomic int    save_request;
+    _Atomic int    load_request;
+    _Atomic int    quit;
+} emu_context;
+
+/* This function publishes a SDL key event to the keypad, if the key is mapped. */
+/* The event is stamped on our clock: its age on the SDL clock is subtracted.   */
+void keyboard_event(emu_context* emu, const SDL_KeyboardEvent* key)
+{
+    Uint64 ticks = SDL_GetTicksNS();
+    UBIT64 age = (ticks > key->timestamp) ? ticks - key->timestamp : 0;
+
+    for(UBIT8 i = 0; i < (KEYBOARD_SIZE * KEYBOARD_SIZE); i++)
+    {
+        if(keymap[i] == key->keysym.scancode)
+        {
+            c8_input_key(&emu->input, i, (key->type == SDL_EVENT_KEY_DOWN) ? STD_TRUE : STD_FALSE, now_ns() - age);
+            return;
+        }
+    }
+}
+
+/* This function handles the emulator hotkeys:               */
+/*   F5 quick save, F9 quick load, Backspace (held) rewinds   */
+/* The emulation thread carries them out at its next frame.  */
+void hotkey_event(emu_context* emu, const SDL_KeyboardEvent* key)
+{
+    switch(key->keysym.scancode)
+    {
+    case SDL_SCANCODE_F5:
+        if(key->type == SDL_EVENT_KEY_DOWN)
+            atomic_store_explicit(&emu->save_request, 1, memory_order_relaxed);
+        break;
+    case SDL_SCANCODE_F9:
+        if(key->type == SDL_EVENT_KEY_DOWN)
+            atomic_store_explicit(&emu->load_request, 1, memory_order_relaxed);
+        break;
+    case SDL_SCANCODE_BACKSPACE:
+        atomic_store_explicit(&emu->rewinding, (key->type == SDL_EVENT_KEY_DOWN) ? 1 : 0, memory_order_relaxed);
+        break;
+    default:
+        keyboard_event(emu, key);
+        break;
+    }
+}
+
+/* This function applies the keypad changes since the previous poll, and */
+/* records them in the movie when a recording is running                 */
+static void emu_keys(emu_context* emu, C8InputReader* reader)
+{
+    UBIT16 changed = c8_input_poll(&emu->input, reader, emu->chip8);
+
+    for(UBIT8 i = 0; changed != 0 && emu->movie != NULL; i++, changed >>= 1)
+    {
+        STD_BOOL pressed = ((reader->keys >> i) & 1) ? STD_TRUE : STD_FALSE;
+
+        if((changed & 1) != 0 && c8_movie_record(emu->movie, emu->chip8, i, pressed) != 0)
+        {
+            fprintf(stderr, "Movie event lost: out of memory\n");
+        }
+    }
+}
+
+/* This function carries out the quick save/load requests, loading is off */
+/* while recording a movie                                                */
+static void emu_states(emu_context* emu)
+{
+    if(atomic_exchange_explicit(&emu->save_request, 0, memory_order_relaxed) != 0
+        && c8_state_write(emu->chip8, QUICK_STATE) != 0)
+    {
+        fprintf(stderr, "Failed to save %s\n", QUICK_STATE);
+    }
+
+    if(atomic_exchange_explicit(&emu->load_request, 0, memory_order_relaxed) != 0
+        && emu->movie == NULL && c8_state_read(emu->chip8, QUICK_STATE) != 0)
+    {
+        fprintf(stderr, "Failed to load %s\n", QUICK_STATE);
+    }
+}
+
+/* This function hands the display to the render thread and wakes it up, */
+/* unless a wake-up is already queued                                    */
+static void emu_publish(emu_context* emu, const C8InputReader* reader)
+{
+    C8Frame* back = c8_triple_back(&emu->frames);
+    SDL_Event e;
+
+    memcpy(back->display, emu->chip8->display, sizeof(back->display));
+    back->hires = emu->chip8->hires;
+    back->frame = emu->chip8->frame;
+    back->input = c8_input_sample(reader);
+    c8_triple_publish(&emu->frames);
+
+    if(atomic_exchange_explicit(&emu->frame_pending, 1, memory_order_relaxed) == 0)
+    {
+        SDL_zero(e);
+        e.type = emu->frame_event;
+
+        if(SDL_PushEvent(&e) < 0)
+        {
+            atomic_store_explicit(&emu->frame_pending, 0, memory_order_relaxed);
+        }
+    }
+}
 
-            if(chip8->sound_timer > 0)
+/* This function sleeps until the absolute CLOCK_MONOTONIC time _deadline_ */
+static void sleep_until_ns(UBIT64 deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadline / SECOND_TO_NS;
+    ts.tv_nsec = deadline % SECOND_TO_NS;
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+        /* Interrupted by a signal: sleep again */
+    }
+}
+
+/* Every 60Hz frame runs _ipf_ instructions in _slices_ evenly spaced     */
+/* slices, applying the input before each one, ticks the timers,          */
+/* publishes the display if it changed and then sleeps until the next     */
+/* frame deadline. While rewinding, frames are popped from the rewind     */
+/* buffer instead. Rendering never holds this thread back.               */
+static void* emu_thread(void* arg)
+{
+    emu_context* emu = arg;
+    Chip8* chip8 = emu->chip8;
+    C8InputReader input;
+
+    UBIT64 start = now_ns();
+    UBIT64 frame = 0;
+    UBIT64 deadline = 0;
+    UBIT64 now = 0;
+
+    c8_input_reader_init(&input);
+
+    while(atomic_load_explicit(&emu->quit, memory_order_relaxed) == 0)
+    {
+        emu_keys(emu, &input);
+        emu_states(emu);
+
+        if(atomic_load_explicit(&emu->rewinding, memory_order_relaxed) != 0 && emu->movie == NULL && emu->rw != NULL)
+        {
+            /* Drop the newest frame and show the one before it */
+            c8_rewind_step_back(emu->rw, chip8, 1);
+            c8_audio_frame(emu->audio, chip8);
+        }
+        else
+        {
+            /* Run the CPU for one frame (nothing runs while FX0A waits for a key). */
+            /* Movies record the keys at frame boundaries, so they poll only once. */
+            for(unsigned s = 0; s < emu->slices; s++)
             {
-                chip8->sound_timer--;
-                if(chip8->sound_timer == 0)
+                if(s > 0)
                 {
-                    // TODO play sound
-                    printf("Beeep\n");
+                    sleep_until_ns(start + frame * SECOND_TO_NS / C8_FRAME_HZ + s * SECOND_TO_NS / C8_FRAME_HZ / emu->slices);
+
+                    if(emu->movie == NULL)
+                    {
+                        emu_keys(emu, &input);
+                    }
                 }
+
+                c8_run(chip8, emu->ipf * (s + 1) / emu->slices - emu->ipf * s / emu->slices);
+                c8_input_observe(&input, chip8, now_ns());
             }
 
-            timedelta_us -= (1.0 / 60.0) * SECOND_TO_US;
-            intructions_per_60_hz = 0;
+            /* The buzzer sounds while the sound timer runs */
+            c8_audio_frame(emu->audio, chip8);
+
+            /* Update the timers, they keep running while the CPU is parked */
+            c8_tick_timers(chip8);
+
+            if(emu->rw != NULL)
+            {
+                c8_rewind_push(emu->rw, chip8);
+            }
         }
 
-        /* Run CPU Cycle */
-        chip8->loop();
+        if(emu->capture != NULL)
+        {
+            c8_capture_frame(emu->capture, chip8);
+        }
 
-        window_draw(ctx, chip8);
+        /* Publish only the frames that changed the display */
+        if(chip8->display_dirty == STD_TRUE)
+        {
+            emu_publish(emu, &input);
+            chip8->display_dirty = STD_FALSE;
+        }
 
-        while(SDL_PollEvent(&e))
+        /* Deadlines are computed from the start time, so no error accumulates */
+        frame++;
+        deadline = start + frame * SECOND_TO_NS / C8_FRAME_HZ;
+        now = now_ns();
+
+        if(now < deadline)
         {
-            /* Handle window events */
-            if(e.type == SDL_EVENT_QUIT)
-            {
-                quit = STD_TRUE; 
-            }
-        } 
+            sleep_until_ns(deadline);
+        }
+        else if(now - deadline > MAX_LATE_FRAMES * SECOND_TO_NS / C8_FRAME_HZ)
+        {
+            /* Host stalled: restart the schedule instead of bursting frames */
+            start = now;
+            frame = 0;
+        }
+    }
+
+    return NULL;
+}
+
+/* ---- Render thread ---- */
+
+/* The main thread owns SDL video: it waits for events, turns key events */
+/* into keypad bits and hotkey requests, and presents the latest frame   */
+/* whenever the emulation thread announces one.                          */
+int main_loop(window_context* ctx, emu_context* emu)
+{
+    SDL_Event e;
+    const C8Frame* f = NULL;
 
-        intructions_per_60_hz++;
+    while(SDL_WaitEvent(&e))
+    {
+        if(e.type == SDL_EVENT_QUIT)
+        {
+            break;
+        }
+        else if((e.type == SDL_EVENT_KEY_DOWN || e.type == SDL_EVENT_KEY_UP) && e.key.repeat == 0)
+        {
+            hotkey_event(emu, &e.key);
+        }
+        else if(e.type == SDL_EVENT_WINDOW_EXPOSED || e.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED)
+        {
+            window_present(ctx);
+        }
+        else if(e.type == emu->frame_event)
+        {
+            /* Clear first: a frame published from now on queues a new event */
+            atomic_store_explicit(&emu->frame_pending, 0, memory_order_relaxed);
 
-        last_time = curr_time;
+            f = c8_triple_acquire(&emu->frames);
+            if(f != NULL)
+            {
+                window_draw(ctx, f);
+                c8_input_record(&emu->latency, &f->input, now_ns());
+            }
+        }
     }
 
     return 0;
@@ -160,37 +594,244 @@ void window_deinit(SDL_Window* w)
 
 void debug_display(Chip8* chip8)
 {
-    for(int i = 0; i < DISP_H; i++)
+    for(int i = 0; i < c8_disp_h(chip8); i++)
     {
-        for(int j = 0; j < DISP_W; j++)
-            (chip8->display[i][j] == 1)? printf("X"): printf(" ");
+        for(int j = 0; j < c8_disp_w(chip8); j++)
+            (c8_pixel(chip8, j, i) != 0)? printf("X"): printf(" ");
         printf("\n");
     }
 }
 
 /* ---- Main Function ---- */
 
-int main()
+void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-i instructions_per_frame] [-q quirks] [-e engine] [-S seed] [-r movie] [-P fg:bg[:c2:c3]] [-k keys] [-s slices] [-L] [-C capture] rom\n", name);
+    fprintf(stderr, "       -k keys maps the keypad 0...F: 16 characters or 16 comma separated SDL scancode names\n");
+    fprintf(stderr, "       -s slices polls the keypad that many times per frame (%d)\n", FRAME_SLICES);
+    fprintf(stderr, "       -L prints the input latency on exit\n");
+    fprintf(stderr, "       -C capture records every frame shown (decode it with ./capture)\n");
+}
+
+/* This function parses a "RRGGBB:RRGGBB[:RRGGBB:RRGGBB]" palette: foreground, */
+/* background, then the XO-CHIP plane 1 and both planes colours               */
+int parse_palette(const char* arg, window_context* ctx)
+{
+    static const int order[PALETTE_SIZE] = { 1, 0, 2, 3 };
+    char* end = NULL;
+
+    for(int i = 0; i < PALETTE_SIZE; i++)
+    {
+        ctx->palette[order[i]] = strtoul(arg, &end, 16) & 0xFFFFFF;
+
+        if(*end == '\0')
+        {
+            /* Foreground and background are required, the others optional */
+            return (i == 1 || i == PALETTE_SIZE - 1) ? 0 : 1;
+        }
+
+        if(*end != ':')
+        {
+            return 1;
+        }
+
+        arg = end + 1;
+    }
+
+    return 1;
+}
+
+int main(int argc, char* argv[])
 {
     window_context ctx;
+    Chip8 machine;
+    C8Audio audio;
+    C8Rewind* rw = NULL;
+    C8Movie movie;
+    emu_context emu;
+    pthread_t emu_tid;
+    const char* movie_file = NULL;
+    const char* capture_file = NULL;
+    UBIT64 seed = C8_DEFAULT_SEED;
+    unsigned long ipf = C8_DEFAULT_IPF;
+    unsigned slices = FRAME_SLICES;
+    STD_BOOL latency = STD_FALSE;
+    int opt = 0;
+
+    Chip8* chip8 = c8_init(&machine);
+
+    /* Play on the fastest portable engine, -e picks another */
+    chip8->engine = C8_ENGINE_PREDECODED;
+
+    ctx.palette[0] = PALETTE_BG;
+    ctx.palette[1] = PALETTE_FG;
+    ctx.palette[2] = PALETTE_2;
+    ctx.palette[3] = PALETTE_3;
+
+    while((opt = getopt(argc, argv, "i:q:e:S:r:P:k:s:LC:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'i':
+            ipf = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            c8_set_quirks(chip8, (UBIT8)strtoul(optarg, NULL, 0));
+            break;
+        case 'e':
+            if(c8_set_engine(chip8, optarg) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            movie_file = optarg;
+            break;
+        case 'C':
+            capture_file = optarg;
+            break;
+        case 'P':
+            if(parse_palette(optarg, &ctx) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'k':
+            if(parse_keymap(optarg) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            slices = strtoul(optarg, NULL, 0);
+            slices = (slices > 0) ? slices : 1;
+            break;
+        case 'L':
+            latency = STD_TRUE;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
-    Chip8* chip8 = c8_init();
+    if(optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
 
     /* Load Chip8 ROM */
-    if(chip8->load_rom("test_opcode.ch8") != 0)
+    if(chip8->load_rom(chip8, argv[optind]) != 0)
     {
+        fprintf(stderr, "Failed to load %s\n", argv[optind]);
         return 1;
     }
 
+    c8_seed(chip8, seed);
+
+    if(movie_file != NULL)
+    {
+        c8_movie_start(&movie, chip8, seed, ipf);
+    }
+
     /* Init SDL Window */
     if(window_init(&ctx) != 0)
     {
         return 1;
     }
     
-    main_loop(&ctx, chip8);
+    /* Rewind is optional: without memory for it, play on */
+    if(movie_file == NULL)
+    {
+        rw = c8_rewind_create(REWIND_BYTES, REWIND_FRAMES, REWIND_KEYFRAME);
+        if(rw == NULL)
+        {
+            fprintf(stderr, "Rewind disabled: out of memory\n");
+        }
+    }
+
+    audio_init(&ctx, &audio);
+
+    /* Real-time capture: a frame the writer cannot take in time is dropped */
+    emu.capture = NULL;
+    if(capture_file != NULL && (emu.capture = c8_capture_open(capture_file, STD_FALSE)) == NULL)
+    {
+        fprintf(stderr, "Failed to create capture %s\n", capture_file);
+    }
+
+    emu.chip8 = chip8;
+    emu.audio = &audio;
+    emu.rw = rw;
+    emu.movie = (movie_file != NULL) ? &movie : NULL;
+    emu.ipf = ipf;
+    emu.slices = slices;
+    c8_triple_init(&emu.frames);
+    emu.frame_event = SDL_RegisterEvents(1);
+    atomic_init(&emu.frame_pending, 0);
+    c8_input_init(&emu.input);
+    memset(&emu.latency, 0, sizeof(emu.latency));
+    atomic_init(&emu.rewinding, 0);
+    atomic_init(&emu.save_request, 0);
+    atomic_init(&emu.load_request, 0);
+    atomic_init(&emu.quit, 0);
+
+    if(emu.frame_event == (Uint32)-1 || pthread_create(&emu_tid, NULL, emu_thread, &emu) != 0)
+    {
+        fprintf(stderr, "Failed to start the emulation thread\n");
+        return 1;
+    }
+
+    main_loop(&ctx, &emu);
+
+    /* The emulation thread owns the machine until it is joined */
+    atomic_store_explicit(&emu.quit, 1, memory_order_relaxed);
+    pthread_join(emu_tid, NULL);
+
+    /* Stop the audio thread before _audio_ goes out of scope */
+    if(ctx.a != NULL)
+    {
+        SDL_DestroyAudioStream(ctx.a);
+    }
 
     window_deinit(ctx.w);
+    c8_rewind_free(rw);
+
+    if(latency == STD_TRUE)
+    {
+        c8_input_write_stats(&emu.latency, stderr);
+    }
+
+    if(emu.capture != NULL)
+    {
+        if(emu.capture->dropped > 0)
+        {
+            fprintf(stderr, "Capture dropped %llu frames\n", (unsigned long long)emu.capture->dropped);
+        }
+
+        if(c8_capture_close(emu.capture) != 0)
+        {
+            fprintf(stderr, "Failed to write capture %s\n", capture_file);
+        }
+    }
+
+    if(movie_file != NULL)
+    {
+        c8_movie_stop(&movie, chip8);
+
+        if(c8_movie_write(&movie, movie_file) != 0)
+        {
+            fprintf(stderr, "Failed to write %s\n", movie_file);
+        }
+
+        c8_movie_free(&movie);
+    }
 
 #ifdef DEBUG
 
@@ -198,5 +839,7 @@ int main()
 
 #endif
 
+    c8_deinit(chip8);
+
     return 0;
-}
\ No newline at end of file
+}